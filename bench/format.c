@@ -0,0 +1,202 @@
+/*
+Lockstep — log resources consumed by userland Linux processes.
+© 2026 Ivan Gankevich
+
+This file is part of Lockstep.
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "config.h"
+
+#include <field.h>
+#include <format.h>
+#include <step.h>
+
+/*
+Compare the table-driven formatter with the sprintf-based one
+that it replaced. Both format every field of a realistic record.
+*/
+
+#define STEP_FIELD(name, format, member) {#name, format, offsetof(step_type, member)},
+
+static field_type step_fields[] = {
+    STEP_FIELDS(STEP_FIELD)
+};
+
+static const size_t num_fields = sizeof(step_fields) / sizeof(field_type);
+
+static const char* printf_formats[] = {
+    "%c", "%d", "%u", "%ld", "%lu", "%llu", "%lf", "%s", "%s"
+};
+
+static char*
+sprintf_field(char* buf, const step_type* step, const field_type* field) {
+    const void* ptr = ((const char*)step) + field->offset;
+    const char* format = printf_formats[field->format];
+    int ret = 0;
+    switch (field->format) {
+        case FIELD_CHAR: ret = sprintf(buf, format, *((const char*)ptr)); break;
+        case FIELD_INT: ret = sprintf(buf, format, *((const int*)ptr)); break;
+        case FIELD_UNSIGNED_INT: ret = sprintf(buf, format, *((const unsigned int*)ptr)); break;
+        case FIELD_LONG: ret = sprintf(buf, format, *((const long*)ptr)); break;
+        case FIELD_UNSIGNED_LONG: ret = sprintf(buf, format, *((const unsigned long*)ptr)); break;
+        case FIELD_UNSIGNED_LONG_LONG:
+            ret = sprintf(buf, format, *((const unsigned long long*)ptr));
+            break;
+        case FIELD_DOUBLE: ret = sprintf(buf, format, *((const double*)ptr)); break;
+        case FIELD_STRING: ret = sprintf(buf, format, (const char*)ptr); break;
+        case FIELD_STRING_ID: ret = sprintf(buf, format, intern_get(*((const intern_id*)ptr))); break;
+    }
+    return buf + ret;
+}
+
+static char*
+sprintf_record(char* first, const step_type* s) {
+    for (size_t i=0; i<num_fields; ++i) {
+        first = sprintf_field(first, s, step_fields + i);
+        *first++ = (i != num_fields-1) ? '|' : '\n';
+    }
+    return first;
+}
+
+static char*
+format_record(char* first, char* last, const step_type* s) {
+    for (size_t i=0; i<num_fields; ++i) {
+        first = format_field(first, last, s, step_fields + i);
+        if (first == NULL || first == last) { return NULL; }
+        *first++ = (i != num_fields-1) ? '|' : '\n';
+    }
+    return first;
+}
+
+static void
+init_step(step_type* s, int i) {
+    memset(s, 0, sizeof(step_type));
+    s->process_id = 32070 + i;
+    s->state = 'S';
+    s->parent_process_id = 31576;
+    s->process_group_id = 31576;
+    s->session_id = 31576;
+    s->tty_process_group_id = -1;
+    s->flags = 4194304;
+    s->minor_faults = 164 + 1000*i;
+    s->userspace_time = 86530 + i;
+    s->kernel_time = 1203 + i;
+    s->priority = 20;
+    s->num_threads = 1 + i%64;
+    s->virtual_memory_size = 12120064UL + 4096UL*i;
+    s->resident_set_size = 552 + i;
+    s->resident_set_limit = 18446744073709551615UL;
+    s->code_segment_start = 93909966192640UL;
+    s->code_segment_end = 93909966221865UL;
+    s->stack_start = 140733715118464UL;
+    s->exit_signal = 17;
+    s->processor = i%128;
+    s->cumulative_block_input_output_delay = 12345ULL*i;
+    s->data_start = 93909966241168UL;
+    s->data_end = 93909966256080UL;
+    s->brk_start = 93910948765696UL;
+    s->arg_start = 140733715120193UL;
+    s->arg_end = 140733715121058UL;
+    s->env_start = 140733715121058UL;
+    s->env_end = 140733715124199UL;
+    s->user_id = 1000 + i%16;
+    s->group_id = 1000;
+    s->uptime = 865.3 + 0.01*i;
+    s->idle_time = 584.28 + 0.01*i;
+    s->ticks_per_second = 100;
+    s->timestamp = 1792368146;
+    s->interval = 5000000;
+    char str[64];
+    s->start_time = 86530 + i;
+    s->command = intern_string(str, snprintf(str, sizeof(str), "solver-%d", i%8));
+    s->executable = intern_string(str, snprintf(str, sizeof(str), "/home/user/bin/solver-%d", i%8));
+    s->io.read_bytes = 1024UL*1024UL*i;
+    s->io.write_bytes = 4096UL*i;
+    s->network.in_octets = 15139120UL;
+    s->network.out_octets = 15138104UL;
+}
+
+static double
+elapsed_ns(const struct timespec* a, const struct timespec* b) {
+    return 1e9*(double)(b->tv_sec - a->tv_sec) + (double)(b->tv_nsec - a->tv_nsec);
+}
+
+#define NUM_STEPS 64
+#define NUM_ITERATIONS 20000
+
+int main(int argc, char* argv[]) {
+    static step_type steps[NUM_STEPS];
+    static char expected[4096*4];
+    static char actual[4096*4];
+    for (int i=0; i<NUM_STEPS; ++i) {
+        init_step(steps + i, i);
+        char* last1 = sprintf_record(expected, steps + i);
+        char* last2 = format_record(actual, actual + sizeof(actual), steps + i);
+        if (last2 == NULL || last1-expected != last2-actual ||
+            memcmp(expected, actual, last1-expected) != 0) {
+            fprintf(stderr, "output mismatch:\n%.*s%.*s",
+                    (int)(last1-expected), expected,
+                    last2 ? (int)(last2-actual) : 0, actual);
+            return 1;
+        }
+    }
+    struct timespec t0, t1, t2;
+    size_t nbytes = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int j=0; j<NUM_ITERATIONS; ++j) {
+        for (int i=0; i<NUM_STEPS; ++i) {
+            nbytes += sprintf_record(actual, steps + i) - actual;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    for (int j=0; j<NUM_ITERATIONS; ++j) {
+        for (int i=0; i<NUM_STEPS; ++i) {
+            nbytes += format_record(actual, actual + sizeof(actual), steps + i) - actual;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+    const double n = (double)NUM_ITERATIONS*NUM_STEPS;
+    const double sprintf_ns = elapsed_ns(&t0, &t1);
+    const double format_ns = elapsed_ns(&t1, &t2);
+    printf("%-16s %10.1f ns/record %8.2f ns/field\n", "sprintf",
+           sprintf_ns/n, sprintf_ns/n/(double)num_fields);
+    printf("%-16s %10.1f ns/record %8.2f ns/field\n", "format_field",
+           format_ns/n, format_ns/n/(double)num_fields);
+    printf("%-16s %10.2fx\n", "speedup", sprintf_ns/format_ns);
+    return nbytes == 0;
+}
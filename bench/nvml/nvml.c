@@ -0,0 +1,217 @@
+/*
+Lockstep — log resources consumed by userland Linux processes.
+© 2026 Ivan Gankevich
+
+This file is part of Lockstep.
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <nvml.h>
+
+#define MAX_DEVICES 64
+
+struct nvmlDevice_st {
+    unsigned int index;
+};
+
+static struct nvmlDevice_st devices[MAX_DEVICES];
+static unsigned int num_devices = 0;
+static unsigned int* pids = NULL;
+static unsigned int num_pids = 0;
+static unsigned long num_calls = 0;
+static int initialised = 0;
+
+static int
+compare_pids(const void* a, const void* b) {
+    const unsigned int x = *(const unsigned int*)a;
+    const unsigned int y = *(const unsigned int*)b;
+    return (x > y) - (x < y);
+}
+
+void
+nvml_stub_configure(unsigned int new_num_devices, const unsigned int* new_pids,
+                    unsigned int new_num_pids) {
+    num_devices = new_num_devices > MAX_DEVICES ? MAX_DEVICES : new_num_devices;
+    for (unsigned int i=0; i<num_devices; ++i) { devices[i].index = i; }
+    free(pids);
+    pids = malloc((new_num_pids == 0 ? 1 : new_num_pids)*sizeof(unsigned int));
+    if (pids == NULL) { abort(); }
+    memcpy(pids, new_pids, new_num_pids*sizeof(unsigned int));
+    num_pids = new_num_pids;
+    qsort(pids, num_pids, sizeof(unsigned int), compare_pids);
+    initialised = 1;
+}
+
+unsigned long
+nvml_stub_num_calls(void) {
+    return num_calls;
+}
+
+nvmlReturn_t
+nvmlInit(void) {
+    ++num_calls;
+    if (initialised) { return NVML_SUCCESS; }
+    const char* str = getenv("NVML_STUB_DEVICES");
+    const unsigned int n = str == NULL ? 1 : (unsigned int)strtoul(str, NULL, 10);
+    unsigned int buf[4096];
+    unsigned int m = 0;
+    str = getenv("NVML_STUB_PIDS");
+    while (str != NULL && *str != 0 && m != sizeof(buf)/sizeof(unsigned int)) {
+        char* end = NULL;
+        buf[m++] = (unsigned int)strtoul(str, &end, 10);
+        str = *end == ',' ? end+1 : end;
+    }
+    nvml_stub_configure(n, buf, m);
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t
+nvmlShutdown(void) {
+    ++num_calls;
+    return NVML_SUCCESS;
+}
+
+const char*
+nvmlErrorString(nvmlReturn_t result) {
+    switch (result) {
+        case NVML_SUCCESS: return "Success";
+        case NVML_ERROR_UNINITIALIZED: return "Uninitialized";
+        case NVML_ERROR_INVALID_ARGUMENT: return "Invalid Argument";
+        case NVML_ERROR_NOT_SUPPORTED: return "Not Supported";
+        case NVML_ERROR_NO_PERMISSION: return "Insufficient Permissions";
+        case NVML_ERROR_ALREADY_INITIALIZED: return "Already Initialized";
+        case NVML_ERROR_NOT_FOUND: return "Not Found";
+        case NVML_ERROR_INSUFFICIENT_SIZE: return "Insufficient Size";
+        default: return "Unknown Error";
+    }
+}
+
+nvmlReturn_t
+nvmlDeviceGetCount(unsigned int* count) {
+    ++num_calls;
+    if (!initialised) { return NVML_ERROR_UNINITIALIZED; }
+    *count = num_devices;
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t
+nvmlDeviceGetHandleByIndex(unsigned int index, nvmlDevice_t* device) {
+    ++num_calls;
+    if (index >= num_devices) { return NVML_ERROR_INVALID_ARGUMENT; }
+    *device = devices + index;
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t
+nvmlDeviceGetAccountingMode(nvmlDevice_t device, nvmlEnableState_t* mode) {
+    ++num_calls;
+    (void)device;
+    *mode = NVML_FEATURE_ENABLED;
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t
+nvmlDeviceSetAccountingMode(nvmlDevice_t device, nvmlEnableState_t mode) {
+    ++num_calls;
+    (void)device;
+    (void)mode;
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t
+nvmlDeviceGetAccountingPids(nvmlDevice_t device, unsigned int* count, unsigned int* result) {
+    ++num_calls;
+    (void)device;
+    if (*count < num_pids) {
+        *count = num_pids;
+        return NVML_ERROR_INSUFFICIENT_SIZE;
+    }
+    if (num_pids != 0) { memcpy(result, pids, num_pids*sizeof(unsigned int)); }
+    *count = num_pids;
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t
+nvmlDeviceGetAccountingStats(nvmlDevice_t device, unsigned int pid,
+                             nvmlAccountingStats_t* stats) {
+    ++num_calls;
+    if (bsearch(&pid, pids, num_pids, sizeof(unsigned int), compare_pids) == NULL) {
+        return NVML_ERROR_NOT_FOUND;
+    }
+    memset(stats, 0, sizeof(nvmlAccountingStats_t));
+    stats->gpuUtilization = (pid + device->index) % 100;
+    stats->memoryUtilization = (pid + 2*device->index) % 100;
+    stats->maxMemoryUsage = (pid % 1024ULL)*1024ULL*1024ULL;
+    stats->time = pid*10ULL;
+    stats->isRunning = 1;
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t
+nvmlDeviceGetUtilizationRates(nvmlDevice_t device, nvmlUtilization_t* utilization) {
+    ++num_calls;
+    utilization->gpu = (unsigned int)((num_calls + 10*device->index) % 101);
+    utilization->memory = (unsigned int)((num_calls + 20*device->index) % 101);
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t
+nvmlDeviceGetMemoryInfo(nvmlDevice_t device, nvmlMemory_t* memory) {
+    ++num_calls;
+    memory->total = 16ULL*1024ULL*1024ULL*1024ULL;
+    memory->used = (num_calls + device->index)*1024ULL*1024ULL % memory->total;
+    memory->free = memory->total - memory->used;
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t
+nvmlDeviceGetPowerUsage(nvmlDevice_t device, unsigned int* power) {
+    ++num_calls;
+    if (device->index == num_devices-1) { return NVML_ERROR_NOT_SUPPORTED; }
+    *power = 50000 + (unsigned int)(num_calls % 250000);
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t
+nvmlDeviceGetClockInfo(nvmlDevice_t device, nvmlClockType_t type, unsigned int* clock) {
+    ++num_calls;
+    (void)device;
+    *clock = type == NVML_CLOCK_MEM ? 5001 : 1410 - (unsigned int)(num_calls % 200);
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t
+nvmlDeviceGetCurrentClocksThrottleReasons(nvmlDevice_t device, unsigned long long* reasons) {
+    ++num_calls;
+    (void)device;
+    // idle or software power cap
+    *reasons = num_calls % 2 == 0 ? 0x1ULL : 0x4ULL;
+    return NVML_SUCCESS;
+}
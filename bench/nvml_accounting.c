@@ -0,0 +1,129 @@
+/*
+Lockstep — log resources consumed by userland Linux processes.
+© 2026 Ivan Gankevich
+
+This file is part of Lockstep.
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <nvml_step.h>
+
+/*
+Compare per-process per-device accounting queries with one query
+per device per tick on the stub NVML library: 8 devices, 20000 processes,
+200 of which use GPUs.
+*/
+
+#define NUM_DEVICES 8
+#define NUM_PROCESSES 20000
+#define NUM_GPU_PROCESSES 200
+#define NUM_TICKS 20
+
+static int
+collect_nvml_per_device(pid_t pid, nvml_step_t* nvml) {
+	memset(nvml, 0, sizeof(nvml_step_t));
+	nvmlAccountingStats_t stats;
+	for (unsigned int i=0; i<nvml_device_count; ++i) {
+		nvmlReturn_t result = nvmlDeviceGetAccountingStats(nvml_devices[i], pid, &stats);
+		if (result == NVML_ERROR_NOT_FOUND) { continue; }
+		if (result != NVML_SUCCESS) { return -1; }
+		nvml->gpu_utilisation += stats.gpuUtilization;
+		nvml->memory_utilization += stats.memoryUtilization;
+		nvml->max_memory_usage += stats.maxMemoryUsage;
+		nvml->time_ms += stats.time;
+	}
+	return 0;
+}
+
+static double
+elapsed_ns(const struct timespec* a, const struct timespec* b) {
+	return 1e9*(double)(b->tv_sec - a->tv_sec) + (double)(b->tv_nsec - a->tv_nsec);
+}
+
+int main(int argc, char* argv[]) {
+	static unsigned int gpu_pids[NUM_GPU_PROCESSES];
+	for (unsigned int i=0; i<NUM_GPU_PROCESSES; ++i) {
+		gpu_pids[i] = 1000 + i*(NUM_PROCESSES/NUM_GPU_PROCESSES);
+	}
+	nvml_stub_configure(NUM_DEVICES, gpu_pids, NUM_GPU_PROCESSES);
+	if (nvmlInit() != NVML_SUCCESS || nvmlDeviceGetCount(&nvml_device_count) != NVML_SUCCESS) {
+		return 1;
+	}
+	for (unsigned int i=0; i<nvml_device_count; ++i) {
+		if (nvmlDeviceGetHandleByIndex(i, nvml_devices + i) != NVML_SUCCESS) { return 1; }
+	}
+	// both methods return the same statistics
+	if (nvml_collect_accounting() == -1) { return 1; }
+	for (pid_t pid=1000; pid<1000+NUM_PROCESSES; ++pid) {
+		nvml_step_t expected, actual;
+		if (collect_nvml_per_device(pid, &expected) == -1 || collect_nvml(pid, &actual) == -1 ||
+			memcmp(&expected, &actual, sizeof(nvml_step_t)) != 0) {
+			fprintf(stderr, "statistics mismatch for pid %d\n", (int)pid);
+			return 1;
+		}
+	}
+	nvml_step_t step;
+	unsigned long long checksum = 0;
+	struct timespec t0, t1, t2;
+	const unsigned long calls0 = nvml_stub_num_calls();
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (int j=0; j<NUM_TICKS; ++j) {
+		for (pid_t pid=1000; pid<1000+NUM_PROCESSES; ++pid) {
+			collect_nvml_per_device(pid, &step);
+			checksum += step.time_ms;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	const unsigned long calls1 = nvml_stub_num_calls();
+	for (int j=0; j<NUM_TICKS; ++j) {
+		nvml_collect_accounting();
+		for (pid_t pid=1000; pid<1000+NUM_PROCESSES; ++pid) {
+			collect_nvml(pid, &step);
+			checksum += step.time_ms;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+	const unsigned long calls2 = nvml_stub_num_calls();
+	const double per_device_ns = elapsed_ns(&t0, &t1);
+	const double accounting_ns = elapsed_ns(&t1, &t2);
+	printf("%-16s %10.1f us/tick %8lu calls/tick\n", "per device",
+		   per_device_ns/NUM_TICKS*1e-3, (calls1-calls0)/NUM_TICKS);
+	printf("%-16s %10.1f us/tick %8lu calls/tick\n", "accounting pids",
+		   accounting_ns/NUM_TICKS*1e-3, (calls2-calls1)/NUM_TICKS);
+	printf("%-16s %10.2fx\n", "speedup", per_device_ns/accounting_ns);
+	nvmlShutdown();
+	return checksum == 0;
+}
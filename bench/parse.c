@@ -0,0 +1,410 @@
+/*
+Lockstep — log resources consumed by userland Linux processes.
+© 2026 Ivan Gankevich
+
+This file is part of Lockstep.
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC 1
+#endif
+
+#include "config.h"
+
+#include <field.h>
+#include <format.h>
+#include <parse.h>
+#include <step.h>
+
+/*
+Benchmark the parsers and the formatters on the samples of real /proc
+files. Every sample file contains either one file (io, netstat, uptime,
+proc_stat, meminfo, diskstats, netdev, smaps_rollup, numa_maps) or one
+record per line (stat, duration, hwmon). The output is one line per
+benchmark with the time and the number of CPU cycles per operation and
+per processed byte (the input of the parsers and the output of the
+formatters) so that the results of different commits can be compared.
+*/
+
+#define MAX_LINES 256
+#define MIN_NS 200000000.0
+
+typedef struct {
+    char* data;
+    size_t size;
+    char* lines[MAX_LINES];
+    size_t line_sizes[MAX_LINES];
+    size_t num_lines;
+} sample_type;
+
+typedef struct {
+    const char* name;
+    sample_type* sample;
+    // returns the number of processed bytes
+    size_t (*run)(const sample_type* sample);
+} benchmark_type;
+
+static volatile size_t sink = 0;
+
+static void
+load_sample(const char* directory, const char* name, sample_type* sample) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", directory, name);
+    FILE* in = fopen(path, "r");
+    if (in == NULL) {
+        fprintf(stderr, "unable to open %s\n", path);
+        exit(1);
+    }
+    size_t capacity = 4096;
+    sample->data = malloc(capacity);
+    sample->size = 0;
+    size_t n;
+    while ((n = fread(sample->data + sample->size, 1, capacity - sample->size - 1, in)) != 0) {
+        sample->size += n;
+        if (capacity - sample->size == 1) {
+            capacity *= 2;
+            sample->data = realloc(sample->data, capacity);
+        }
+    }
+    fclose(in);
+    sample->data[sample->size] = 0;
+    // split the copy into NUL-terminated lines, data keeps the whole file
+    sample->num_lines = 0;
+    char* copy = malloc(sample->size + 1);
+    memcpy(copy, sample->data, sample->size + 1);
+    char* first = copy;
+    char* last = copy + sample->size;
+    while (first != last && sample->num_lines != MAX_LINES) {
+        char* newline = memchr(first, '\n', last-first);
+        if (newline == NULL) { newline = last; }
+        *newline = 0;
+        sample->lines[sample->num_lines] = first;
+        sample->line_sizes[sample->num_lines] = newline - first;
+        ++sample->num_lines;
+        first = newline == last ? last : newline + 1;
+    }
+}
+
+static size_t
+bench_stat(const sample_type* sample) {
+    step_type s;
+    char command[17];
+    for (size_t i=0; i<sample->num_lines; ++i) {
+        sink += parse_stat(sample->lines[i], &s, command);
+    }
+    return sample->size;
+}
+
+static size_t
+bench_io(const sample_type* sample) {
+    io_step_t io;
+    sink += parse_io(sample->data, &io);
+    return sample->size;
+}
+
+static size_t
+bench_netstat(const sample_type* sample) {
+    network_step_t network;
+    sink += parse_netstat(sample->data, &network);
+    return sample->size;
+}
+
+static size_t
+bench_uptime(const sample_type* sample) {
+    double uptime = 0, idle_time = 0;
+    sink += parse_uptime(sample->data, &uptime, &idle_time);
+    return sample->size;
+}
+
+static size_t
+bench_cpu(const sample_type* sample) {
+    counters_step_t c;
+    const char* first = sample->data;
+    const char* last = first + sample->size;
+    // the daemon stops at the first line that is not a cpu line
+    do {
+        first = parse_cpu_line(first, last, &c);
+        sink += c.nvalues;
+    } while (c.nvalues != 0 && first != last);
+    return first - sample->data;
+}
+
+static size_t
+bench_meminfo(const sample_type* sample) {
+    counters_step_t c;
+    sink += parse_meminfo(sample->data, sample->data + sample->size, &c);
+    return sample->size;
+}
+
+static size_t
+bench_smaps_rollup(const sample_type* sample) {
+    smaps_step_t smaps;
+    sink += parse_smaps_rollup(sample->data, sample->data + sample->size, &smaps);
+    return sample->size;
+}
+
+static size_t
+bench_numa_maps(const sample_type* sample) {
+    unsigned long long bytes[MAX_NUMA_NODES] = {0};
+    parse_numa_maps(sample->data, sample->data + sample->size, bytes);
+    sink += bytes[0];
+    return sample->size;
+}
+
+static size_t
+bench_diskstats(const sample_type* sample) {
+    counters_step_t c;
+    const char* first = sample->data;
+    const char* last = first + sample->size;
+    while (first != last) {
+        first = parse_diskstats_line(first, last, &c);
+        sink += c.nvalues;
+    }
+    return sample->size;
+}
+
+static size_t
+bench_netdev(const sample_type* sample) {
+    counters_step_t c;
+    const char* first = sample->data;
+    const char* last = first + sample->size;
+    while (first != last) {
+        first = parse_netdev_line(first, last, &c);
+        sink += c.nvalues;
+    }
+    return sample->size;
+}
+
+static size_t
+bench_duration(const sample_type* sample) {
+    for (size_t i=0; i<sample->num_lines; ++i) {
+        const char* first = sample->lines[i];
+        sink += parse_duration(first, first + sample->line_sizes[i]);
+    }
+    return sample->size;
+}
+
+typedef struct {
+    char device[32];
+    char sensor[32];
+    char value[32];
+    char label[32];
+    char name[32];
+} hwmon_sample_type;
+
+static hwmon_sample_type hwmon_samples[MAX_LINES];
+
+static char*
+copy_column(char* first, char* dst, size_t size) {
+    size_t n = 0;
+    while (*first != 0 && *first != '|') {
+        if (n != size-1) { dst[n++] = *first; }
+        ++first;
+    }
+    dst[n] = 0;
+    return *first == '|' ? first+1 : first;
+}
+
+static void
+init_hwmon(const sample_type* sample) {
+    for (size_t i=0; i<sample->num_lines; ++i) {
+        hwmon_sample_type* h = hwmon_samples + i;
+        char* first = sample->lines[i];
+        first = copy_column(first, h->device, sizeof(h->device));
+        first = copy_column(first, h->sensor, sizeof(h->sensor));
+        first = copy_column(first, h->value, sizeof(h->value));
+        first = copy_column(first, h->label, sizeof(h->label));
+        copy_column(first, h->name, sizeof(h->name));
+    }
+}
+
+static size_t
+bench_hwmon_line(const sample_type* sample) {
+    char buf[4096];
+    size_t nbytes = 0;
+    for (size_t i=0; i<sample->num_lines; ++i) {
+        const hwmon_sample_type* h = hwmon_samples + i;
+        char* last = format_hwmon_line(buf, buf + sizeof(buf), 1792368146,
+                                       h->device, h->sensor,
+                                       h->value, strlen(h->value),
+                                       h->label, strlen(h->label),
+                                       h->name, strlen(h->name));
+        nbytes += last - buf;
+    }
+    sink += nbytes;
+    return nbytes;
+}
+
+#define STEP_FIELD(name, format, member) {#name, format, offsetof(step_type, member)},
+
+static field_type step_fields[] = {
+    STEP_FIELDS(STEP_FIELD)
+};
+
+static const size_t num_fields = sizeof(step_fields) / sizeof(field_type);
+
+static step_type format_steps[MAX_LINES];
+
+static void
+init_format(const sample_type* sample) {
+    char command[17];
+    for (size_t i=0; i<sample->num_lines; ++i) {
+        step_type* s = format_steps + i;
+        memset(command, 0, sizeof(command));
+        parse_stat(sample->lines[i], s, command);
+        s->command = intern_string(command, strlen(command));
+        s->executable = s->command;
+    }
+}
+
+static size_t
+bench_format_record(const sample_type* sample) {
+    char buf[4096*4];
+    size_t nbytes = 0;
+    for (size_t i=0; i<sample->num_lines; ++i) {
+        char* first = buf;
+        char* last = buf + sizeof(buf);
+        for (size_t j=0; j<num_fields; ++j) {
+            first = format_field(first, last, format_steps + i, step_fields + j);
+            *first++ = (j != num_fields-1) ? '|' : '\n';
+        }
+        nbytes += first - buf;
+    }
+    sink += nbytes;
+    return nbytes;
+}
+
+static double
+elapsed_ns(const struct timespec* a, const struct timespec* b) {
+    return 1e9*(double)(b->tv_sec - a->tv_sec) + (double)(b->tv_nsec - a->tv_nsec);
+}
+
+static unsigned long long
+cycles(void) {
+#if defined(HAVE_RDTSC)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static void
+run_benchmark(const benchmark_type* b) {
+    // warm up and calibrate the number of iterations
+    size_t niterations = 1;
+    struct timespec t0, t1;
+    for (;;) {
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (size_t i=0; i<niterations; ++i) { b->run(b->sample); }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        if (elapsed_ns(&t0, &t1) >= MIN_NS/10) { break; }
+        niterations *= 2;
+    }
+    niterations *= 10;
+    size_t nbytes = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    const unsigned long long c0 = cycles();
+    for (size_t i=0; i<niterations; ++i) { nbytes += b->run(b->sample); }
+    const unsigned long long c1 = cycles();
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    const double nops = (double)niterations*(double)b->sample->num_lines;
+    const double ns = elapsed_ns(&t0, &t1);
+    printf("%-16s %10.1f ns/op", b->name, ns/nops);
+#if defined(HAVE_RDTSC)
+    const double ncycles = (double)(c1 - c0);
+    printf(" %10.1f cycles/op %8.2f cycles/byte\n", ncycles/nops, ncycles/(double)nbytes);
+#else
+    (void)c0; (void)c1;
+    printf(" %10s cycles/op %8s cycles/byte\n", "n/a", "n/a");
+#endif
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s samples-directory\n", argv[0]);
+        return 1;
+    }
+    const char* directory = argv[1];
+    static sample_type stat, io, netstat, uptime, duration, hwmon;
+    static sample_type proc_stat, meminfo, diskstats, netdev, smaps_rollup, numa_maps;
+    load_sample(directory, "stat", &stat);
+    load_sample(directory, "io", &io);
+    load_sample(directory, "netstat", &netstat);
+    load_sample(directory, "uptime", &uptime);
+    load_sample(directory, "duration", &duration);
+    load_sample(directory, "hwmon", &hwmon);
+    load_sample(directory, "proc_stat", &proc_stat);
+    load_sample(directory, "meminfo", &meminfo);
+    load_sample(directory, "diskstats", &diskstats);
+    load_sample(directory, "netdev", &netdev);
+    load_sample(directory, "smaps_rollup", &smaps_rollup);
+    load_sample(directory, "numa_maps", &numa_maps);
+    // multi-line files are one operation
+    io.num_lines = 1;
+    netstat.num_lines = 1;
+    uptime.num_lines = 1;
+    proc_stat.num_lines = 1;
+    meminfo.num_lines = 1;
+    diskstats.num_lines = 1;
+    netdev.num_lines = 1;
+    smaps_rollup.num_lines = 1;
+    numa_maps.num_lines = 1;
+    init_hwmon(&hwmon);
+    init_format(&stat);
+    const benchmark_type benchmarks[] = {
+        {"stat", &stat, bench_stat},
+        {"io", &io, bench_io},
+        {"netstat", &netstat, bench_netstat},
+        {"uptime", &uptime, bench_uptime},
+        {"duration", &duration, bench_duration},
+        {"cpu", &proc_stat, bench_cpu},
+        {"meminfo", &meminfo, bench_meminfo},
+        {"diskstats", &diskstats, bench_diskstats},
+        {"netdev", &netdev, bench_netdev},
+        {"smaps_rollup", &smaps_rollup, bench_smaps_rollup},
+        {"numa_maps", &numa_maps, bench_numa_maps},
+        {"hwmon_line", &hwmon, bench_hwmon_line},
+        {"format_record", &stat, bench_format_record},
+    };
+    const size_t nbenchmarks = sizeof(benchmarks) / sizeof(benchmark_type);
+    for (size_t i=0; i<nbenchmarks; ++i) {
+        run_benchmark(benchmarks + i);
+    }
+    return 0;
+}
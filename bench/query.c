@@ -0,0 +1,221 @@
+/*
+Lockstep — log resources consumed by userland Linux processes.
+© 2026 Ivan Gankevich
+
+This file is part of Lockstep.
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#define _GNU_SOURCE
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "config.h"
+
+#include <field.h>
+#include <intern.h>
+#include <segment_writer.h>
+#include <step.h>
+#include <writer.h>
+
+/*
+Write a month of synthetic process records to the segments with the
+writer of lockstep and measure how long lockstep-query takes to scan them.
+The records of NUM_PROCESSES processes are sampled every INTERVAL seconds.
+Usage: bench-query lockstep-query [directory]
+*/
+
+#define NUM_DAYS 30
+#define NUM_PROCESSES 100
+#define INTERVAL 10
+#define NUM_COMMANDS 20
+
+#define STEP_FIELD(name, format, member) {#name, format, offsetof(step_type, member)},
+
+static field_type step_fields[] = {
+    STEP_FIELDS(STEP_FIELD)
+};
+
+static const size_t num_fields = sizeof(step_fields) / sizeof(field_type);
+
+static const char* segment_fields[] = {
+    "timestamp", "pid", "command", "resident_set_size", "userspace_time", "cpu_percent"
+};
+
+static const field_type*
+find_step_field(const char* name) {
+    for (size_t i=0; i<num_fields; ++i) {
+        if (strcmp(step_fields[i].name, name) == 0) { return step_fields + i; }
+    }
+    fprintf(stderr, "unknown field %s\n", name);
+    exit(1);
+}
+
+static double
+elapsed_s(const struct timespec* t0, const struct timespec* t1) {
+    return (double)(t1->tv_sec - t0->tv_sec) + 1e-9*(double)(t1->tv_nsec - t0->tv_nsec);
+}
+
+static unsigned long
+write_segments(time_t first_timestamp) {
+    // write every block without dropping and without batching
+    writer_policy = WRITER_BLOCK;
+    writer_flush_interval = 0;
+    writer_start(1);
+    for (size_t i=0; i<sizeof(segment_fields)/sizeof(const char*); ++i) {
+        segment_add_column(find_step_field(segment_fields[i]));
+    }
+    intern_id commands[NUM_COMMANDS];
+    for (int i=0; i<NUM_COMMANDS; ++i) {
+        char name[32];
+        const int n = snprintf(name, sizeof(name), "command-%d", i);
+        commands[i] = intern_string(name, n);
+    }
+    step_type s;
+    memset(&s, 0, sizeof(s));
+    unsigned long nrows = 0;
+    const time_t last_timestamp = first_timestamp + NUM_DAYS*24L*60L*60L;
+    for (time_t t=first_timestamp; t<last_timestamp; t+=INTERVAL) {
+        for (int i=0; i<NUM_PROCESSES; ++i) {
+            const long k = (long)(t - first_timestamp)/INTERVAL;
+            s.timestamp = t;
+            s.process_id = 1000 + i;
+            s.command = commands[i % NUM_COMMANDS];
+            s.resident_set_size = 1000 + 10*i + (k*(i+1)) % 5000;
+            s.userspace_time = (unsigned long)(k*(i % 4));
+            s.cpu_percent = (double)((k + i) % 1000)*0.1;
+            segment_add(&s, s.timestamp, s.process_id);
+            ++nrows;
+        }
+    }
+    segment_close();
+    writer_stop(NULL, 0);
+    return nrows;
+}
+
+static void
+remove_segments(const char* path) {
+    DIR* dir = opendir(path);
+    if (dir == NULL) { return; }
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] != '.') { unlinkat(dirfd(dir), entry->d_name, 0); }
+    }
+    closedir(dir);
+    rmdir(path);
+}
+
+static unsigned long
+segments_size(const char* path) {
+    DIR* dir = opendir(path);
+    if (dir == NULL) { return 0; }
+    unsigned long nbytes = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        struct stat st;
+        if (entry->d_name[0] != '.' && fstatat(dirfd(dir), entry->d_name, &st, 0) == 0) {
+            nbytes += st.st_size;
+        }
+    }
+    closedir(dir);
+    return nbytes;
+}
+
+/* Run lockstep-query with its output discarded and return the wall-clock time. */
+static double
+run_query(const char* name, char* const argv[]) {
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    pid_t pid = fork();
+    if (pid == -1) { perror("fork"); exit(1); }
+    if (pid == 0) {
+        int fd = open("/dev/null", O_WRONLY|O_CLOEXEC);
+        if (fd == -1 || dup2(fd, STDOUT_FILENO) == -1) { _exit(1); }
+        execv(argv[0], argv);
+        perror("execv");
+        _exit(1);
+    }
+    int status = 0;
+    if (waitpid(pid, &status, 0) == -1) { perror("waitpid"); exit(1); }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "%s failed\n", argv[0]);
+        exit(1);
+    }
+    const double seconds = elapsed_s(&t0, &t1);
+    printf("%-24s %8.3f s\n", name, seconds);
+    return seconds;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s lockstep-query [directory]\n", argv[0]);
+        return 1;
+    }
+    char directory[PATH_MAX] = "/tmp/lockstep-bench-query-XXXXXX";
+    if (argc >= 3) {
+        snprintf(directory, sizeof(directory), "%s/lockstep-bench-query-XXXXXX", argv[2]);
+    }
+    if (mkdtemp(directory) == NULL) { perror("mkdtemp"); return 1; }
+    snprintf(segment_directory, sizeof(segment_directory), "%s", directory);
+    // 2026-01-01T00:00:00Z
+    const time_t first_timestamp = 1767225600;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    const unsigned long nrows = write_segments(first_timestamp);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    const unsigned long nbytes = segments_size(directory);
+    printf("%-24s %8.3f s %lu rows %.1f MiB %.2f bytes/row\n", "write", elapsed_s(&t0, &t1),
+           nrows, (double)nbytes/(1024.0*1024.0), (double)nbytes/(double)nrows);
+    char last_week[32];
+    snprintf(last_week, sizeof(last_week), "%ld",
+             (long)(first_timestamp + (NUM_DAYS-7)*24L*60L*60L));
+    char* month[] = {argv[1], "-g", "command", "-a", "max:resident_set_size",
+                     "-a", "avg:cpu_percent", directory, NULL};
+    char* week[] = {argv[1], "-s", last_week, "-g", "command", "-a", "max:resident_set_size",
+                    directory, NULL};
+    char* predicate[] = {argv[1], "-w", "resident_set_size>6000", "-a", "count:pid",
+                         directory, NULL};
+    run_query("month", month);
+    run_query("last week", week);
+    run_query("month, predicate", predicate);
+    remove_segments(directory);
+    return 0;
+}
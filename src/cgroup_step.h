@@ -0,0 +1,237 @@
+/*
+Lockstep — log resources consumed by userland Linux processes.
+© 2026 Ivan Gankevich
+
+This file is part of Lockstep.
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef CGROUP_STEP_H
+#define CGROUP_STEP_H
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <fcntl.h>
+#include <limits.h>
+#include <regex.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <intern.h>
+#include <process_table.h>
+#include <step.h>
+
+/*
+The cgroup of a process is read from /proc/<pid>/cgroup once per
+(pid, start time), after exec and then every cgroup_refresh_interval
+to notice migrations. The unified hierarchy (0::) is preferred, otherwise
+name=systemd is used. The path and the tag (the first capture of
+the cgroup.tag regular expression or the whole match) are stored per cgroup
+inode, so that the expression is matched once per cgroup.
+*/
+
+typedef struct {
+    ino_t inode;
+    unsigned int generation;
+    intern_id path;
+    intern_id tag;
+} cgroup_entry_type;
+
+// in microseconds
+static uint64_t cgroup_refresh_interval = 60000000UL;
+static char cgroup_root[PATH_MAX] = "/sys/fs/cgroup";
+static regex_t cgroup_tag_regex;
+static int cgroup_has_tag_regex = 0;
+// open addressing, inode zero is an empty slot
+static cgroup_entry_type* cgroup_table = NULL;
+static unsigned int cgroup_table_capacity = 0;
+static unsigned int cgroup_table_size = 0;
+
+static void
+cgroup_set_tag_regex(const char* pattern) {
+    if (cgroup_has_tag_regex) { regfree(&cgroup_tag_regex); }
+    int ret = regcomp(&cgroup_tag_regex, pattern, REG_EXTENDED);
+    if (ret != 0) {
+        char message[256];
+        regerror(ret, &cgroup_tag_regex, message, sizeof(message));
+        fprintf(stderr, "bad cgroup tag regular expression %s: %s\n", pattern, message);
+        exit(1);
+    }
+    cgroup_has_tag_regex = 1;
+}
+
+static intern_id
+cgroup_tag(const char* path) {
+    if (!cgroup_has_tag_regex) { return 0; }
+    regmatch_t match[2];
+    if (regexec(&cgroup_tag_regex, path, 2, match, 0) != 0) { return 0; }
+    const regmatch_t* m = match[1].rm_so != -1 ? match+1 : match;
+    return intern_string(path + m->rm_so, m->rm_eo - m->rm_so);
+}
+
+static cgroup_entry_type*
+cgroup_table_slot(cgroup_entry_type* table, unsigned int capacity, ino_t inode) {
+    const unsigned int mask = capacity-1;
+    unsigned int i = (unsigned int)(inode*2654435761U) & mask;
+    while (table[i].inode != 0 && table[i].inode != inode) { i = (i+1) & mask; }
+    return table + i;
+}
+
+static void
+cgroup_table_rehash(unsigned int capacity) {
+    cgroup_entry_type* table = calloc(capacity, sizeof(cgroup_entry_type));
+    if (table == NULL) { perror("calloc"); exit(1); }
+    for (unsigned int i=0; i<cgroup_table_capacity; ++i) {
+        if (cgroup_table[i].inode == 0) { continue; }
+        *cgroup_table_slot(table, capacity, cgroup_table[i].inode) = cgroup_table[i];
+    }
+    free(cgroup_table);
+    cgroup_table = table;
+    cgroup_table_capacity = capacity;
+}
+
+/* Remove the cgroups that no process referenced since the previous sweep. */
+static void
+cgroup_table_sweep(unsigned int generation) {
+    unsigned int removed = 0;
+    for (unsigned int i=0; i<cgroup_table_capacity; ++i) {
+        cgroup_entry_type* e = cgroup_table + i;
+        if (e->inode == 0 || e->generation == generation) { continue; }
+        memset(e, 0, sizeof(cgroup_entry_type));
+        ++removed;
+    }
+    if (removed == 0) { return; }
+    cgroup_table_size -= removed;
+    cgroup_table_rehash(cgroup_table_capacity);
+}
+
+/* Returns the length of the path or -1. */
+static ssize_t
+read_cgroup_path(int process_dir_fd, char* path, size_t max_size) {
+    char buf[4096];
+    int fd = openat(process_dir_fd, "cgroup", O_RDONLY|O_CLOEXEC);
+    if (fd == -1) { return -1; }
+    ssize_t n = read(fd, buf, sizeof(buf)-1);
+    close(fd);
+    if (n <= 0) { return -1; }
+    buf[n] = 0;
+    const char* result = NULL;
+    const char* result_last = NULL;
+    char* first = buf;
+    while (*first != 0) {
+        char* last = strchr(first, '\n');
+        if (last == NULL) { last = buf + n; }
+        // hierarchy-ID:controller-list:cgroup-path
+        char* colon = memchr(first, ':', last-first);
+        char* colon2 = colon == NULL ? NULL : memchr(colon+1, ':', last-colon-1);
+        if (colon2 != NULL) {
+            if (colon2 == colon+1 && colon-first == 1 && *first == '0') {
+                result = colon2+1;
+                result_last = last;
+                break;
+            }
+            if (result == NULL && colon2-colon-1 == 12 && strncmp(colon+1, "name=systemd", 12) == 0) {
+                result = colon2+1;
+                result_last = last;
+            }
+        }
+        first = *last == 0 ? last : last+1;
+    }
+    if (result == NULL || (size_t)(result_last-result) >= max_size) { return -1; }
+    memcpy(path, result, result_last-result);
+    path[result_last-result] = 0;
+    return result_last-result;
+}
+
+static void
+resolve_cgroup(int process_dir_fd, process_state_type* p) {
+    char path[PATH_MAX];
+    ssize_t n = read_cgroup_path(process_dir_fd, path, sizeof(path));
+    if (n == -1) {
+        p->cgroup_inode = 0;
+        p->cgroup = 0;
+        p->cgroup_tag = 0;
+        return;
+    }
+    char full_path[sizeof(cgroup_root) + PATH_MAX];
+    snprintf(full_path, sizeof(full_path), "%s%s", cgroup_root, path);
+    struct stat st;
+    const ino_t inode = stat(full_path, &st) == -1 ? 0 : st.st_ino;
+    if (inode == 0) {
+        // not mounted where we expect it: no caching
+        p->cgroup_inode = 0;
+        p->cgroup = intern_string(path, n);
+        p->cgroup_tag = cgroup_tag(path);
+        return;
+    }
+    if (2*(cgroup_table_size+1) > cgroup_table_capacity) {
+        cgroup_table_rehash(cgroup_table_capacity == 0 ? 256 : 2*cgroup_table_capacity);
+    }
+    cgroup_entry_type* e = cgroup_table_slot(cgroup_table, cgroup_table_capacity, inode);
+    if (e->inode == 0) {
+        e->inode = inode;
+        e->path = intern_string(path, n);
+        e->tag = cgroup_tag(path);
+        ++cgroup_table_size;
+    } else if (intern_size(e->path) != (size_t)n || memcmp(intern_get(e->path), path, n) != 0) {
+        // the cgroup was renamed
+        e->path = intern_string(path, n);
+        e->tag = cgroup_tag(path);
+    }
+    p->cgroup_inode = inode;
+    p->cgroup = e->path;
+    p->cgroup_tag = e->tag;
+}
+
+static void
+collect_cgroup(int process_dir_fd, process_state_type* p, int exec, uint64_t now,
+               step_type* s) {
+    if (p->cgroup_time == 0 || exec || now - p->cgroup_time >= cgroup_refresh_interval) {
+        resolve_cgroup(process_dir_fd, p);
+        p->cgroup_time = now;
+    }
+    if (p->cgroup_inode != 0) {
+        // keep the cgroup and its strings from being swept
+        cgroup_entry_type* e = cgroup_table_slot(cgroup_table, cgroup_table_capacity,
+                                                 p->cgroup_inode);
+        if (e->inode == p->cgroup_inode) {
+            e->generation = process_table_generation;
+            p->cgroup = e->path;
+            p->cgroup_tag = e->tag;
+        }
+    }
+    intern_touch(p->cgroup);
+    intern_touch(p->cgroup_tag);
+    s->cgroup = p->cgroup;
+    s->cgroup_tag = p->cgroup_tag;
+}
+
+#endif // vim:filetype=c
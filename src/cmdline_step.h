@@ -0,0 +1,162 @@
+/*
+Lockstep — log resources consumed by userland Linux processes.
+© 2026 Ivan Gankevich
+
+This file is part of Lockstep.
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef CMDLINE_STEP_H
+#define CMDLINE_STEP_H
+
+#include <sys/types.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <intern.h>
+#include <process_table.h>
+#include <step.h>
+
+/*
+The command line and the selected environment variables of a process
+are read once per (pid, start time) and again after exec, the values
+are kept in the process table. Arguments are separated by spaces; '|' and
+control characters are replaced with '_' to keep the records parseable.
+*/
+
+typedef enum {
+    CMDLINE_EVERY_RECORD,
+    CMDLINE_FIRST_RECORD
+} cmdline_emit_type;
+
+static cmdline_emit_type cmdline_emit = CMDLINE_EVERY_RECORD;
+// the maximum length of the command line and of every variable
+static size_t cmdline_max_size = 1024;
+// the maximum number of bytes of /proc/<pid>/environ that are read
+static size_t environ_max_size = 1024*1024;
+static char env_names[MAX_ENV_FIELDS][128];
+static size_t num_env_names = 0;
+
+static inline void
+cmdline_sanitise(char* first, char* last) {
+    for (; first != last; ++first) {
+        if (*first == 0) { *first = ' '; }
+        else if (*first == '|' || (unsigned char)*first < ' ' || *first == 127) { *first = '_'; }
+    }
+}
+
+static intern_id
+read_cmdline(int process_dir_fd) {
+    char buf[65536];
+    const size_t max_size = cmdline_max_size < sizeof(buf) ? cmdline_max_size : sizeof(buf);
+    int fd = openat(process_dir_fd, "cmdline", O_RDONLY|O_CLOEXEC);
+    if (fd == -1) { return 0; }
+    ssize_t n = read(fd, buf, max_size);
+    close(fd);
+    if (n <= 0) { return 0; }
+    // the last argument ends with NUL
+    while (n != 0 && buf[n-1] == 0) { --n; }
+    cmdline_sanitise(buf, buf + n);
+    return intern_string(buf, n);
+}
+
+static void
+match_environ_entry(const char* first, const char* last, intern_id* env) {
+    const char* equals = memchr(first, '=', last-first);
+    if (equals == NULL) { return; }
+    for (size_t i=0; i<num_env_names; ++i) {
+        const size_t n = strlen(env_names[i]);
+        if ((size_t)(equals-first) != n || memcmp(first, env_names[i], n) != 0) { continue; }
+        char value[4096];
+        size_t size = last-equals-1;
+        if (size > cmdline_max_size) { size = cmdline_max_size; }
+        if (size > sizeof(value)) { size = sizeof(value); }
+        memcpy(value, equals+1, size);
+        cmdline_sanitise(value, value + size);
+        env[i] = intern_string(value, size);
+    }
+}
+
+static void
+read_environ(int process_dir_fd, intern_id* env) {
+    memset(env, 0, num_env_names*sizeof(intern_id));
+    int fd = openat(process_dir_fd, "environ", O_RDONLY|O_CLOEXEC);
+    if (fd == -1) { return; }
+    char buf[16384];
+    size_t size = 0;
+    size_t total = 0;
+    // skip the entry that does not fit in the buffer
+    int skip = 0;
+    while (total < environ_max_size) {
+        ssize_t n = read(fd, buf + size, sizeof(buf) - size);
+        if (n <= 0) { break; }
+        total += n;
+        size += n;
+        char* first = buf;
+        char* last = buf + size;
+        char* entry_last;
+        while ((entry_last = memchr(first, 0, last-first)) != NULL) {
+            if (!skip) { match_environ_entry(first, entry_last, env); }
+            skip = 0;
+            first = entry_last+1;
+        }
+        if (first == buf && size == sizeof(buf)) {
+            skip = 1;
+            size = 0;
+        } else {
+            memmove(buf, first, last-first);
+            size = last-first;
+        }
+    }
+    close(fd);
+}
+
+static void
+collect_cmdline(int process_dir_fd, process_state_type* p, int exec, step_type* s) {
+    const int first_record = !p->cmdline_read || exec;
+    if (first_record) {
+        p->cmdline = read_cmdline(process_dir_fd);
+        if (num_env_names != 0) { read_environ(process_dir_fd, p->env); }
+        p->cmdline_read = 1;
+    } else {
+        // keep the strings from being swept
+        intern_touch(p->cmdline);
+        for (size_t i=0; i<num_env_names; ++i) { intern_touch(p->env[i]); }
+    }
+    if (first_record || cmdline_emit == CMDLINE_EVERY_RECORD) {
+        s->cmdline = p->cmdline;
+        memcpy(s->env, p->env, num_env_names*sizeof(intern_id));
+    } else {
+        s->cmdline = 0;
+        memset(s->env, 0, num_env_names*sizeof(intern_id));
+    }
+}
+
+#endif // vim:filetype=c
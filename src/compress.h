@@ -0,0 +1,173 @@
+/*
+Lockstep — log resources consumed by userland Linux processes.
+© 2026 Ivan Gankevich
+
+This file is part of Lockstep.
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <pthread.h>
+
+#include "config.h"
+#if defined(LOCKSTEP_WITH_ZLIB)
+#include <zlib.h>
+#endif
+
+/*
+Background compression of closed log segments. The queue is protected
+by a mutex: segments are closed at most a few times per hour, so there
+is no need for anything fancier.
+*/
+typedef struct compress_item compress_item_type;
+
+struct compress_item {
+    compress_item_type* next;
+    char path[];
+};
+
+static compress_item_type* compress_first = NULL;
+static compress_item_type* compress_last = NULL;
+static pthread_mutex_t compress_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t compress_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t compress_thread;
+static int compress_running = 0;
+
+#if defined(LOCKSTEP_WITH_ZLIB)
+static int
+compress_file(const char* path) {
+    int ret = 0;
+    char gz_path[PATH_MAX];
+    char tmp_path[PATH_MAX];
+    snprintf(gz_path, sizeof(gz_path), "%s.gz", path);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.gz.tmp", path);
+    int fd = open(path, O_RDONLY|O_CLOEXEC);
+    if (fd == -1) {
+        fprintf(stderr, "unable to open %s for reading\n", path);
+        return -1;
+    }
+    gzFile out = gzopen(tmp_path, "wb6");
+    if (out == NULL) {
+        fprintf(stderr, "unable to open %s for writing\n", tmp_path);
+        ret = -1;
+        goto close_fd;
+    }
+    char buffer[4096*16];
+    ssize_t nbytes = 0;
+    while ((nbytes = read(fd, buffer, sizeof(buffer))) > 0) {
+        if (gzwrite(out, buffer, (unsigned int)nbytes) != nbytes) {
+            fprintf(stderr, "unable to write to %s\n", tmp_path);
+            ret = -1;
+            break;
+        }
+    }
+    if (nbytes == -1) {
+        fprintf(stderr, "unable to read from %s\n", path);
+        ret = -1;
+    }
+    if (gzclose(out) != Z_OK) {
+        fprintf(stderr, "unable to close %s\n", tmp_path);
+        ret = -1;
+    }
+    if (ret == 0) {
+        if (rename(tmp_path, gz_path) == -1) { perror("rename"); ret = -1; }
+        else if (unlink(path) == -1) { perror("unlink"); }
+    } else {
+        unlink(tmp_path);
+    }
+close_fd:
+    if (close(fd) == -1) { perror("close"); }
+    return ret;
+}
+#endif
+
+static void*
+compress_main(void* arg) {
+    pthread_mutex_lock(&compress_mutex);
+    while (1) {
+        while (compress_first == NULL && compress_running) {
+            pthread_cond_wait(&compress_cond, &compress_mutex);
+        }
+        if (compress_first == NULL) { break; }
+        compress_item_type* item = compress_first;
+        compress_first = item->next;
+        if (compress_first == NULL) { compress_last = NULL; }
+        pthread_mutex_unlock(&compress_mutex);
+        #if defined(LOCKSTEP_WITH_ZLIB)
+        compress_file(item->path);
+        #endif
+        free(item);
+        pthread_mutex_lock(&compress_mutex);
+    }
+    pthread_mutex_unlock(&compress_mutex);
+    return NULL;
+}
+
+static void
+compress_start() {
+    compress_running = 1;
+    int ret = pthread_create(&compress_thread, NULL, compress_main, NULL);
+    if (ret != 0) {
+        errno = ret;
+        perror("pthread_create");
+        exit(1);
+    }
+}
+
+static void
+compress_push(const char* path) {
+    size_t n = strlen(path) + 1;
+    compress_item_type* item = malloc(sizeof(compress_item_type) + n);
+    if (item == NULL) { perror("malloc"); return; }
+    item->next = NULL;
+    memcpy(item->path, path, n);
+    pthread_mutex_lock(&compress_mutex);
+    if (compress_last == NULL) { compress_first = item; }
+    else { compress_last->next = item; }
+    compress_last = item;
+    pthread_cond_signal(&compress_cond);
+    pthread_mutex_unlock(&compress_mutex);
+}
+
+/* Compress the remaining segments and stop the thread. */
+static void
+compress_stop() {
+    if (!compress_running) { return; }
+    pthread_mutex_lock(&compress_mutex);
+    compress_running = 0;
+    pthread_cond_signal(&compress_cond);
+    pthread_mutex_unlock(&compress_mutex);
+    int ret = pthread_join(compress_thread, NULL);
+    if (ret != 0) {
+        errno = ret;
+        perror("pthread_join");
+    }
+}
+
+#endif // vim:filetype=c
@@ -0,0 +1,114 @@
+/*
+Lockstep — log resources consumed by userland Linux processes.
+© 2026 Ivan Gankevich
+
+This file is part of Lockstep.
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+The control socket is the local stream socket that accepts one command
+per connection and replies with "ok", "error: <message>" or the list of
+"name value" lines, then closes the connection:
+
+set <key> <value>       change process.fields, system.fields, interval,
+                        process.output, system.output, event.output,
+                        output.flush, watch.* or pressure.* between the ticks
+burst pid <pid> <duration>   sample the process every watch.interval
+burst node <duration>        sample all processes every pressure.interval
+stats                   print the statistics of the daemon
+
+Only the owner of the daemon and root may connect.
+*/
+
+#define CONTROL_DEFAULT_PATH "/run/lockstep.sock"
+#define CONTROL_MAX_COMMAND 1024
+#define CONTROL_MAX_CLIENTS 4
+
+/* Returns the listening socket or -1. */
+static inline int
+control_listen(const char* path) {
+    struct sockaddr_un address = {0};
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "control socket path %s is too long\n", path);
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+    if (fd == -1) { perror("socket"); return -1; }
+    // the socket of the previous instance
+    if (unlink(path) == -1 && errno != ENOENT) { perror("unlink"); }
+    const mode_t old_mask = umask(0177);
+    const int ret = bind(fd, (struct sockaddr*)&address, sizeof(address));
+    umask(old_mask);
+    if (ret == -1 || listen(fd, CONTROL_MAX_CLIENTS) == -1) {
+        fprintf(stderr, "unable to listen on %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Returns 1 if the peer is root or the owner of the daemon. */
+static inline int
+control_peer_allowed(int fd) {
+    struct ucred cred;
+    socklen_t n = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &n) == -1) { return 0; }
+    return cred.uid == 0 || cred.uid == geteuid();
+}
+
+static inline void
+control_reply(int fd, const char* reply, size_t n) {
+    // the replies are small and fit into the socket buffer
+    while (n != 0) {
+        ssize_t nwritten = send(fd, reply, n, MSG_NOSIGNAL|MSG_DONTWAIT);
+        if (nwritten == -1) {
+            if (errno == EINTR) { continue; }
+            break;
+        }
+        reply += nwritten;
+        n -= nwritten;
+    }
+}
+
+#endif // vim:filetype=c
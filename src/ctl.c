@@ -0,0 +1,120 @@
+/*
+Lockstep — log resources consumed by userland Linux processes.
+© 2026 Ivan Gankevich
+
+This file is part of Lockstep.
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#define _GNU_SOURCE
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <control.h>
+
+/*
+Send the command to the control socket of the running daemon
+and print the reply (see control.h for the list of commands).
+*/
+
+static void
+help_message(const char* argv0) {
+    printf("usage: %s [-s socket] [-h] command...\n", argv0);
+    fputs("  -s socket  the control socket (default " CONTROL_DEFAULT_PATH ")\n", stdout);
+    fputs("  -h         help\n", stdout);
+    fputs("commands:\n", stdout);
+    fputs("  set <key> <value>            change the field list, the interval or the output\n", stdout);
+    fputs("  burst pid <pid> <duration>   sample the process every watch.interval\n", stdout);
+    fputs("  burst node <duration>        sample all processes every pressure.interval\n", stdout);
+    fputs("  stats                        print the statistics of the daemon\n", stdout);
+}
+
+int main(int argc, char* argv[]) {
+    const char* path = CONTROL_DEFAULT_PATH;
+    int opt = 0;
+    while ((opt = getopt(argc, argv, "+s:h")) != -1) {
+        if (opt == 's') { path = optarg; }
+        if (opt == 'h') {
+            help_message(argv[0]);
+            return 0;
+        }
+        if (opt == '?') {
+            help_message(argv[0]);
+            return 1;
+        }
+    }
+    if (optind == argc) {
+        help_message(argv[0]);
+        return 1;
+    }
+    char command[CONTROL_MAX_COMMAND];
+    size_t n = 0;
+    for (int i=optind; i<argc; ++i) {
+        const size_t size = strlen(argv[i]);
+        if (n + size + 1 >= sizeof(command)) {
+            fputs("the command is too long\n", stderr);
+            return 1;
+        }
+        memcpy(command + n, argv[i], size);
+        n += size;
+        command[n++] = i == argc-1 ? '\n' : ' ';
+    }
+    struct sockaddr_un address = {0};
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "bad socket path %s\n", path);
+        return 1;
+    }
+    strcpy(address.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+    if (fd == -1) { perror("socket"); return 1; }
+    if (connect(fd, (struct sockaddr*)&address, sizeof(address)) == -1) {
+        fprintf(stderr, "unable to connect to %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    if (write(fd, command, n) != (ssize_t)n) { perror("write"); return 1; }
+    int ret = 0;
+    char reply[4096];
+    ssize_t nread = 0;
+    int first = 1;
+    while ((nread = read(fd, reply, sizeof(reply))) > 0) {
+        if (first && nread >= 6 && strncmp(reply, "error:", 6) == 0) { ret = 1; }
+        first = 0;
+        fwrite(reply, 1, nread, stdout);
+    }
+    if (nread == -1) { perror("read"); ret = 1; }
+    close(fd);
+    return ret;
+}
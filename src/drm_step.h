@@ -0,0 +1,209 @@
+/*
+Lockstep — log resources consumed by userland Linux processes.
+© 2026 Ivan Gankevich
+
+This file is part of Lockstep.
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef DRM_STEP_H
+#define DRM_STEP_H
+
+#include <sys/types.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <process_table.h>
+#include <step.h>
+
+/*
+Per-process GPU usage from DRM fdinfo (Documentation/gpu/drm-usage-stats.rst).
+The descriptors of a process that refer to /dev/dri devices are found by
+scanning /proc/<pid>/fd when the process is new and then every
+drm_rescan_interval; on the other ticks only /proc/<pid>/fdinfo/<fd> of
+the known descriptors are read. Descriptors that share the same
+drm-client-id are counted once.
+*/
+
+// in microseconds
+static uint64_t drm_rescan_interval = 10000000UL;
+
+static void
+drm_add_fd(process_state_type* p, int fd) {
+    if (p->num_drm_fds == p->drm_fds_capacity) {
+        p->drm_fds_capacity = p->drm_fds_capacity == 0 ? 4 : 2*p->drm_fds_capacity;
+        p->drm_fds = realloc(p->drm_fds, p->drm_fds_capacity*sizeof(int));
+        if (p->drm_fds == NULL) { perror("realloc"); exit(1); }
+    }
+    p->drm_fds[p->num_drm_fds++] = fd;
+}
+
+static void
+drm_scan_fds(int process_dir_fd, process_state_type* p) {
+    p->num_drm_fds = 0;
+    int dir_fd = openat(process_dir_fd, "fd", O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+    if (dir_fd == -1) { return; }
+    DIR* dir = fdopendir(dir_fd);
+    if (dir == NULL) {
+        close(dir_fd);
+        return;
+    }
+    char target[64];
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] < '0' || entry->d_name[0] > '9') { continue; }
+        ssize_t n = readlinkat(dir_fd, entry->d_name, target, sizeof(target)-1);
+        if (n < 9 || strncmp(target, "/dev/dri/", 9) != 0) { continue; }
+        drm_add_fd(p, atoi(entry->d_name));
+    }
+    closedir(dir);
+}
+
+static inline const char*
+drm_parse_number(const char* first, const char* last, unsigned long long* result) {
+    while (first != last && (*first == ' ' || *first == '\t')) { ++first; }
+    unsigned long long x = 0;
+    while (first != last && *first >= '0' && *first <= '9') { x = 10*x + (*first++ - '0'); }
+    *result = x;
+    return first;
+}
+
+static inline unsigned long long
+drm_parse_bytes(const char* first, const char* last) {
+    unsigned long long x = 0;
+    first = drm_parse_number(first, last, &x);
+    while (first != last && (*first == ' ' || *first == '\t')) { ++first; }
+    if (first != last) {
+        if (*first == 'K') { x <<= 10; }
+        else if (*first == 'M') { x <<= 20; }
+        else if (*first == 'G') { x <<= 30; }
+    }
+    return x;
+}
+
+static inline int
+drm_is_vram(const char* region, const char* last) {
+    const size_t n = last-region;
+    return (n >= 4 && strncmp(region, "vram", 4) == 0) ||
+           (n >= 5 && strncmp(region, "local", 5) == 0);
+}
+
+/*
+Returns the client id or zero if the descriptor is not a DRM client.
+The statistics are added to the step.
+*/
+static unsigned long long
+drm_parse_fdinfo(const char* first, const char* last, drm_step_t* drm) {
+    unsigned long long client_id = 0;
+    unsigned long long engine_ns = 0;
+    unsigned long long total[2] = {0, 0};
+    unsigned long long memory[2] = {0, 0};
+    int has_total = 0;
+    while (first != last) {
+        const char* line_last = memchr(first, '\n', last-first);
+        if (line_last == NULL) { line_last = last; }
+        const char* colon = memchr(first, ':', line_last-first);
+        if (colon != NULL && line_last-first > 4 && strncmp(first, "drm-", 4) == 0) {
+            const char* key = first + 4;
+            const size_t n = colon-key;
+            if (n == 9 && strncmp(key, "client-id", 9) == 0) {
+                drm_parse_number(colon+1, line_last, &client_id);
+            } else if (n > 16 && strncmp(key, "engine-capacity-", 16) == 0) {
+                // the number of the engines of this type, not the time
+            } else if (n > 7 && strncmp(key, "engine-", 7) == 0) {
+                unsigned long long x = 0;
+                drm_parse_number(colon+1, line_last, &x);
+                engine_ns += x;
+            } else if (n > 7 && strncmp(key, "memory-", 7) == 0) {
+                memory[drm_is_vram(key+7, colon)] += drm_parse_bytes(colon+1, line_last);
+            } else if (n > 6 && strncmp(key, "total-", 6) == 0) {
+                total[drm_is_vram(key+6, colon)] += drm_parse_bytes(colon+1, line_last);
+                has_total = 1;
+            }
+        }
+        first = line_last == last ? last : line_last+1;
+    }
+    if (client_id == 0) { return 0; }
+    // drm-memory-<region> is the legacy name of drm-resident-<region>,
+    // drm-total-<region> includes it
+    const unsigned long long* bytes = has_total ? total : memory;
+    drm->clients += 1;
+    drm->engine_ns += engine_ns;
+    drm->memory_gtt += bytes[0];
+    drm->memory_vram += bytes[1];
+    return client_id;
+}
+
+static void
+collect_drm_fdinfo(int process_dir_fd, process_state_type* p, uint64_t now, drm_step_t* drm) {
+    memset(drm, 0, sizeof(drm_step_t));
+    if (p->drm_scan_time == 0 || now - p->drm_scan_time >= drm_rescan_interval) {
+        drm_scan_fds(process_dir_fd, p);
+        p->drm_scan_time = now;
+    }
+    if (p->num_drm_fds == 0) { return; }
+    char path[32];
+    char buf[4096];
+    unsigned long long client_ids[64];
+    unsigned int num_client_ids = 0;
+    unsigned int i = 0;
+    while (i < p->num_drm_fds) {
+        snprintf(path, sizeof(path), "fdinfo/%d", p->drm_fds[i]);
+        int fd = openat(process_dir_fd, path, O_RDONLY|O_CLOEXEC);
+        if (fd == -1) {
+            // the descriptor was closed
+            p->drm_fds[i] = p->drm_fds[--p->num_drm_fds];
+            continue;
+        }
+        ssize_t n = read(fd, buf, sizeof(buf));
+        close(fd);
+        ++i;
+        if (n <= 0) { continue; }
+        drm_step_t client;
+        memset(&client, 0, sizeof(client));
+        const unsigned long long id = drm_parse_fdinfo(buf, buf+n, &client);
+        if (id == 0) { continue; }
+        unsigned int j = 0;
+        while (j != num_client_ids && client_ids[j] != id) { ++j; }
+        if (j != num_client_ids) { continue; }
+        if (num_client_ids != sizeof(client_ids)/sizeof(client_ids[0])) {
+            client_ids[num_client_ids++] = id;
+        }
+        drm->clients += client.clients;
+        drm->engine_ns += client.engine_ns;
+        drm->memory_vram += client.memory_vram;
+        drm->memory_gtt += client.memory_gtt;
+    }
+}
+
+#endif // vim:filetype=c
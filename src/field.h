@@ -33,10 +33,48 @@ For more information, please refer to <http://unlicense.org/>
 #ifndef FIELD_H
 #define FIELD_H
 
+typedef enum {
+	FIELD_CHAR,
+	FIELD_INT,
+	FIELD_UNSIGNED_INT,
+	FIELD_LONG,
+	FIELD_UNSIGNED_LONG,
+	FIELD_UNSIGNED_LONG_LONG,
+	FIELD_DOUBLE,
+	FIELD_STRING,
+	// the id of the interned string (see intern.h)
+	FIELD_STRING_ID
+} field_format_type;
+
 typedef struct {
 	char name[128];
-	char format[4];
+	field_format_type format;
 	int offset;
 } field_type;
 
+/* The numeric value of the field, zero for strings. */
+static inline double
+field_number(const void* object, const field_type* field) {
+	const void* ptr = ((const char*)object) + field->offset;
+	switch (field->format) {
+		case FIELD_CHAR: return (double)*((const char*)ptr);
+		case FIELD_INT: return (double)*((const int*)ptr);
+		case FIELD_UNSIGNED_INT: return (double)*((const unsigned int*)ptr);
+		case FIELD_LONG: return (double)*((const long*)ptr);
+		case FIELD_UNSIGNED_LONG: return (double)*((const unsigned long*)ptr);
+		case FIELD_UNSIGNED_LONG_LONG: return (double)*((const unsigned long long*)ptr);
+		case FIELD_DOUBLE: return *((const double*)ptr);
+		case FIELD_STRING:
+		case FIELD_STRING_ID:
+			return 0;
+	}
+	return 0;
+}
+
+/* Returns 1 if the field is a number. */
+static inline int
+field_is_number(const field_type* field) {
+	return field->format != FIELD_STRING && field->format != FIELD_STRING_ID;
+}
+
 #endif // vim:filetype=c
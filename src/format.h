@@ -0,0 +1,175 @@
+/*
+Lockstep — log resources consumed by userland Linux processes.
+© 2026 Ivan Gankevich
+
+This file is part of Lockstep.
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <field.h>
+#include <intern.h>
+
+/*
+Allocation-free formatting of field values. Every function writes
+the value to [first,last) and returns the pointer past the last written
+character or NULL if there is not enough space.
+*/
+
+static const char format_digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static inline int
+format_count_digits(unsigned long long x) {
+    int n = 1;
+    while (1) {
+        if (x < 10ULL) { return n; }
+        if (x < 100ULL) { return n+1; }
+        if (x < 1000ULL) { return n+2; }
+        if (x < 10000ULL) { return n+3; }
+        x /= 10000ULL;
+        n += 4;
+    }
+}
+
+static inline char*
+format_unsigned(char* first, char* last, unsigned long long x) {
+    const int n = format_count_digits(x);
+    if (last-first < n) { return NULL; }
+    char* end = first + n;
+    char* ptr = end;
+    while (x >= 100ULL) {
+        const unsigned int i = (unsigned int)(x % 100ULL) * 2;
+        x /= 100ULL;
+        *--ptr = format_digit_pairs[i+1];
+        *--ptr = format_digit_pairs[i];
+    }
+    if (x < 10ULL) {
+        *--ptr = (char)('0' + x);
+    } else {
+        const unsigned int i = (unsigned int)x * 2;
+        *--ptr = format_digit_pairs[i+1];
+        *--ptr = format_digit_pairs[i];
+    }
+    return end;
+}
+
+static inline char*
+format_signed(char* first, char* last, long long x) {
+    if (x < 0) {
+        if (first == last) { return NULL; }
+        *first++ = '-';
+        return format_unsigned(first, last, 0ULL - (unsigned long long)x);
+    }
+    return format_unsigned(first, last, (unsigned long long)x);
+}
+
+/* The same output as printf("%f") for the values smaller than 9e9. */
+static inline char*
+format_double(char* first, char* last, double x) {
+    if (!(fabs(x) < 9e9)) {
+        // infinities, NaNs and large values are rare, use the slow path
+        char tmp[512];
+        int n = snprintf(tmp, sizeof(tmp), "%f", x);
+        if (n < 0 || last-first < n) { return NULL; }
+        memcpy(first, tmp, n);
+        return first + n;
+    }
+    if (x < 0 || (x == 0 && signbit(x))) {
+        if (first == last) { return NULL; }
+        *first++ = '-';
+        x = -x;
+    }
+    unsigned long long fixed = (unsigned long long)llround(x * 1e6);
+    first = format_unsigned(first, last, fixed / 1000000ULL);
+    if (first == NULL || last-first < 7) { return NULL; }
+    *first++ = '.';
+    unsigned long long fraction = fixed % 1000000ULL;
+    for (int i=5; i>=0; --i) {
+        first[i] = (char)('0' + fraction%10ULL);
+        fraction /= 10ULL;
+    }
+    return first + 6;
+}
+
+static inline char*
+format_string(char* first, char* last, const char* str) {
+    const size_t n = strlen(str);
+    if ((size_t)(last-first) < n) { return NULL; }
+    memcpy(first, str, n);
+    return first + n;
+}
+
+static inline char*
+format_field(char* first, char* last, const void* object, const field_type* field) {
+    const void* ptr = ((const char*)object) + field->offset;
+    switch (field->format) {
+        case FIELD_CHAR:
+            if (first == last) { return NULL; }
+            *first++ = *((const char*)ptr);
+            return first;
+        case FIELD_INT:
+            return format_signed(first, last, *((const int*)ptr));
+        case FIELD_UNSIGNED_INT:
+            return format_unsigned(first, last, *((const unsigned int*)ptr));
+        case FIELD_LONG:
+            return format_signed(first, last, *((const long*)ptr));
+        case FIELD_UNSIGNED_LONG:
+            return format_unsigned(first, last, *((const unsigned long*)ptr));
+        case FIELD_UNSIGNED_LONG_LONG:
+            return format_unsigned(first, last, *((const unsigned long long*)ptr));
+        case FIELD_DOUBLE:
+            return format_double(first, last, *((const double*)ptr));
+        case FIELD_STRING:
+            return format_string(first, last, (const char*)ptr);
+        case FIELD_STRING_ID: {
+            const intern_id id = *((const intern_id*)ptr);
+            const size_t n = intern_size(id);
+            if ((size_t)(last-first) < n) { return NULL; }
+            memcpy(first, intern_get(id), n);
+            return first + n;
+        }
+    }
+    return first;
+}
+
+#endif // vim:filetype=c
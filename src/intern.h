@@ -0,0 +1,243 @@
+/*
+Lockstep — log resources consumed by userland Linux processes.
+© 2026 Ivan Gankevich
+
+This file is part of Lockstep.
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <field.h>
+
+/*
+The table of interned strings. Every distinct string is stored once
+in the arena and is referenced by its id. Strings that were not interned
+since the previous sweep (i.e. the strings of the processes that exited)
+are removed by intern_sweep; the arena is compacted when more than half
+of it is unused. Id 0 is the empty string.
+*/
+
+typedef uint32_t intern_id;
+
+typedef struct {
+    uint32_t offset;
+    uint32_t size;
+    uint32_t hash;
+    uint32_t generation;
+} intern_entry_type;
+
+#define INTERN_FREE UINT32_MAX
+
+static char* intern_arena = NULL;
+static size_t intern_arena_size = 0;
+static size_t intern_arena_capacity = 0;
+static size_t intern_dead_bytes = 0;
+static intern_entry_type* intern_entries = NULL;
+static uint32_t intern_num_entries = 0;
+static uint32_t intern_entries_capacity = 0;
+static uint32_t* intern_free_ids = NULL;
+static uint32_t intern_num_free_ids = 0;
+// open addressing, zero is an empty slot, otherwise id+1
+static uint32_t* intern_table = NULL;
+static uint32_t intern_table_capacity = 0;
+static uint32_t intern_num_strings = 0;
+static uint32_t intern_generation = 1;
+
+static inline uint32_t
+intern_hash(const char* str, size_t n) {
+    // FNV-1a
+    uint32_t h = 2166136261U;
+    for (size_t i=0; i<n; ++i) { h ^= (unsigned char)str[i]; h *= 16777619U; }
+    return h;
+}
+
+static inline const char*
+intern_get(intern_id id) {
+    return intern_arena + intern_entries[id].offset;
+}
+
+static inline size_t
+intern_size(intern_id id) {
+    return intern_entries[id].size;
+}
+
+/* Keep the string that is referenced outside of the tick from being swept. */
+static inline void
+intern_touch(intern_id id) {
+    if (id != 0) { intern_entries[id].generation = intern_generation; }
+}
+
+static inline void
+intern_table_insert(intern_id id) {
+    const uint32_t mask = intern_table_capacity-1;
+    uint32_t i = intern_entries[id].hash & mask;
+    while (intern_table[i] != 0) { i = (i+1) & mask; }
+    intern_table[i] = id+1;
+}
+
+static inline void
+intern_table_rebuild(uint32_t capacity) {
+    free(intern_table);
+    intern_table_capacity = capacity;
+    intern_table = calloc(capacity, sizeof(uint32_t));
+    if (intern_table == NULL) { perror("calloc"); exit(1); }
+    for (uint32_t id=1; id<intern_num_entries; ++id) {
+        if (intern_entries[id].size != INTERN_FREE) { intern_table_insert(id); }
+    }
+}
+
+static inline void
+intern_arena_append(const char* str, size_t n) {
+    if (intern_arena_size + n + 1 > intern_arena_capacity) {
+        size_t capacity = intern_arena_capacity == 0 ? 65536 : 2*intern_arena_capacity;
+        while (capacity < intern_arena_size + n + 1) { capacity *= 2; }
+        intern_arena = realloc(intern_arena, capacity);
+        if (intern_arena == NULL) { perror("realloc"); exit(1); }
+        intern_arena_capacity = capacity;
+    }
+    memcpy(intern_arena + intern_arena_size, str, n);
+    intern_arena[intern_arena_size + n] = 0;
+    intern_arena_size += n + 1;
+}
+
+static inline void
+intern_init() {
+    intern_entries_capacity = 1024;
+    intern_entries = malloc(intern_entries_capacity*sizeof(intern_entry_type));
+    intern_free_ids = malloc(intern_entries_capacity*sizeof(uint32_t));
+    if (intern_entries == NULL || intern_free_ids == NULL) { perror("malloc"); exit(1); }
+    intern_arena_append("", 0);
+    intern_entries[0] = (intern_entry_type){0, 0, 0, 0};
+    intern_num_entries = 1;
+    intern_table_rebuild(2048);
+}
+
+/*
+The string pointers returned by intern_get are valid until the next call
+to intern_string or intern_sweep.
+*/
+static inline intern_id
+intern_string(const char* str, size_t n) {
+    if (n == 0) { return 0; }
+    if (intern_entries == NULL) { intern_init(); }
+    const uint32_t hash = intern_hash(str, n);
+    const uint32_t mask = intern_table_capacity-1;
+    uint32_t i = hash & mask;
+    while (intern_table[i] != 0) {
+        intern_entry_type* e = intern_entries + intern_table[i]-1;
+        if (e->hash == hash && e->size == n && memcmp(intern_arena + e->offset, str, n) == 0) {
+            e->generation = intern_generation;
+            return intern_table[i]-1;
+        }
+        i = (i+1) & mask;
+    }
+    intern_id id;
+    if (intern_num_free_ids != 0) {
+        id = intern_free_ids[--intern_num_free_ids];
+    } else {
+        if (intern_num_entries == intern_entries_capacity) {
+            intern_entries_capacity *= 2;
+            intern_entries = realloc(intern_entries,
+                intern_entries_capacity*sizeof(intern_entry_type));
+            intern_free_ids = realloc(intern_free_ids,
+                intern_entries_capacity*sizeof(uint32_t));
+            if (intern_entries == NULL || intern_free_ids == NULL) {
+                perror("realloc");
+                exit(1);
+            }
+        }
+        id = intern_num_entries++;
+    }
+    intern_entry_type* e = intern_entries + id;
+    e->offset = (uint32_t)intern_arena_size;
+    e->size = (uint32_t)n;
+    e->hash = hash;
+    e->generation = intern_generation;
+    intern_arena_append(str, n);
+    ++intern_num_strings;
+    if (2*intern_num_strings > intern_table_capacity) {
+        intern_table_rebuild(2*intern_table_capacity);
+    } else {
+        intern_table_insert(id);
+    }
+    return id;
+}
+
+static inline void
+intern_compact() {
+    char* arena = malloc(intern_arena_capacity);
+    if (arena == NULL) { perror("malloc"); exit(1); }
+    size_t size = 1;
+    arena[0] = 0;
+    for (uint32_t id=1; id<intern_num_entries; ++id) {
+        intern_entry_type* e = intern_entries + id;
+        if (e->size == INTERN_FREE) { continue; }
+        memcpy(arena + size, intern_arena + e->offset, e->size + 1);
+        e->offset = (uint32_t)size;
+        size += e->size + 1;
+    }
+    free(intern_arena);
+    intern_arena = arena;
+    intern_arena_size = size;
+    intern_dead_bytes = 0;
+}
+
+/* Remove the strings that were not interned since the previous sweep. */
+static inline void
+intern_sweep() {
+    uint32_t removed = 0;
+    for (uint32_t id=1; id<intern_num_entries; ++id) {
+        intern_entry_type* e = intern_entries + id;
+        if (e->size == INTERN_FREE || e->generation == intern_generation) { continue; }
+        intern_dead_bytes += e->size + 1;
+        e->size = INTERN_FREE;
+        intern_free_ids[intern_num_free_ids++] = id;
+        ++removed;
+    }
+    ++intern_generation;
+    if (removed == 0) { return; }
+    intern_num_strings -= removed;
+    intern_table_rebuild(intern_table_capacity);
+    if (2*intern_dead_bytes > intern_arena_size) { intern_compact(); }
+}
+
+/* The value of FIELD_STRING or FIELD_STRING_ID field. */
+static inline const char*
+field_string(const void* object, const field_type* field) {
+    const void* ptr = ((const char*)object) + field->offset;
+    if (field->format == FIELD_STRING_ID) { return intern_get(*((const intern_id*)ptr)); }
+    return (const char*)ptr;
+}
+
+#endif // vim:filetype=c
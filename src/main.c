@@ -34,8 +34,14 @@ For more information, please refer to <http://unlicense.org/>
 
 #include <sys/types.h>
 
+#include <sys/epoll.h>
 #include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
 #include <sys/wait.h>
 
 #include <ctype.h>
@@ -43,8 +49,10 @@ For more information, please refer to <http://unlicense.org/>
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <math.h>
 #include <signal.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -56,23 +64,30 @@ For more information, please refer to <http://unlicense.org/>
 #if defined(LOCKSTEP_WITH_NVML)
 #include <nvml_step.h>
 #endif
+#include <cgroup_step.h>
+#include <cmdline_step.h>
+#include <control.h>
+#include <drm_step.h>
 #include <field.h>
+#include <format.h>
+#include <numa_step.h>
+#include <parse.h>
+#include <pressure.h>
+#include <process_table.h>
+#include <rules.h>
+#include <segment_writer.h>
+#include <smaps_step.h>
 #include <step.h>
+#include <stream_sink.h>
+#include <syslog_sink.h>
+#include <system_step.h>
+#include <tier.h>
+#include <top.h>
+#include <writer.h>
 
 
-#define STAT_FORMAT \
-        "%d (%16[^)]) %c %d %d %d %d %d %u %lu %lu %lu %lu %lu %lu %ld %ld %ld %ld %ld " \
-        "%ld %s %lu %ld %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %d %d " \
-        "%u %u %llu %lu %ld %lu %lu %lu %lu %lu %lu %lu %d"
-
 #define CREDENTIALS_FORMAT "%d %d"
 
-#define UPTIME_FORMAT "%lf %lf"
-
-#define NETSTAT_FORMAT "IpExt: %*u %*u %*u %*u %*u %*u %lu %lu %*u %*u %*u %*u %*u %*u %*u %*u %*u"
-
-#define IO_FORMAT "rchar: %*u\nwchar: %*u\nsyscr: %*u\nsyscw: %*u\nread_bytes: %lu\nwrite_bytes: %lu\ncancelled_write_bytes: %lu"
-
 #define STEP_FORMAT \
         "%d|%s|%c|%d|%d|%d|%d|%d|%u|%lu|%lu|%lu|%lu|%lu|%lu|%ld|%ld|%ld|%ld|%ld|" \
         "%ld|%llu|%lu|%ld|%lu|%lu|%lu|%lu|%lu|%lu|%lu|%lu|%lu|%lu|%lu|%lu|%lu|%d|%d|" \
@@ -83,224 +98,278 @@ For more information, please refer to <http://unlicense.org/>
 
 static char buf[4096*4];
 static unsigned long interval = 1000000;
+static unsigned long min_interval = 0;
+static unsigned long max_interval = 0;
+static double cpu_budget = 0;
 static unsigned long syslog_interval = 5*60*1000000;
 static int enable_syslog = 0;
 static int syslog_facility = LOG_LOCAL0;
 static int syslog_level = LOG_INFO;
 static uid_t min_uid = 1000;
 static int running = 1;
-static int process_out_fd = -1;
-static int system_out_fd = -1;
+static output_type process_output = {-1};
+static output_type system_output = {-1};
+static output_type event_output = {-1};
+// the events are written to event.output only if it is set
+static int event_file = 0;
+static writer_buffer_type* process_buffer = NULL;
+static writer_buffer_type* system_buffer = NULL;
+static writer_buffer_type* event_buffer = NULL;
+static output_type* system_out = &system_output;
+static int tick_dropped = 0;
+static struct timespec last_flush = {0};
 typedef enum {
     SYSTEM_HWMON = 1,
     SYSTEM_DRM = 2,
     SYSTEM_THERMAL = 4,
+    SYSTEM_NVML = 8,
+    SYSTEM_PRESSURE = 16,
+    SYSTEM_CPU = 32,
+    SYSTEM_MEM = 64,
+    SYSTEM_DISK = 128,
+    SYSTEM_NETDEV = 256,
+    SYSTEM_NUMA = 512,
 } system_fields_type;
 static system_fields_type system_fields = 0;
 static system_fields_type syslog_system_fields = 0;
+static int syslog_process = 0;
+static int syslog_summary = 0;
+// -1 until set, then defaults to true if there is no event.output
+static int syslog_events = -1;
+static char syslog_path[PATH_MAX] = "/dev/log";
+static char control_path[PATH_MAX] = {0};
+
+typedef struct {
+    unsigned long processes;
+    unsigned long num_threads;
+    unsigned long resident_set_size;
+    unsigned long virtual_memory_size;
+    unsigned long userspace_time;
+    unsigned long kernel_time;
+    unsigned long read_bytes;
+    unsigned long write_bytes;
+} summary_type;
+
+static summary_type summary;
 static char*const* child_argv = 0;
 static pid_t child_pid = 0;
 
-static field_type step_fields[] = {
-    {"pid", "%d", offsetof(step_type, process_id)},
-    {"state", "%c", offsetof(step_type, state)},
-    {"ppid", "%d", offsetof(step_type, parent_process_id)},
-    {"pgrp", "%d", offsetof(step_type, process_group_id)},
-    {"session", "%d", offsetof(step_type, session_id)},
-    {"tty_number", "%d", offsetof(step_type, tty_number)},
-    {"tty_process_group_id", "%d", offsetof(step_type, tty_process_group_id)},
-    {"flags", "%u", offsetof(step_type, flags)},
-    {"minor_faults", "%lu", offsetof(step_type, minor_faults)},
-    {"child_minor_faults", "%lu", offsetof(step_type, child_minor_faults)},
-    {"major_faults", "%lu", offsetof(step_type, major_faults)},
-    {"child_major_faults", "%lu", offsetof(step_type, child_major_faults)},
-    {"userspace_time", "%lu", offsetof(step_type, userspace_time)},
-    {"kernel_time", "%lu", offsetof(step_type, kernel_time)},
-    {"child_userspace_time", "%ld", offsetof(step_type, child_userspace_time)},
-    {"child_kernel_time", "%ld", offsetof(step_type, child_kernel_time)},
-    {"priority", "%ld", offsetof(step_type, priority)},
-    {"nice", "%ld", offsetof(step_type, nice)},
-    {"num_threads", "%ld", offsetof(step_type, num_threads)},
-    {"itrealvalue", "%ld", offsetof(step_type, unused)},
-    {"start_time", "%s", offsetof(step_type, start_time)},
-    {"virtual_memory_size", "%lu", offsetof(step_type, virtual_memory_size)},
-    {"resident_set_size", "%ld", offsetof(step_type, resident_set_size)},
-    {"resident_set_limit", "%lu", offsetof(step_type, resident_set_limit)},
-    {"code_segment_start", "%lu", offsetof(step_type, code_segment_start)},
-    {"code_segment_end", "%lu", offsetof(step_type, code_segment_end)},
-    {"stack_start", "%lu", offsetof(step_type, stack_start)},
-    {"stack_pointer", "%lu", offsetof(step_type, stack_pointer)},
-    {"instruction_pointer", "%lu", offsetof(step_type, instruction_pointer)},
-    {"signals", "%lu", offsetof(step_type, signals)},
-    {"blocked_signals", "%lu", offsetof(step_type, blocked_signals)},
-    {"ignored_signal", "%lu", offsetof(step_type, ignored_signal)},
-    {"caught_signal", "%lu", offsetof(step_type, caught_signal)},
-    {"wait_channel", "%lu", offsetof(step_type, wait_channel)},
-    {"num_swapped_pages", "%lu", offsetof(step_type, num_swapped_pages)},
-    {"children_num_swapped_pages", "%lu", offsetof(step_type, children_num_swapped_pages)},
-    {"exit_signal", "%d", offsetof(step_type, exit_signal)},
-    {"processor", "%d", offsetof(step_type, processor)},
-    {"realtime_priority", "%u", offsetof(step_type, realtime_priority)},
-    {"policy", "%u", offsetof(step_type, policy)},
-    {"cumulative_block_input_output_delay", "%llu", offsetof(step_type, cumulative_block_input_output_delay)},
-    {"guest_time", "%lu", offsetof(step_type, guest_time)},
-    {"child_guest_time", "%ld", offsetof(step_type, child_guest_time)},
-    {"data_start", "%lu", offsetof(step_type, data_start)},
-    {"data_end", "%lu", offsetof(step_type, data_end)},
-    {"brk_start", "%lu", offsetof(step_type, brk_start)},
-    {"arg_start", "%lu", offsetof(step_type, arg_start)},
-    {"arg_end", "%lu", offsetof(step_type, arg_end)},
-    {"env_start", "%lu", offsetof(step_type, env_start)},
-    {"env_end", "%lu", offsetof(step_type, env_end)},
-    {"exit_code", "%d", offsetof(step_type, exit_code)},
-    {"user", "%d", offsetof(step_type, user_id)},
-    {"group", "%d", offsetof(step_type, group_id)},
-    {"uptime", "%lf", offsetof(step_type, uptime)},
-    {"idle_time", "%lf", offsetof(step_type, idle_time)},
-    {"timestamp", "%lu", offsetof(step_type, timestamp)},
-    {"ticks_per_second", "%ld", offsetof(step_type, ticks_per_second)},
-    {"command", "%s", offsetof(step_type, command)},
-    {"executable", "%s", offsetof(step_type, executable)},
-    {"read_bytes", "%lu", offsetof(step_type, io) + offsetof(io_step_t, read_bytes)},
-    {"write_bytes", "%lu", offsetof(step_type, io) + offsetof(io_step_t, write_bytes)},
-    {"cancelled_write_bytes", "%lu", offsetof(step_type, io) + offsetof(io_step_t, cancelled_write_bytes)},
-    {"in_octets", "%lu", offsetof(step_type, network) + offsetof(network_step_t, in_octets)},
-    {"out_octets", "%lu", offsetof(step_type, network) + offsetof(network_step_t, out_octets)}
-    #if defined(LOCKSTEP_WITH_NVML)
-    , {"nvml_gpu_utilisation", "%u", offsetof(step_type, nvml) + offsetof(nvml_step_t, gpu_utilisation)}
-    , {"nvml_memory_utilisation", "%u", offsetof(step_type, nvml) + offsetof(nvml_step_t, memory_utilization)}
-    , {"nvml_max_memory_usage", "%lu", offsetof(step_type, nvml) + offsetof(nvml_step_t, max_memory_usage)}
-    , {"nvml_time_ms", "%lu", offsetof(step_type, nvml) + offsetof(nvml_step_t, time_ms)}
-    #endif
+#define STEP_FIELD(name, format, member) {#name, format, offsetof(step_type, member)},
+
+#define STEP_FIELD_COUNT(name, format, member) +1
+
+enum { NUM_STEP_FIELDS = 0 STEP_FIELDS(STEP_FIELD_COUNT) };
+
+// env:NAME fields are added after the static ones
+static field_type step_fields[NUM_STEP_FIELDS + MAX_ENV_FIELDS] = {
+    STEP_FIELDS(STEP_FIELD)
 };
+static int num_step_fields = NUM_STEP_FIELDS;
 
-static int process_fields[sizeof(step_fields) / sizeof(field_type)];
+static int process_fields[NUM_STEP_FIELDS + MAX_ENV_FIELDS];
 static int num_process_fields = 0;
+// collect DRM fdinfo, the command line, the environment and the cgroup
+// only if their fields were selected
+static int drm_fields = 0;
+static int cmdline_fields = 0;
+static int cgroup_fields = 0;
+// cpu_percent, io_rate and run_queue_wait_percent are selected or used by the rules or process.top
+static int rate_fields = 0;
+static int rate_keys = 0;
+// the same for the fields of /proc/<pid>/schedstat
+static int schedstat_fields = 0;
+static int schedstat_keys = 0;
+// the same for the fields of /proc/<pid>/smaps_rollup
+static int smaps_fields = 0;
+static int smaps_keys = 0;
+// the same for the numa_ fields
+static int numa_fields = 0;
+static int numa_keys = 0;
+static uint64_t tick_time = 0;
+// watched processes and sensors are sampled between the ticks
+static int watch_tick = 0;
+// the reason of the burst sampling (see burst_start), empty on the regular ticks
+static intern_id burst_tag = 0;
 
-static int
-compare_chars(const char* first, const char* last, const char* str) {
-    const size_t n1 = last-first;
-    const size_t n2 = strlen(str);
-    if (n1 != n2) { return -1; }
-    return strncmp(first, str, n1);
-}
-
-static int
-open_output_file(const char* path) {
-    int fd = open(path, O_CREAT|O_APPEND|O_WRONLY, 0644);
-    if (fd == -1) {
+static void
+open_output_file(output_type* output, const char* path) {
+    if (output->path != NULL) {
+        if (close(output->fd) == -1) { perror("close"); }
+        free((void*)output->path);
+    }
+    output->path = strdup(path);
+    if (output->path == NULL || output_open(output) == -1) {
         fprintf(stderr, "failed to open %s for writing\n", path);
         exit(1);
     }
-    return fd;
 }
 
 static inline field_type*
 find_field(const char* name, const char* name_last) {
     field_type* first = step_fields;
-    field_type* last = step_fields + sizeof(step_fields) / sizeof(field_type);
+    field_type* last = step_fields + num_step_fields;
     while (first != last) {
         if (compare_chars(name, name_last, first->name) == 0) {
-        //if (strncmp(first->name, name, n) == 0) {
             return first;
         }
         ++first;
     }
+    const size_t n = name_last-name;
+    if (n > 4 && strncmp(name, "env:", 4) == 0 && n < sizeof(env_names[0])) {
+        if (num_env_names == MAX_ENV_FIELDS) {
+            fprintf(stderr, "too many env fields, the maximum is %d\n", MAX_ENV_FIELDS);
+            exit(1);
+        }
+        field_type* field = step_fields + num_step_fields++;
+        memcpy(field->name, name, n);
+        field->name[n] = 0;
+        field->format = FIELD_STRING_ID;
+        field->offset = offsetof(step_type, env) + num_env_names*sizeof(intern_id);
+        memcpy(env_names[num_env_names], name+4, n-4);
+        env_names[num_env_names][n-4] = 0;
+        ++num_env_names;
+        return field;
+    }
     return NULL;
 }
 
-static inline char*
-print_field(char* buf, step_type* step, field_type* field) {
-    void* ptr = ((char*)step) + field->offset;
-    int ret = 0;
-    switch (field->format[1]) {
-        case 's':
-            ret = sprintf(buf, field->format, (char*)ptr);
-            break;
-        case 'd':
-            ret = sprintf(buf, field->format, *((int*)ptr));
-            break;
-        case 'u':
-            ret = sprintf(buf, field->format, *((unsigned int*)ptr));
-            break;
-        case 'c':
-            ret = sprintf(buf, field->format, *((char*)ptr));
-            break;
-        case 'l':
-            switch (field->format[2]) {
-                case 0:
-                    ret = sprintf(buf, field->format, *((long*)ptr));
-                    break;
-                case 'd':
-                    ret = sprintf(buf, field->format, *((long int*)ptr));
-                    break;
-                case 'u':
-                    ret = sprintf(buf, field->format, *((long unsigned int*)ptr));
-                    break;
-                case 'f':
-                    ret = sprintf(buf, field->format, *((double*)ptr));
-                    break;
-                case 'l':
-                    switch (field->format[3]) {
-                        case 0:
-                            ret = sprintf(buf, field->format, *((long long*)ptr));
-                            break;
-                        case 'd':
-                            ret = sprintf(buf, field->format, *((long long int*)ptr));
-                            break;
-                        case 'u':
-                            ret = sprintf(buf, field->format, *((long long unsigned int*)ptr));
-                            break;
-                        default:
-                            fprintf(stderr, "bad format character: %c\n", field->format[3]);
-                            break;
-                    }
-                    break;
-                default:
-                    fprintf(stderr, "bad format character: %c\n", field->format[2]);
-                    break;
-            }
-            break;
-        default:
-            fprintf(stderr, "bad format character: %c\n", field->format[1]);
-            break;
+static inline void
+write_to_syslog(time_t timestamp, const char* first, size_t n, system_fields_type fields) {
+    if (enable_syslog && (syslog_system_fields & fields)) {
+        syslog_append(syslog_facility|syslog_level, SYSLOG_MESSAGE_SYSTEM, timestamp, first, n);
     }
-    if (ret != -1) {
-        buf += ret;
+}
+
+static void
+summary_add(const step_type* s) {
+    ++summary.processes;
+    summary.num_threads += s->num_threads;
+    summary.resident_set_size += s->resident_set_size;
+    summary.virtual_memory_size += s->virtual_memory_size;
+    summary.userspace_time += s->userspace_time;
+    summary.kernel_time += s->kernel_time;
+    summary.read_bytes += s->io.read_bytes;
+    summary.write_bytes += s->io.write_bytes;
+}
+
+static void
+summary_write(time_t timestamp) {
+    int n = snprintf(
+        buf, sizeof(buf),
+        "%lu|processes=%lu|num_threads=%lu|resident_set_size=%lu|virtual_memory_size=%lu|"
+        "userspace_time=%lu|kernel_time=%lu|read_bytes=%lu|write_bytes=%lu",
+        timestamp, summary.processes, summary.num_threads, summary.resident_set_size,
+        summary.virtual_memory_size, summary.userspace_time, summary.kernel_time,
+        summary.read_bytes, summary.write_bytes);
+    if (n > 0) {
+        syslog_append(syslog_facility|syslog_level, SYSLOG_MESSAGE_SUMMARY, timestamp, buf, n);
     }
-    return buf;
 }
 
 static inline void
-write_to_syslog(const char* first, system_fields_type fields) {
-    if (enable_syslog && (syslog_system_fields & fields)) {
-        syslog(syslog_facility|syslog_level, "%s", first);
+write_to_output(output_type* output, writer_buffer_type** current,
+                time_t timestamp, const char* first, size_t n) {
+    writer_buffer_type* b = output_buffer(output, current, timestamp);
+    if (b == NULL) {
+        // the writer thread lags behind, drop the record
+        writer_dropped_bytes += n;
+        tick_dropped = 1;
+        return;
     }
+    output_write(b, first, n);
 }
 
-static inline void
-write_to_file(int fd, const char* first, size_t n) {
-    while (n != 0) {
-        ssize_t nwritten = write(fd, first, n);
-        if (nwritten == -1) { perror("write"); break; }
-        n -= nwritten;
-        first += nwritten;
+/* Write the event record immediately, bypassing the flush interval. */
+static void
+event_write(time_t timestamp, const char* text, const char* subject,
+            const char* name, double value) {
+    char line[512];
+    int n = 0;
+    if (value == floor(value) && fabs(value) < 1e18) {
+        n = snprintf(line, sizeof(line), "%ld|%s|%s|%s|%.0f\n",
+                     (long)timestamp, text, subject, name, value);
+    } else {
+        n = snprintf(line, sizeof(line), "%ld|%s|%s|%s|%f\n",
+                     (long)timestamp, text, subject, name, value);
+    }
+    if (n <= 0) { return; }
+    if ((size_t)n >= sizeof(line)) { n = sizeof(line)-1; }
+    if (event_file) {
+        write_to_output(&event_output, &event_buffer, timestamp, line, n);
+        output_flush(&event_buffer);
+    }
+    if (syslog_events) {
+        syslog_append(syslog_facility|LOG_WARNING, SYSLOG_MESSAGE_EVENT, timestamp, line, n);
+        syslog_flush();
+    }
+}
+
+static void
+flush_outputs(int force) {
+    if (!force && writer_flush_interval != 0) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        unsigned long elapsed =
+            (now.tv_sec - last_flush.tv_sec)*1000000UL +
+            (now.tv_nsec - last_flush.tv_nsec)/1000L;
+        if (elapsed < writer_flush_interval) { return; }
+        last_flush = now;
+    }
+    output_flush(&process_buffer);
+    output_flush(&system_buffer);
+    if (tick_dropped) {
+        ++writer_dropped_ticks;
+        tick_dropped = 0;
+    }
+}
+
+static inline char*
+step_format(char* first, char* last, const step_type* s) {
+    for (int i=0; i<num_process_fields; ++i) {
+        first = format_field(first, last, s, step_fields + process_fields[i]);
+        if (first == NULL || first == last) { return NULL; }
+        *first++ = (i != num_process_fields-1) ? '|' : '\n';
     }
+    return first;
 }
 
 static inline void
 step_write(step_type* s) {
-    char* first = buf;
-    for (int i=0; i<num_process_fields; ++i) {
-        field_type* field = step_fields + process_fields[i];
-        first = print_field(first, s, field);
-        if (i != num_process_fields-1) {
-            *first++ = '|';
+    if (segment_directory[0] != 0) { segment_add(s, s->timestamp, s->process_id); }
+    if (stream_enabled) { stream_add(s); }
+    // format the record directly in the buffer of the writer thread
+    writer_buffer_type* b = output_buffer(&process_output, &process_buffer, s->timestamp);
+    size_t reserve = 4096;
+    char* first;
+    char* last;
+    while (1) {
+        if (b == NULL) {
+            // the writer thread lags behind, format the record only for syslog
+            first = buf;
+            last = buf + sizeof(buf);
+        } else {
+            output_reserve(b, reserve);
+            first = b->data + b->size;
+            last = b->data + b->capacity;
         }
+        last = step_format(first, last, s);
+        if (last != NULL || b == NULL) { break; }
+        reserve *= 2;
+    }
+    if (last == NULL) { return; }
+    if (b == NULL) {
+        writer_dropped_bytes += last-first;
+        tick_dropped = 1;
+    } else {
+        b->size += last-first;
+    }
+    if (enable_syslog) {
+        if (syslog_process) {
+            syslog_append(syslog_facility|syslog_level, SYSLOG_MESSAGE_PROCESS,
+                          s->timestamp, first, last-first);
+        }
+        if (syslog_summary) { summary_add(s); }
     }
-    *first++ = '\n';
-    *first = 0;
-    write_to_file(process_out_fd, buf, first-buf);
 }
 
 static inline int
@@ -316,20 +385,15 @@ is_number(const char* first) {
 
 static int
 collect_executable(int process_dir_fd, const char* directory, step_type* s) {
-    int ret = 0;
-    int nbytes = readlinkat(
-        process_dir_fd,
-        "exe",
-        s->executable,
-        sizeof(s->executable)
-    );
+    char path[PATH_MAX];
+    s->executable = 0;
+    ssize_t nbytes = readlinkat(process_dir_fd, "exe", path, sizeof(path));
     if (nbytes == -1) {
-        ret = -1;
-        goto end;
+        // the process that exited but is not reaped yet has no executable
+        return errno == ENOENT ? 0 : -1;
     }
-    s->executable[nbytes] = 0;
-end:
-    return ret;
+    s->executable = intern_string(path, nbytes);
+    return 0;
 }
 
 static int
@@ -348,62 +412,9 @@ collect_stat(int process_dir_fd, const char* directory, step_type* s) {
     }
     buf[nbytes] = 0;
 //  printf(buf);
-    sscanf(
-        buf,
-        STAT_FORMAT,
-        &s->process_id,
-        s->command,
-        &s->state,
-        &s->parent_process_id,
-        &s->process_group_id,
-        &s->session_id,
-        &s->tty_number,
-        &s->tty_process_group_id,
-        &s->flags,
-        &s->minor_faults,
-        &s->child_minor_faults,
-        &s->major_faults,
-        &s->child_major_faults,
-        &s->userspace_time,
-        &s->kernel_time,
-        &s->child_userspace_time,
-        &s->child_kernel_time,
-        &s->priority,
-        &s->nice,
-        &s->num_threads,
-        &s->unused,
-        s->start_time,
-        &s->virtual_memory_size,
-        &s->resident_set_size,
-        &s->resident_set_limit,
-        &s->code_segment_start,
-        &s->code_segment_end,
-        &s->stack_start,
-        &s->stack_pointer,
-        &s->instruction_pointer,
-        &s->signals,
-        &s->blocked_signals,
-        &s->ignored_signal,
-        &s->caught_signal,
-        &s->wait_channel,
-        &s->num_swapped_pages,
-        &s->children_num_swapped_pages,
-        &s->exit_signal,
-        &s->processor,
-        &s->realtime_priority,
-        &s->policy,
-        &s->cumulative_block_input_output_delay,
-        &s->guest_time,
-        &s->child_guest_time,
-        &s->data_start,
-        &s->data_end,
-        &s->brk_start,
-        &s->arg_start,
-        &s->arg_end,
-        &s->env_start,
-        &s->env_end,
-        &s->exit_code
-    );
+    char command[17] = {0};
+    parse_stat(buf, s, command);
+    s->command = intern_string(command, strlen(command));
     if (collect_executable(process_dir_fd, directory, s) == -1) {
         ret = -1;
         goto close_fd;
@@ -431,7 +442,7 @@ collect_uptime(int proc_fd, step_type* s) {
         goto close_fd;
     }
     buf[nbytes] = 0;
-    sscanf(buf, UPTIME_FORMAT, &s->uptime, &s->idle_time);
+    parse_uptime(buf, &s->uptime, &s->idle_time);
 close_fd:
     if (close(fd) == -1) {
         fprintf(stderr, "unable to close /proc/uptime file\n");
@@ -456,13 +467,7 @@ collect_io(int process_dir_fd, const char* directory, step_type* s) {
         goto close_fd;
     }
     buf[nbytes] = 0;
-    sscanf(
-        buf,
-        IO_FORMAT,
-        &s->io.read_bytes,
-        &s->io.write_bytes,
-        &s->io.cancelled_write_bytes
-    );
+    parse_io(buf, &s->io);
 close_fd:
     if (close(fd) == -1) {
         fprintf(stderr, "unable to close /proc/%s/io file\n", directory);
@@ -471,20 +476,71 @@ close_fd:
     return ret;
 }
 
-static char*
-find_newline(char* first, char* last) {
-    while (first != last) {
-        if (*first++ == '\n') {
-            break;
+/* Add the counters of one schedstat file to the step. */
+static int
+add_schedstat(int dir_fd, const char* path, schedstat_step_t* sched) {
+    int fd = openat(dir_fd, path, O_RDONLY);
+    if (fd == -1) { return -1; }
+    char buf[128];
+    ssize_t nbytes = read(fd, buf, sizeof(buf)-1);
+    if (close(fd) == -1) { perror("close"); }
+    if (nbytes == -1) { return -1; }
+    buf[nbytes] = 0;
+    schedstat_step_t thread = {0, 0, 0};
+    parse_schedstat(buf, &thread);
+    sched->run_time_ns += thread.run_time_ns;
+    sched->run_queue_wait_ns += thread.run_queue_wait_ns;
+    sched->timeslices += thread.timeslices;
+    return 0;
+}
+
+/*
+The cumulative time on the CPU and waiting on the run queue in nanoseconds
+and the number of timeslices summed over the threads of the process.
+/proc/<pid>/schedstat covers the main thread only, so the multithreaded
+processes read /proc/<pid>/task/<tid>/schedstat of every thread. The
+counters of the threads that exited are lost, so the sums may decrease.
+*/
+static int
+collect_schedstat(int process_dir_fd, const char* directory, step_type* s) {
+    memset(&s->sched, 0, sizeof(schedstat_step_t));
+    if (s->num_threads <= 1) {
+        if (add_schedstat(process_dir_fd, "schedstat", &s->sched) == -1) {
+            fprintf(stderr, "unable to read /proc/%s/schedstat file\n", directory);
+            return -1;
         }
+        return 0;
     }
-    return first;
+    int task_fd = openat(process_dir_fd, "task", O_RDONLY|O_DIRECTORY);
+    if (task_fd == -1) {
+        fprintf(stderr, "unable to open /proc/%s/task directory\n", directory);
+        return -1;
+    }
+    DIR* task = fdopendir(task_fd);
+    if (task == NULL) {
+        close(task_fd);
+        return -1;
+    }
+    char path[sizeof(((struct dirent*)0)->d_name) + 16];
+    for (struct dirent* entry = readdir(task); entry != NULL; entry = readdir(task)) {
+        if (!is_number(entry->d_name)) { continue; }
+        snprintf(path, sizeof(path), "%s/schedstat", entry->d_name);
+        // the thread may have exited after readdir
+        add_schedstat(task_fd, path, &s->sched);
+    }
+    if (closedir(task) == -1) { perror("closedir"); }
+    return 0;
 }
 
 static int
 collect_network(int proc_fd, step_type* s) {
     int ret = 0;
     int fd = openat(proc_fd, "net/netstat", O_RDONLY);
+    if (fd == -1 && s->state == 'Z') {
+        // the process that exited but is not reaped yet has no network namespace
+        memset(&s->network, 0, sizeof(network_step_t));
+        return 0;
+    }
     if (fd == -1) {
         fprintf(stderr, "unable to open /proc/net/netstat file\n");
         return -1;
@@ -497,16 +553,10 @@ collect_network(int proc_fd, step_type* s) {
         goto close_fd;
     }
     buf[nbytes] = 0;
-    char* first = buf;
-    char* last = first + nbytes;
-    for (int i=0; i<3; ++i) {
-        first = find_newline(first, last);
-    }
-    if (first == last) {
+    if (parse_netstat(buf, &s->network) == -1) {
         ret = -1;
         goto close_fd;
     }
-    sscanf(first, NETSTAT_FORMAT, &s->network.in_octets, &s->network.out_octets);
 close_fd:
     if (close(fd) == -1) {
         fprintf(stderr, "unable to close /proc/net/netstat file\n");
@@ -516,7 +566,160 @@ close_fd:
 }
 
 static void
-collect_proc(time_t timestamp) {
+rules_check_process(process_state_type* p, const step_type* s) {
+    const uint64_t until = tick_time + watch_duration;
+    for (int i=0; i<num_rules; ++i) {
+        const rule_type* rule = rules + i;
+        if (rule->kind != RULE_PROCESS) { continue; }
+        double x = field_number(s, rule->field);
+        if (rule->per_tick) {
+            const double previous = p->rule_values[i];
+            p->rule_values[i] = x;
+            if (!p->rules_initialized) { continue; }
+            x -= previous;
+        }
+        const uint32_t bit = 1U << i;
+        if (!rule_matches(rule, x)) {
+            p->rules_fired &= ~bit;
+            continue;
+        }
+        if (p->rules_fired & bit) { continue; }
+        p->rules_fired |= bit;
+        char subject[32];
+        snprintf(subject, sizeof(subject), "%d", s->process_id);
+        event_write(s->timestamp, rule->text, subject, intern_get(s->command), x);
+        watch_add(s->process_id, s->start_time, NULL, NULL, until);
+    }
+    p->rules_initialized = 1;
+}
+
+/* Returns 1 if the collectors need the state of the process from the previous tick. */
+static inline int
+process_state_enabled() {
+    return drm_fields || cmdline_fields || cgroup_fields || rate_fields || rate_keys ||
+        smaps_fields || smaps_keys || numa_fields || numa_keys || num_process_rules != 0;
+}
+
+static inline int
+field_is_rate(const field_type* field) {
+    return strcmp(field->name, "cpu_percent") == 0 || strcmp(field->name, "io_rate") == 0 ||
+        strcmp(field->name, "run_queue_wait_percent") == 0;
+}
+
+static inline int
+field_is_schedstat(const field_type* field) {
+    return strncmp(field->name, "run_", 4) == 0 || strcmp(field->name, "timeslices") == 0;
+}
+
+static inline int
+field_is_smaps(const field_type* field) {
+    return strncmp(field->name, "pss", 3) == 0 || strcmp(field->name, "uss") == 0 ||
+        strcmp(field->name, "swap_pss") == 0 || strcmp(field->name, "smaps_age") == 0;
+}
+
+static inline int
+field_is_numa(const field_type* field) {
+    return strncmp(field->name, "numa_", 5) == 0;
+}
+
+static int
+collect_process(int proc_fd, const char* proc_dir_name, step_type* s) {
+    int ret = 0;
+    int process_dir_fd = openat(proc_fd, proc_dir_name, O_PATH);
+    if (process_dir_fd == -1) {
+        // the process have terminated
+        return -1;
+    }
+    if (collect_stat(process_dir_fd, proc_dir_name, s) == -1) {
+        fprintf(stderr, "failed to collect data for %s\n", proc_dir_name);
+        ret = -1;
+        goto close_process_dir;
+    }
+    if (collect_io(process_dir_fd, proc_dir_name, s) == -1) {
+        fprintf(stderr, "failed to collect io data for %s\n", proc_dir_name);
+        goto close_process_dir;
+    }
+    if ((schedstat_fields || schedstat_keys) &&
+        collect_schedstat(process_dir_fd, proc_dir_name, s) == -1) {
+        fprintf(stderr, "failed to collect scheduler data for %s\n", proc_dir_name);
+        goto close_process_dir;
+    }
+    if (collect_network(process_dir_fd, s) == -1) {
+        fprintf(stderr, "failed to collect network data for %s\n", proc_dir_name);
+        goto close_process_dir;
+    }
+    process_state_type* p = NULL;
+    if (process_state_enabled()) {
+        p = process_table_get(s->process_id, s->start_time);
+        const int exec = process_state_exec(p, s->arg_start, s->env_start);
+        if (drm_fields) { collect_drm_fdinfo(process_dir_fd, p, tick_time, &s->drm); }
+        if (cmdline_fields) { collect_cmdline(process_dir_fd, p, exec, s); }
+        if (cgroup_fields) { collect_cgroup(process_dir_fd, p, exec, tick_time, s); }
+        if (smaps_fields || smaps_keys) {
+            collect_smaps(process_dir_fd, p, !watch_tick, tick_time, s);
+        }
+        if (numa_fields || numa_keys) {
+            collect_numa(process_dir_fd, p, !watch_tick, tick_time, s);
+        }
+        if (rate_fields || rate_keys) { collect_rates(p, !watch_tick, tick_time, s); }
+    }
+    #if defined(LOCKSTEP_WITH_NVML)
+    if (collect_nvml(s->process_id, &s->nvml) == -1) {
+        fprintf(stderr, "failed to collect nvml data for %s\n", proc_dir_name);
+        goto close_process_dir;
+    }
+    #endif
+    if (num_process_rules != 0 && !watch_tick) { rules_check_process(p, s); }
+close_process_dir:
+    if (close(process_dir_fd) == -1) {
+        fprintf(stderr, "unable to close /proc/%s directory\n", proc_dir_name);
+    }
+    return ret;
+}
+
+/* Write the record or keep it for process.top, add it to the tiers. */
+static inline void
+process_emit(step_type* s) {
+    if (num_tiers != 0 && !watch_tick) { tier_add(s); }
+    if (top_capacity != 0) { top_push(s); }
+    else { step_write(s); }
+}
+
+static void
+top_write() {
+    top_sort();
+    for (size_t i=0; i<top_size; ++i) {
+        step_write(&top_entries[i].step);
+    }
+    if (top_num_other != 0) {
+        top_other.command = intern_string("other", 5);
+        step_write(&top_other);
+    }
+    top_reset();
+}
+
+static int
+step_init(int proc_fd, step_type* s, time_t timestamp, unsigned long current_interval) {
+    long ticks_per_second = sysconf(_SC_CLK_TCK);
+    if (ticks_per_second == -1) {
+        ticks_per_second = 100;
+        fprintf(stderr, "failed to get ticks per second, using default value: %ld\n", ticks_per_second);
+    }
+    s->ticks_per_second = ticks_per_second;
+    s->timestamp = timestamp;
+    s->interval = current_interval;
+    s->burst = burst_tag;
+    // stays zero unless the schedstat fields are selected
+    memset(&s->sched, 0, sizeof(schedstat_step_t));
+    if (collect_uptime(proc_fd, s) == -1) {
+        fprintf(stderr, "failed to collect uptime data\n");
+        return -1;
+    }
+    return 0;
+}
+
+static void
+collect_proc(time_t timestamp, unsigned long current_interval) {
     DIR* proc = opendir("/proc");
     if (proc == NULL) {
         perror("unable to open /proc directory");
@@ -527,11 +730,8 @@ collect_proc(time_t timestamp) {
         perror("unable to open /proc directory");
         return;
     }
-    long ticks_per_second = sysconf(_SC_CLK_TCK);
-    if (ticks_per_second == -1) {
-        ticks_per_second = 100;
-        fprintf(stderr, "failed to get ticks per second, using default value: %ld\n", ticks_per_second);
-    }
+    step_type s;
+    step_init(proc_fd, &s, timestamp, current_interval);
     struct dirent* entry;
     pid_t self = getpid();
     while (1) {
@@ -539,11 +739,8 @@ collect_proc(time_t timestamp) {
         if (entry == NULL) {
             break;
         }
-        step_type s;
-        s.ticks_per_second = ticks_per_second;
-        s.timestamp = timestamp;
-        if (collect_uptime(proc_fd, &s) == -1) {
-            fprintf(stderr, "failed to collect uptime data for %s\n", entry->d_name);
+        if (!is_number(entry->d_name)) {
+            continue;
         }
         struct stat st;
         if (fstatat(proc_fd, entry->d_name, &st, 0) == -1) {
@@ -552,7 +749,7 @@ collect_proc(time_t timestamp) {
         }
         s.user_id = st.st_uid;
         s.group_id = st.st_gid;
-        if ((st.st_mode & S_IFMT) == S_IFDIR && is_number(entry->d_name)) {
+        if ((st.st_mode & S_IFMT) == S_IFDIR) {
             pid_t pid = atoi(entry->d_name);
             if (pid == 0) {
                 continue;
@@ -560,41 +757,266 @@ collect_proc(time_t timestamp) {
             if (st.st_uid < min_uid && pid != self) {
                 continue;
             }
-            const char* proc_dir_name = entry->d_name;
-            int process_dir_fd = openat(proc_fd, proc_dir_name, O_PATH);
-            if (process_dir_fd == -1) {
-                fprintf(stderr, "unable to open /proc/%s directory\n", proc_dir_name);
+            if (collect_process(proc_fd, entry->d_name, &s) == -1) {
                 continue;
             }
-            if (collect_stat(process_dir_fd, proc_dir_name, &s) == -1) {
-                fprintf(stderr, "failed to collect data for %s\n", proc_dir_name);
-                goto close_process_dir;
+            process_emit(&s);
+        }
+    }
+    if (closedir(proc) == -1) {
+        perror("unable to close /proc directory");
+        return;
+    }
+}
+
+static pid_t* tree_pids = 0;
+static size_t tree_size = 0;
+static size_t tree_capacity = 0;
+static int proc_children_supported = 1;
+
+static void
+tree_push(pid_t pid) {
+    if (tree_size == tree_capacity) {
+        tree_capacity = tree_capacity == 0 ? 64 : tree_capacity*2;
+        tree_pids = realloc(tree_pids, tree_capacity*sizeof(pid_t));
+        if (tree_pids == NULL) { perror("realloc"); exit(1); }
+    }
+    tree_pids[tree_size++] = pid;
+}
+
+static int
+compare_pids(const void* a, const void* b) {
+    pid_t x = *((const pid_t*)a), y = *((const pid_t*)b);
+    return (x > y) - (x < y);
+}
+
+static int
+tree_contains(pid_t pid, size_t n) {
+    return bsearch(&pid, tree_pids, n, sizeof(pid_t), compare_pids) != NULL;
+}
+
+/*
+Append children of all threads of the process to the tree using
+/proc/<pid>/task/<tid>/children files. Returns -1 if the kernel
+does not provide these files (CONFIG_PROC_CHILDREN is not set).
+*/
+static int
+collect_children(int proc_fd, pid_t pid) {
+    char path[sizeof(((struct dirent*)0)->d_name) + 16];
+    snprintf(path, sizeof(path), "%d/task", pid);
+    int task_fd = openat(proc_fd, path, O_RDONLY|O_DIRECTORY);
+    if (task_fd == -1) {
+        // the process have terminated
+        return 0;
+    }
+    DIR* task = fdopendir(task_fd);
+    if (task == NULL) {
+        close(task_fd);
+        return 0;
+    }
+    int ret = 0;
+    for (struct dirent* entry = readdir(task); entry != NULL; entry = readdir(task)) {
+        if (!is_number(entry->d_name)) { continue; }
+        snprintf(path, sizeof(path), "%s/children", entry->d_name);
+        int fd = openat(task_fd, path, O_RDONLY);
+        if (fd == -1) {
+            if (errno == ENOENT && faccessat(task_fd, entry->d_name, F_OK, 0) == 0) {
+                ret = -1;
+                break;
             }
-            if (collect_io(process_dir_fd, proc_dir_name, &s) == -1) {
-                fprintf(stderr, "failed to collect io data for %s\n", proc_dir_name);
-                goto close_process_dir;
+            continue;
+        }
+        ssize_t nbytes = read(fd, buf, sizeof(buf)-1);
+        if (nbytes > 0) {
+            buf[nbytes] = 0;
+            char* first = buf;
+            char* last = 0;
+            while (1) {
+                long child = strtol(first, &last, 10);
+                if (last == first) { break; }
+                tree_push((pid_t)child);
+                first = last;
             }
-            if (collect_network(process_dir_fd, &s) == -1) {
-                fprintf(stderr, "failed to collect network data for %s\n", proc_dir_name);
-                goto close_process_dir;
+        }
+        if (close(fd) == -1) { perror("close"); }
+    }
+    if (closedir(task) == -1) { perror("closedir"); }
+    return ret;
+}
+
+/* Returns the parent process id from /proc/<pid>/stat or -1. */
+static pid_t
+read_parent_pid(int proc_fd, const char* name) {
+    char path[sizeof(((struct dirent*)0)->d_name) + 16];
+    snprintf(path, sizeof(path), "%s/stat", name);
+    int fd = openat(proc_fd, path, O_RDONLY);
+    if (fd == -1) { return -1; }
+    char line[512];
+    ssize_t nbytes = read(fd, line, sizeof(line)-1);
+    if (close(fd) == -1) { perror("close"); }
+    if (nbytes <= 0) { return -1; }
+    line[nbytes] = 0;
+    // the command may contain any characters, skip to the last parenthesis
+    const char* first = strrchr(line, ')');
+    char state = 0;
+    int parent = -1;
+    if (first == NULL || sscanf(first+1, " %c %d", &state, &parent) != 2) { return -1; }
+    return parent;
+}
+
+/*
+Collect the statistics only for the descendants of lockstep (the command
+and all of its children). Orphaned descendants are reparented to lockstep
+which is the subreaper, so they stay in the tree. Lockstep itself is the
+root of the tree, but its record is not written.
+*/
+static void
+collect_tree(time_t timestamp, unsigned long current_interval) {
+    int proc_fd = open("/proc", O_RDONLY|O_DIRECTORY);
+    if (proc_fd == -1) {
+        perror("unable to open /proc directory");
+        return;
+    }
+    step_type s;
+    step_init(proc_fd, &s, timestamp, current_interval);
+    char name[32];
+    if (proc_children_supported) {
+        tree_size = 0;
+        tree_push(getpid());
+        for (size_t i=0; i<tree_size; ++i) {
+            if (collect_children(proc_fd, tree_pids[i]) == -1) {
+                fprintf(stderr, "/proc/<pid>/task/<tid>/children files are not supported, "
+                        "falling back to the full scan\n");
+                proc_children_supported = 0;
+                break;
             }
-            #if defined(LOCKSTEP_WITH_NVML)
-            if (collect_nvml(pid, &s.nvml) == -1) {
-                fprintf(stderr, "failed to collect nvml data for %s\n", proc_dir_name);
-                goto close_process_dir;
+        }
+    }
+    if (proc_children_supported) {
+        // the first pid is lockstep itself
+        for (size_t i=1; i<tree_size; ++i) {
+            snprintf(name, sizeof(name), "%d", tree_pids[i]);
+            struct stat st;
+            if (fstatat(proc_fd, name, &st, 0) == -1) { continue; }
+            s.user_id = st.st_uid;
+            s.group_id = st.st_gid;
+            if (collect_process(proc_fd, name, &s) == -1) { continue; }
+            process_emit(&s);
+        }
+    } else {
+        // learn the tree from parent process ids of all processes
+        const pid_t self = getpid();
+        if (tree_size == 0) { tree_push(self); }
+        qsort(tree_pids, tree_size, sizeof(pid_t), compare_pids);
+        const size_t old_size = tree_size;
+        DIR* proc = fdopendir(proc_fd);
+        if (proc == NULL) {
+            perror("unable to open /proc directory");
+            close(proc_fd);
+            return;
+        }
+        for (struct dirent* entry = readdir(proc); entry != NULL; entry = readdir(proc)) {
+            if (!is_number(entry->d_name)) { continue; }
+            const pid_t pid = atoi(entry->d_name);
+            if (pid == self) {
+                tree_push(pid);
+                continue;
             }
-            #endif
-close_process_dir:
-            if (close(process_dir_fd) == -1) {
-                fprintf(stderr, "unable to close /proc/%s directory\n", proc_dir_name);
+            // only pid and ppid are read for the processes outside of the tree
+            if (!tree_contains(pid, old_size) &&
+                !tree_contains(read_parent_pid(proc_fd, entry->d_name), old_size)) {
+                continue;
             }
-            step_write(&s);
+            struct stat st;
+            if (fstatat(proc_fd, entry->d_name, &st, 0) == -1) { continue; }
+            s.user_id = st.st_uid;
+            s.group_id = st.st_gid;
+            if (collect_process(proc_fd, entry->d_name, &s) == -1) { continue; }
+            tree_push(s.process_id);
+            process_emit(&s);
+        }
+        // keep only the processes that were seen in this scan
+        memmove(tree_pids, tree_pids+old_size, (tree_size-old_size)*sizeof(pid_t));
+        tree_size -= old_size;
+        if (closedir(proc) == -1) { perror("unable to close /proc directory"); }
+        return;
+    }
+    if (close(proc_fd) == -1) { perror("unable to close /proc directory"); }
+}
+
+/* Read the first line of the file without the newline character. */
+static ssize_t
+read_line_at(int dir_fd, const char* name, char* line, size_t size) {
+    int fd = openat(dir_fd, name, O_RDONLY);
+    if (fd == -1) { return -1; }
+    ssize_t nbytes = read(fd, line, size);
+    if (close(fd) == -1) { perror("close"); }
+    if (nbytes == -1) { return -1; }
+    ssize_t n = 0;
+    while (n != nbytes && line[n] != '\n') { ++n; }
+    return n;
+}
+
+static void
+rules_check_sensor(time_t timestamp, const char* device, const char* sensor,
+                   const char* value, size_t value_size,
+                   const char* label, size_t label_size) {
+    char tmp[64];
+    if (value_size >= sizeof(tmp)) { return; }
+    memcpy(tmp, value, value_size);
+    tmp[value_size] = 0;
+    const double x = strtod(tmp, NULL);
+    const uint64_t until = tick_time + watch_duration;
+    uint32_t* fired = NULL;
+    for (int i=0; i<num_rules; ++i) {
+        const rule_type* rule = rules + i;
+        if (rule->kind != RULE_HWMON) { continue; }
+        if (strncmp(sensor, rule->name, strlen(rule->name)) != 0) { continue; }
+        if (fired == NULL) { fired = rule_sensor_fired(device, sensor); }
+        const uint32_t bit = 1U << i;
+        if (!rule_matches(rule, x)) {
+            *fired &= ~bit;
+            continue;
         }
+        if (*fired & bit) { continue; }
+        *fired |= bit;
+        char subject[PATH_MAX];
+        snprintf(subject, sizeof(subject), "/sys/class/hwmon/%s/%s", device, sensor);
+        snprintf(tmp, sizeof(tmp), "%.*s", (int)label_size, label);
+        event_write(timestamp, rule->text, subject, tmp, x);
+        watch_add(0, 0, device, sensor, until);
     }
-    if (closedir(proc) == -1) {
-        perror("unable to close /proc directory");
+}
+
+/* The sensor name ends with _input, it is temporarily changed to read *_label. */
+static void
+collect_hwmon_sensor(time_t timestamp, int dir_fd, const char* device, char* sensor,
+                     const char* hwmon_name, size_t hwmon_name_size) {
+    const size_t prefix_len = strlen(sensor)-6;
+    char value[64];
+    ssize_t value_size = read_line_at(dir_fd, sensor, value, sizeof(value));
+    if (value_size == -1) {
+        fprintf(stderr, "unable to read from /sys/class/hwmon/%s/%s file\n", device, sensor);
         return;
     }
+    // check for *_label
+    char label[64];
+    memcpy(sensor+prefix_len+1, "label", 5);
+    ssize_t label_size = read_line_at(dir_fd, sensor, label, sizeof(label));
+    if (label_size == -1) { label_size = 0; }
+    memcpy(sensor+prefix_len+1, "input", 5);
+    if (num_sensor_rules != 0 && !watch_tick) {
+        rules_check_sensor(timestamp, device, sensor, value, value_size, label, label_size);
+    }
+    char* first = format_hwmon_line(buf, buf+sizeof(buf), timestamp, device, sensor,
+                                    value, value_size, label, label_size,
+                                    hwmon_name, hwmon_name_size);
+    if (first == NULL) { return; }
+    // watched sensors are written even if hwmon is not selected
+    if ((system_fields & SYSTEM_HWMON) || watch_tick) {
+        write_to_output(system_out, &system_buffer, timestamp, buf, first-buf);
+    }
+    if (!watch_tick) { write_to_syslog(timestamp, buf, first-buf, SYSTEM_HWMON); }
 }
 
 static void
@@ -626,6 +1048,11 @@ collect_hwmon(time_t timestamp) {
             fprintf(stderr, "unable to open /sys/class/hwmon/%s directory", name);
             continue;
         }
+        // the name is the same for all sensors of the device
+        char hwmon_name[64];
+        ssize_t hwmon_name_size = read_line_at(hwmon_subdir_fd, "name",
+                                               hwmon_name, sizeof(hwmon_name));
+        if (hwmon_name_size == -1) { hwmon_name_size = 0; }
         for (struct dirent* entry2 = readdir(hwmon_sub);
              entry2 != NULL;
              entry2 = readdir(hwmon_sub)) {
@@ -633,57 +1060,8 @@ collect_hwmon(time_t timestamp) {
             size_t len = strlen(name2);
             size_t prefix_len = len-6;
             if (!(len >= 6 && strcmp(name2+prefix_len, "_input") == 0)) { continue; }
-            int fd = openat(hwmon_subdir_fd, name2, O_RDONLY);
-            if (fd == -1) {
-                fprintf(stderr, "unable to open /sys/class/hwmon/%s/%s file\n", name, name2);
-                continue;
-            }
-            char* first = buf;
-            int nwritten = sprintf(first, "%lu|/sys/class/hwmon/%s/%s|", timestamp, name, name2);
-            if (nwritten == -1) { goto close_fd; }
-            first += nwritten;
-            ssize_t nbytes = read(fd, first, sizeof(buf)-4-(first-buf));
-            if (nbytes == -1) {
-                fprintf(stderr, "unable to read from /sys/class/hwmon/%s/%s file\n", name, name2);
-                goto close_fd;
-            }
-            for (ssize_t i=0; i<nbytes && *first != '\n'; ++i, ++first);
-            *first++ = '|';
-            // check for *_label
-            memcpy(name2+prefix_len+1, "label", 5);
-            int fd2 = openat(hwmon_subdir_fd, name2, O_RDONLY);
-            if (fd2 != -1) {
-                ssize_t nbytes = read(fd2, first, sizeof(buf)-3-(first-buf));
-                if (nbytes == -1) {
-                    fprintf(stderr, "unable to read from /sys/class/hwmon/%s/%s file\n", name, name2);
-                    goto close_fd_2;
-                }
-                for (ssize_t i=0; i<nbytes && *first != '\n'; ++i, ++first);
-            }
-            *first++ = '|';
-            // check for name
-            int fd3 = openat(hwmon_subdir_fd, "name", O_RDONLY);
-            if (fd3 != -1) {
-                ssize_t nbytes = read(fd3, first, sizeof(buf)-2-(first-buf));
-                if (nbytes == -1) {
-                    perror("read");
-                    goto close_fd_3;
-                }
-                for (ssize_t i=0; i<nbytes && *first != '\n'; ++i, ++first);
-            }
-            *first++ = '\n';
-            *first = 0;
-            if (system_fields & SYSTEM_HWMON) {
-                write_to_file(system_out_fd, buf, first-buf);
-            }
-            write_to_syslog(buf, SYSTEM_HWMON);
-            //printf("%lu|/sys/class/hwmon/%s/%s|%s\n", timestamp, name, name2, buf);
-close_fd_3:
-            if (fd3 != -1 && close(fd3) == -1) { perror("close"); }
-close_fd_2:
-            if (fd2 != -1 && close(fd2) == -1) { perror("close"); }
-close_fd:
-            if (close(fd) == -1) { perror("close"); }
+            collect_hwmon_sensor(timestamp, hwmon_subdir_fd, name, name2,
+                                 hwmon_name, hwmon_name_size);
         }
         if (closedir(hwmon_sub) == -1) {
             fprintf(stderr, "unable to close /sys/class/hwmon/%s directory", name);
@@ -697,14 +1075,72 @@ close_fd:
 }
 
 static void
-collect_thermal(time_t timestamp) {
-    DIR* thermal = opendir("/sys/class/thermal");
-    if (thermal == NULL) {
-        perror("unable to open /sys/class/thermal directory");
+collect_hwmon_watch(time_t timestamp, const watch_type* w) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "/sys/class/hwmon/%s", w->device);
+    int dir_fd = open(path, O_RDONLY|O_DIRECTORY);
+    if (dir_fd == -1) { return; }
+    char hwmon_name[64];
+    ssize_t hwmon_name_size = read_line_at(dir_fd, "name", hwmon_name, sizeof(hwmon_name));
+    if (hwmon_name_size == -1) { hwmon_name_size = 0; }
+    char sensor[sizeof(w->sensor)];
+    memcpy(sensor, w->sensor, sizeof(sensor));
+    collect_hwmon_sensor(timestamp, dir_fd, w->device, sensor, hwmon_name, hwmon_name_size);
+    if (close(dir_fd) == -1) { perror("close"); }
+}
+
+/*
+Sample the watched processes and sensors. The records go to the regular
+outputs with the watch interval, syslog gets only the regular ticks.
+*/
+static void
+collect_watches(time_t timestamp) {
+    int proc_fd = open("/proc", O_RDONLY|O_DIRECTORY);
+    if (proc_fd == -1) {
+        perror("unable to open /proc directory");
         return;
     }
-    int thermal_fd = dirfd(thermal);
-    if (thermal_fd == -1) {
+    const int old_enable_syslog = enable_syslog;
+    enable_syslog = 0;
+    watch_tick = 1;
+    step_type s;
+    step_init(proc_fd, &s, timestamp, watch_interval);
+    char name[32];
+    for (int i=0; i<num_watches; ++i) {
+        watch_type* w = watches + i;
+        if (w->pid == 0) {
+            collect_hwmon_watch(timestamp, w);
+            continue;
+        }
+        snprintf(name, sizeof(name), "%d", w->pid);
+        struct stat st;
+        if (fstatat(proc_fd, name, &st, 0) == -1) {
+            // the process has terminated
+            w->until = 0;
+            continue;
+        }
+        s.user_id = st.st_uid;
+        s.group_id = st.st_gid;
+        if (collect_process(proc_fd, name, &s) == -1 || s.start_time != w->start_time) {
+            w->until = 0;
+            continue;
+        }
+        step_write(&s);
+    }
+    watch_tick = 0;
+    enable_syslog = old_enable_syslog;
+    if (close(proc_fd) == -1) { perror("unable to close /proc directory"); }
+}
+
+static void
+collect_thermal(time_t timestamp) {
+    DIR* thermal = opendir("/sys/class/thermal");
+    if (thermal == NULL) {
+        perror("unable to open /sys/class/thermal directory");
+        return;
+    }
+    int thermal_fd = dirfd(thermal);
+    if (thermal_fd == -1) {
         perror("unable to open /sys/class/thermal directory");
         return;
     }
@@ -755,9 +1191,9 @@ close_fd_2:
         *first++ = '\n';
         *first = 0;
         if (system_fields & SYSTEM_THERMAL) {
-            write_to_file(system_out_fd, buf, first-buf);
+            write_to_output(system_out, &system_buffer, timestamp, buf, first-buf);
         }
-        write_to_syslog(buf, SYSTEM_THERMAL);
+        write_to_syslog(timestamp, buf, first-buf, SYSTEM_THERMAL);
     }
     if (closedir(thermal) == -1) {
         perror("unable to close /sys/class/thermal directory");
@@ -765,6 +1201,104 @@ close_fd_2:
     }
 }
 
+static inline void
+write_system_record(time_t timestamp, const char* first, size_t n, system_fields_type field) {
+    if (system_fields & field) {
+        write_to_output(system_out, &system_buffer, timestamp, first, n);
+    }
+    write_to_syslog(timestamp, first, n, field);
+}
+
+typedef const char* (*parse_line_type)(const char* first, const char* last, counters_step_t* c);
+
+static void
+collect_counters(time_t timestamp, system_file_type file, parse_line_type parse_line,
+                 system_fields_type field) {
+    const char* path = system_file_paths[file];
+    ssize_t n = system_file_read(file);
+    if (n == -1) {
+        fprintf(stderr, "unable to read from %s file\n", path);
+        return;
+    }
+    const char* first = system_file_buffer;
+    const char* last = first + n;
+    counters_step_t c;
+    while (first != last) {
+        first = parse_line(first, last, &c);
+        if (c.nvalues == 0) {
+            // the cpu lines are at the beginning of /proc/stat
+            if (file == SYSTEM_FILE_STAT) { break; }
+            continue;
+        }
+        if (file == SYSTEM_FILE_DISKSTATS) {
+            // skip the devices that were never used (e.g. loop devices)
+            int used = 0;
+            for (int i=0; i<c.nvalues; ++i) { used |= c.values[i] != 0; }
+            if (!used) { continue; }
+        }
+        char* end = format_counters_line(buf, buf+sizeof(buf), timestamp, path, &c);
+        if (end != NULL) { write_system_record(timestamp, buf, end-buf, field); }
+    }
+}
+
+static void
+collect_memory(time_t timestamp) {
+    ssize_t n = system_file_read(SYSTEM_FILE_MEMINFO);
+    if (n == -1) {
+        fprintf(stderr, "unable to read from /proc/meminfo file\n");
+        return;
+    }
+    counters_step_t c;
+    parse_meminfo(system_file_buffer, system_file_buffer + n, &c);
+    char* end = format_counters_line(buf, buf+sizeof(buf), timestamp, "/proc/meminfo", &c);
+    if (end != NULL) { write_system_record(timestamp, buf, end-buf, SYSTEM_MEM); }
+}
+
+static void
+collect_numa_nodes(time_t timestamp) {
+    numa_init();
+    for (int i=0; i<numa_num_nodes; ++i) {
+        const numa_node_type* node = numa_nodes + i;
+        counters_step_t c;
+        snprintf(c.name, sizeof(c.name), "node%d", node->number);
+        ssize_t n = node->meminfo_fd == -1 ? -1 : system_fd_read(node->meminfo_fd);
+        if (n == -1) {
+            fprintf(stderr, "unable to read from /sys/devices/system/node/%s/meminfo file\n",
+                    c.name);
+            continue;
+        }
+        parse_node_meminfo(system_file_buffer, system_file_buffer + n, &c);
+        n = node->numastat_fd == -1 ? -1 : system_fd_read(node->numastat_fd);
+        if (n == -1) {
+            fprintf(stderr, "unable to read from /sys/devices/system/node/%s/numastat file\n",
+                    c.name);
+            continue;
+        }
+        parse_numastat(system_file_buffer, system_file_buffer + n, &c);
+        char path[64];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/%s", c.name);
+        char* end = format_counters_line(buf, buf+sizeof(buf), timestamp, path, &c);
+        if (end != NULL) { write_system_record(timestamp, buf, end-buf, SYSTEM_NUMA); }
+    }
+}
+
+static void
+collect_pressure(time_t timestamp) {
+    for (int i=0; i<NUM_PRESSURE_RESOURCES; ++i) {
+        pressure_step_t some, full;
+        if (pressure_read((pressure_resource_type)i, &some, &full) == -1) { continue; }
+        int n = snprintf(buf, sizeof(buf), "%lu|/proc/pressure/%s|%.2f|%.2f|%llu|%.2f|%.2f|%llu\n",
+                         timestamp, pressure_resources[i],
+                         some.avg10, some.avg60, some.total,
+                         full.avg10, full.avg60, full.total);
+        if (n <= 0 || (size_t)n >= sizeof(buf)) { continue; }
+        if (system_fields & SYSTEM_PRESSURE) {
+            write_to_output(system_out, &system_buffer, timestamp, buf, n);
+        }
+        write_to_syslog(timestamp, buf, n, SYSTEM_PRESSURE);
+    }
+}
+
 static void
 collect_drm(time_t timestamp) {
     const char* fields[] = {
@@ -808,9 +1342,9 @@ collect_drm(time_t timestamp) {
             *first++ = '\n';
             *first = 0;
             if (system_fields & SYSTEM_DRM) {
-                write_to_file(system_out_fd, buf, first-buf);
+                write_to_output(system_out, &system_buffer, timestamp, buf, first-buf);
             }
-            write_to_syslog(buf, SYSTEM_DRM);
+            write_to_syslog(timestamp, buf, first-buf, SYSTEM_DRM);
 close_fd:
             if (close(fd) == -1) { perror("close"); }
         }
@@ -821,19 +1355,66 @@ close_fd:
     }
 }
 
+#if defined(LOCKSTEP_WITH_NVML)
+static void
+write_nvml_value(time_t timestamp, unsigned int device, const char* name,
+                 const char* format, unsigned long long value) {
+    char* first = buf;
+    char* last = buf + sizeof(buf);
+    first += snprintf(first, last-first, "%lu|nvml/%u/%s|", timestamp, device, name);
+    first += snprintf(first, last-first, format, value);
+    *first++ = '\n';
+    if (system_fields & SYSTEM_NVML) {
+        write_to_output(system_out, &system_buffer, timestamp, buf, first-buf);
+    }
+    write_to_syslog(timestamp, buf, first-buf, SYSTEM_NVML);
+}
+
+static void
+collect_nvml_devices(time_t timestamp) {
+    for (unsigned int i=0; i<nvml_device_count; ++i) {
+        nvmlDevice_t device = nvml_devices[i];
+        nvmlUtilization_t utilization;
+        nvmlMemory_t memory;
+        unsigned int value;
+        unsigned long long reasons;
+        // metrics that the device does not support are skipped
+        if (nvmlDeviceGetUtilizationRates(device, &utilization) == NVML_SUCCESS) {
+            write_nvml_value(timestamp, i, "gpu_utilisation", "%llu", utilization.gpu);
+            write_nvml_value(timestamp, i, "memory_utilisation", "%llu", utilization.memory);
+        }
+        if (nvmlDeviceGetMemoryInfo(device, &memory) == NVML_SUCCESS) {
+            write_nvml_value(timestamp, i, "memory_used", "%llu", memory.used);
+            write_nvml_value(timestamp, i, "memory_total", "%llu", memory.total);
+        }
+        if (nvmlDeviceGetPowerUsage(device, &value) == NVML_SUCCESS) {
+            write_nvml_value(timestamp, i, "power_draw_mw", "%llu", value);
+        }
+        if (nvmlDeviceGetClockInfo(device, NVML_CLOCK_SM, &value) == NVML_SUCCESS) {
+            write_nvml_value(timestamp, i, "sm_clock_mhz", "%llu", value);
+        }
+        if (nvmlDeviceGetCurrentClocksThrottleReasons(device, &reasons) == NVML_SUCCESS) {
+            write_nvml_value(timestamp, i, "throttle_reasons", "%#llx", reasons);
+        }
+    }
+}
+#endif
+
 static void
 help_message(const char* argv0) {
-    printf("usage: %s [-c file] [-i interval] [-f field...] [-o file] [-F field...] [-O file] [-h] [--] [command]\n", argv0);
+    printf("usage: %s [-c file] [-i interval] [-b budget] [-f field...] [-o file] [-F field...] [-O file] [-h] [--] [command]\n", argv0);
     fputs("  -c file      configuration file\n", stdout);
     fputs("  -i interval  interval in microseconds\n", stdout);
+    fputs("  -b budget    CPU budget of the collector (e.g. 0.5%), adapts the interval\n", stdout);
     fputs("  -f field...  process fields\n", stdout);
     fputs("  -o file      write process statistics to file\n", stdout);
     fputs("  -F field...  system fields\n", stdout);
     fputs("  -O file      write system statistics to file\n", stdout);
     fputs("  -h           help\n", stdout);
+    fputs("  command      run the command and record only its process tree\n", stdout);
     fputs("\nprocess fields:\n", stdout);
     field_type* first = step_fields;
-    field_type* last = step_fields + sizeof(step_fields) / sizeof(field_type);
+    field_type* last = step_fields + NUM_STEP_FIELDS;
     field_type* old_first = first;
     fputs("  ", stdout);
     while (first != last) {
@@ -844,15 +1425,32 @@ help_message(const char* argv0) {
         }
         ++first;
     }
-    fputc('\n', stdout);
+    fputs("env:NAME\n", stdout);
     fputs("\nsystem fields:\n", stdout);
-    fputs("  hwmon thermal drm\n", stdout);
+    #if defined(LOCKSTEP_WITH_NVML)
+    fputs("  hwmon thermal drm pressure cpu mem disk netdev numa nvml\n", stdout);
+    #else
+    fputs("  hwmon thermal drm pressure cpu mem disk netdev numa\n", stdout);
+    #endif
 }
 
 static void
-parse_process_fields(const char* first, const char* last) {
+field_flags_add(const field_type* field) {
+    if (strncmp(field->name, "drm_", 4) == 0) { drm_fields = 1; }
+    if (strcmp(field->name, "cmdline") == 0 ||
+        strncmp(field->name, "env:", 4) == 0) { cmdline_fields = 1; }
+    if (strncmp(field->name, "cgroup", 6) == 0) { cgroup_fields = 1; }
+    if (field_is_rate(field)) { rate_fields = 1; }
+    if (field_is_schedstat(field)) { schedstat_fields = 1; }
+    if (field_is_smaps(field)) { smaps_fields = 1; }
+    if (field_is_numa(field)) { numa_fields = 1; }
+}
+
+/* Parse comma-separated field names, returns the number of fields or -1. */
+static int
+parse_field_list(const char* first, const char* last, int* fields) {
+    int nfields = 0;
     const char* field_begin = first;
-    num_process_fields = 0;
     while (first != last+1) {
         if (first == last || *first == ',') {
             const size_t n = first - field_begin;
@@ -861,17 +1459,50 @@ parse_process_fields(const char* first, const char* last) {
                 fputs("bad field: ", stderr);
                 fwrite(field_begin, 1, n, stderr);
                 fputs("\n", stderr);
-                exit(1);
+                return -1;
             }
-            process_fields[num_process_fields++] = result - step_fields;
+            fields[nfields++] = result - step_fields;
             field_begin = first + 1;
         }
         ++first;
     }
+    return nfields;
 }
 
-static system_fields_type
-parse_system_fields(const char* first, const char* last) {
+/*
+Replace the selected process fields. The optional data is collected
+for the new fields and for the columns of the segments and the stream,
+the tiers, that are fixed at startup.
+*/
+static void
+set_process_fields(const int* fields, int nfields) {
+    memcpy(process_fields, fields, nfields*sizeof(int));
+    num_process_fields = nfields;
+    drm_fields = 0;
+    cmdline_fields = 0;
+    cgroup_fields = 0;
+    rate_fields = 0;
+    schedstat_fields = 0;
+    smaps_fields = 0;
+    numa_fields = 0;
+    for (int i=0; i<num_process_fields; ++i) { field_flags_add(step_fields + process_fields[i]); }
+    for (size_t i=0; i<segment_ncolumns; ++i) { field_flags_add(segment_columns[i].field); }
+    for (size_t i=0; i<stream_ncolumns; ++i) { field_flags_add(stream_columns[i].field); }
+    for (int i=0; i<tier_num_fields; ++i) { field_flags_add(tier_fields[i]); }
+    if (tier_group != NULL) { field_flags_add(tier_group); }
+}
+
+static void
+parse_process_fields(const char* first, const char* last) {
+    int fields[NUM_STEP_FIELDS + MAX_ENV_FIELDS];
+    const int nfields = parse_field_list(first, last, fields);
+    if (nfields == -1) { exit(1); }
+    set_process_fields(fields, nfields);
+}
+
+/* Parse comma-separated system field names, returns -1 on error. */
+static int
+parse_system_field_list(const char* first, const char* last, system_fields_type* fields) {
     system_fields_type result = 0;
     const char* field_begin = first;
     while (first != last+1) {
@@ -883,52 +1514,41 @@ parse_system_fields(const char* first, const char* last) {
                 result |= SYSTEM_DRM;
             } else if (compare_chars(field_begin, first, "thermal") == 0) {
                 result |= SYSTEM_THERMAL;
+            } else if (compare_chars(field_begin, first, "pressure") == 0) {
+                result |= SYSTEM_PRESSURE;
+            } else if (compare_chars(field_begin, first, "cpu") == 0) {
+                result |= SYSTEM_CPU;
+            } else if (compare_chars(field_begin, first, "mem") == 0) {
+                result |= SYSTEM_MEM;
+            } else if (compare_chars(field_begin, first, "disk") == 0) {
+                result |= SYSTEM_DISK;
+            } else if (compare_chars(field_begin, first, "netdev") == 0) {
+                result |= SYSTEM_NETDEV;
+            } else if (compare_chars(field_begin, first, "numa") == 0) {
+                result |= SYSTEM_NUMA;
+            #if defined(LOCKSTEP_WITH_NVML)
+            } else if (compare_chars(field_begin, first, "nvml") == 0) {
+                result |= SYSTEM_NVML;
+            #endif
             } else {
                 fputs("bad field: ", stderr);
                 fwrite(field_begin, 1, n, stderr);
                 fputs("\n", stderr);
-                exit(1);
+                return -1;
             }
             field_begin = first + 1;
         }
         ++first;
     }
-    return result;
-}
-
-static unsigned long
-parse_unsigned_long(const char* first, const char* last) {
-    unsigned long i = 0;
-    unsigned long power = 1;
-    while (first != last) {
-        --last;
-        if (*last < '0' || *last > '9') { perror("parse_unsigned_long"); }
-        unsigned long addon = power * ((*last)-'0');
-        if (ULONG_MAX - addon < i) { return ULONG_MAX; }
-        i += addon;
-        power *= 10;
-    }
-    return i;
+    *fields = result;
+    return 0;
 }
 
-static unsigned long
-parse_duration(const char* first, const char* last) {
-    const char* suffix_first = last;
-    while (suffix_first != first && !isdigit(*(suffix_first-1))) {
-        --suffix_first;
-    }
-    unsigned long interval = parse_unsigned_long(first, suffix_first);
-    if (compare_chars(suffix_first, last, "m") == 0) { interval *= 60UL*1000000UL; }
-    else if (compare_chars(suffix_first, last, "s") == 0) { interval *= 1000000UL; }
-    else if (compare_chars(suffix_first, last, "ms") == 0) { interval *= 1000UL; }
-    else if (compare_chars(suffix_first, last, "us") == 0) {}
-    else if (compare_chars(suffix_first, last, "ns") == 0) { interval /= 1000UL; }
-    else { return ULONG_MAX; }
-    if (interval <= 0) {
-        fprintf(stderr, "bad interval %lu\n", interval);
-        exit(1);
-    }
-    return interval;
+static system_fields_type
+parse_system_fields(const char* first, const char* last) {
+    system_fields_type result = 0;
+    if (parse_system_field_list(first, last, &result) == -1) { exit(1); }
+    return result;
 }
 
 static int
@@ -971,6 +1591,64 @@ parse_syslog_level(const char* first, const char* last) {
     return level;
 }
 
+static void
+parse_rule(const char* first, const char* last, const char* path, int line_number) {
+    if (num_rules == MAX_RULES) {
+        fprintf(stderr, "%s:%d error: too many rules, the maximum is %d\n",
+                path, line_number, MAX_RULES);
+        exit(1);
+    }
+    rule_type* rule = rules + num_rules;
+    if (rule_parse(first, last, rule) == -1) {
+        fprintf(stderr, "%s:%d error: bad rule\n", path, line_number);
+        exit(1);
+    }
+    if (rule->kind == RULE_PROCESS) {
+        rule->field = find_field(rule->name, rule->name + strlen(rule->name));
+        if (rule->field == NULL || !field_is_number(rule->field)) {
+            fprintf(stderr, "%s:%d error: bad numeric field %s\n", path, line_number, rule->name);
+            exit(1);
+        }
+        if (field_is_rate(rule->field)) { rate_keys = 1; }
+        if (field_is_schedstat(rule->field)) { schedstat_keys = 1; }
+        if (field_is_smaps(rule->field)) { smaps_keys = 1; }
+        if (field_is_numa(rule->field)) { numa_keys = 1; }
+        ++num_process_rules;
+    } else {
+        ++num_sensor_rules;
+    }
+    ++num_rules;
+}
+
+/* Parse "N [by field]", the default field is cpu_percent. */
+static void
+parse_top(const char* first, const char* last, const char* path, int line_number) {
+    const char* number_last = first;
+    while (number_last != last && isdigit(*number_last)) { ++number_last; }
+    const unsigned long n = parse_unsigned_long(first, number_last);
+    first = number_last;
+    while (first != last && isspace(*first)) { ++first; }
+    const char* name = "cpu_percent";
+    const char* name_last = name + strlen(name);
+    if (last-first > 3 && strncmp(first, "by", 2) == 0 && isspace(first[2])) {
+        name = first + 3;
+        while (name != last && isspace(*name)) { ++name; }
+        name_last = last;
+    } else if (first != last) {
+        name_last = name;
+    }
+    field_type* field = name == name_last ? NULL : find_field(name, name_last);
+    if (n == 0 || n == ULONG_MAX || field == NULL || !field_is_number(field)) {
+        fprintf(stderr, "%s:%d error: bad top, expected N by numeric field\n", path, line_number);
+        exit(1);
+    }
+    if (field_is_rate(field)) { rate_keys = 1; }
+    if (field_is_schedstat(field)) { schedstat_keys = 1; }
+    if (field_is_smaps(field)) { smaps_keys = 1; }
+    if (field_is_numa(field)) { numa_keys = 1; }
+    top_init(n, field);
+}
+
 static void
 read_configuration_line(const char* first, const char* last,
                         const char* path, int line_number) {
@@ -1006,6 +1684,34 @@ read_configuration_line(const char* first, const char* last,
             fprintf(stderr, "%s:%d error: bad interval", path, line_number);
             exit(1);
         }
+    } else if (compare_chars(key_first, key_last, "syslog.process") == 0) {
+        syslog_process = parse_boolean(value_first, value_last);
+        if (syslog_process == -1) {
+            fprintf(stderr, "%s:%d error: bad boolean", path, line_number);
+            exit(1);
+        }
+    } else if (compare_chars(key_first, key_last, "syslog.summary") == 0) {
+        syslog_summary = parse_boolean(value_first, value_last);
+        if (syslog_summary == -1) {
+            fprintf(stderr, "%s:%d error: bad boolean", path, line_number);
+            exit(1);
+        }
+    } else if (compare_chars(key_first, key_last, "syslog.events") == 0) {
+        syslog_events = parse_boolean(value_first, value_last);
+        if (syslog_events == -1) {
+            fprintf(stderr, "%s:%d error: bad boolean", path, line_number);
+            exit(1);
+        }
+    } else if (compare_chars(key_first, key_last, "syslog.rate") == 0) {
+        syslog_rate = parse_unsigned_long(value_first, value_last);
+    } else if (compare_chars(key_first, key_last, "syslog.path") == 0) {
+        const size_t n = value_last-value_first;
+        if (n >= sizeof(syslog_path)) {
+            fprintf(stderr, "%s:%d error: bad path", path, line_number);
+            exit(1);
+        }
+        memcpy(syslog_path, value_first, n);
+        syslog_path[n] = 0;
     } else if (compare_chars(key_first, key_last, "syslog.facility") == 0) {
         syslog_facility = parse_syslog_facility(value_first, value_last);
     } else if (compare_chars(key_first, key_last, "syslog.level") == 0) {
@@ -1016,18 +1722,288 @@ read_configuration_line(const char* first, const char* last,
             fprintf(stderr, "%s:%d error: bad interval", path, line_number);
             exit(1);
         }
+    } else if (compare_chars(key_first, key_last, "rule") == 0) {
+        parse_rule(value_first, value_last, path, line_number);
+    } else if (compare_chars(key_first, key_last, "event.output") == 0) {
+        strncpy(tmp, value_first, value_last-value_first);
+        tmp[value_last-value_first] = 0;
+        open_output_file(&event_output, tmp);
+        event_file = 1;
+    } else if (compare_chars(key_first, key_last, "watch.interval") == 0) {
+        watch_interval = parse_duration(value_first, value_last);
+        if (watch_interval == 0 || watch_interval == ULONG_MAX) {
+            fprintf(stderr, "%s:%d error: bad interval", path, line_number);
+            exit(1);
+        }
+    } else if (compare_chars(key_first, key_last, "watch.duration") == 0) {
+        watch_duration = parse_duration(value_first, value_last);
+        if (watch_duration == 0 || watch_duration == ULONG_MAX) {
+            fprintf(stderr, "%s:%d error: bad interval", path, line_number);
+            exit(1);
+        }
+    } else if (compare_chars(key_first, key_last, "control.socket") == 0) {
+        const size_t n = value_last-value_first;
+        if (n >= sizeof(control_path)) {
+            fprintf(stderr, "%s:%d error: bad path", path, line_number);
+            exit(1);
+        }
+        memcpy(control_path, value_first, n);
+        control_path[n] = 0;
+    } else if (compare_chars(key_first, key_last, "pressure.trigger") == 0) {
+        if (num_pressure_triggers == MAX_PRESSURE_TRIGGERS) {
+            fprintf(stderr, "%s:%d error: too many pressure triggers, the maximum is %d\n",
+                    path, line_number, MAX_PRESSURE_TRIGGERS);
+            exit(1);
+        }
+        pressure_trigger_type* t = pressure_triggers + num_pressure_triggers;
+        if (pressure_trigger_parse(value_first, value_last, t) == -1) {
+            fprintf(stderr, "%s:%d error: bad pressure trigger\n", path, line_number);
+            exit(1);
+        }
+        ++num_pressure_triggers;
+    } else if (compare_chars(key_first, key_last, "pressure.interval") == 0) {
+        pressure_interval = parse_duration(value_first, value_last);
+        if (pressure_interval == 0 || pressure_interval == ULONG_MAX) {
+            fprintf(stderr, "%s:%d error: bad interval", path, line_number);
+            exit(1);
+        }
+    } else if (compare_chars(key_first, key_last, "pressure.duration") == 0) {
+        pressure_duration = parse_duration(value_first, value_last);
+        if (pressure_duration == 0 || pressure_duration == ULONG_MAX) {
+            fprintf(stderr, "%s:%d error: bad interval", path, line_number);
+            exit(1);
+        }
+    } else if (compare_chars(key_first, key_last, "cmdline.emit") == 0) {
+        if (compare_chars(value_first, value_last, "every") == 0) {
+            cmdline_emit = CMDLINE_EVERY_RECORD;
+        } else if (compare_chars(value_first, value_last, "first") == 0) {
+            cmdline_emit = CMDLINE_FIRST_RECORD;
+        } else {
+            fprintf(stderr, "%s:%d error: bad value, expected every or first", path, line_number);
+            exit(1);
+        }
+    } else if (compare_chars(key_first, key_last, "cmdline.max") == 0) {
+        cmdline_max_size = parse_size(value_first, value_last);
+        if (cmdline_max_size == 0 || cmdline_max_size == ULONG_MAX) {
+            fprintf(stderr, "%s:%d error: bad size", path, line_number);
+            exit(1);
+        }
+    } else if (compare_chars(key_first, key_last, "environ.max") == 0) {
+        environ_max_size = parse_size(value_first, value_last);
+        if (environ_max_size == 0 || environ_max_size == ULONG_MAX) {
+            fprintf(stderr, "%s:%d error: bad size", path, line_number);
+            exit(1);
+        }
+    } else if (compare_chars(key_first, key_last, "cgroup.tag") == 0) {
+        strncpy(tmp, value_first, value_last-value_first);
+        tmp[value_last-value_first] = 0;
+        cgroup_set_tag_regex(tmp);
+    } else if (compare_chars(key_first, key_last, "cgroup.refresh") == 0) {
+        cgroup_refresh_interval = parse_duration(value_first, value_last);
+        if (cgroup_refresh_interval == ULONG_MAX) {
+            fprintf(stderr, "%s:%d error: bad interval", path, line_number);
+            exit(1);
+        }
+    } else if (compare_chars(key_first, key_last, "cgroup.root") == 0) {
+        const size_t n = value_last-value_first;
+        if (n >= sizeof(cgroup_root)) {
+            fprintf(stderr, "%s:%d error: bad path", path, line_number);
+            exit(1);
+        }
+        memcpy(cgroup_root, value_first, n);
+        cgroup_root[n] = 0;
+    } else if (compare_chars(key_first, key_last, "drm.rescan") == 0) {
+        drm_rescan_interval = parse_duration(value_first, value_last);
+        if (drm_rescan_interval == ULONG_MAX) {
+            fprintf(stderr, "%s:%d error: bad interval", path, line_number);
+            exit(1);
+        }
+    } else if (compare_chars(key_first, key_last, "smaps.interval") == 0) {
+        smaps_interval = parse_duration(value_first, value_last);
+        if (smaps_interval == ULONG_MAX) {
+            fprintf(stderr, "%s:%d error: bad interval", path, line_number);
+            exit(1);
+        }
+    } else if (compare_chars(key_first, key_last, "smaps.budget") == 0) {
+        smaps_budget = parse_unsigned_long(value_first, value_last);
+        if (smaps_budget == 0 || smaps_budget == ULONG_MAX) {
+            fprintf(stderr, "%s:%d error: bad number of processes", path, line_number);
+            exit(1);
+        }
+    } else if (compare_chars(key_first, key_last, "numa.interval") == 0) {
+        numa_interval = parse_duration(value_first, value_last);
+        if (numa_interval == ULONG_MAX) {
+            fprintf(stderr, "%s:%d error: bad interval", path, line_number);
+            exit(1);
+        }
+    } else if (compare_chars(key_first, key_last, "numa.budget") == 0) {
+        numa_budget = parse_duration(value_first, value_last);
+        if (numa_budget == 0 || numa_budget == ULONG_MAX) {
+            fprintf(stderr, "%s:%d error: bad interval", path, line_number);
+            exit(1);
+        }
+    } else if (compare_chars(key_first, key_last, "numa.min_rss") == 0) {
+        numa_min_rss = parse_size(value_first, value_last);
+        if (numa_min_rss == 0) {
+            fprintf(stderr, "%s:%d error: bad size", path, line_number);
+            exit(1);
+        }
+    } else if (compare_chars(key_first, key_last, "interval.min") == 0) {
+        min_interval = parse_duration(value_first, value_last);
+        if (min_interval == 0 || min_interval == ULONG_MAX) {
+            fprintf(stderr, "%s:%d error: bad interval", path, line_number);
+            exit(1);
+        }
+    } else if (compare_chars(key_first, key_last, "interval.max") == 0) {
+        max_interval = parse_duration(value_first, value_last);
+        if (max_interval == 0 || max_interval == ULONG_MAX) {
+            fprintf(stderr, "%s:%d error: bad interval", path, line_number);
+            exit(1);
+        }
+    } else if (compare_chars(key_first, key_last, "cpu.budget") == 0) {
+        cpu_budget = parse_budget(value_first, value_last);
+        if (cpu_budget == -1) {
+            fprintf(stderr, "%s:%d error: bad cpu budget", path, line_number);
+            exit(1);
+        }
+    } else if (compare_chars(key_first, key_last, "output.queue") == 0) {
+        writer_queue_capacity = parse_unsigned_long(value_first, value_last);
+        if (writer_queue_capacity == 0 || writer_queue_capacity > 4096) {
+            fprintf(stderr, "%s:%d error: bad queue size", path, line_number);
+            exit(1);
+        }
+    } else if (compare_chars(key_first, key_last, "output.policy") == 0) {
+        if (compare_chars(value_first, value_last, "drop") == 0) {
+            writer_policy = WRITER_DROP;
+        } else if (compare_chars(value_first, value_last, "block") == 0) {
+            writer_policy = WRITER_BLOCK;
+        } else {
+            fprintf(stderr, "%s:%d error: bad policy", path, line_number);
+            exit(1);
+        }
+    } else if (compare_chars(key_first, key_last, "output.flush") == 0) {
+        writer_flush_interval = parse_duration(value_first, value_last);
+        if (writer_flush_interval == ULONG_MAX) {
+            fprintf(stderr, "%s:%d error: bad interval", path, line_number);
+            exit(1);
+        }
+    } else if (compare_chars(key_first, key_last, "output.sync") == 0) {
+        writer_sync_interval = parse_duration(value_first, value_last);
+        if (writer_sync_interval == ULONG_MAX) {
+            fprintf(stderr, "%s:%d error: bad interval", path, line_number);
+            exit(1);
+        }
+    } else if (compare_chars(key_first, key_last, "output.rotate.size") == 0) {
+        rotate_size = parse_size(value_first, value_last);
+        if (rotate_size == 0) {
+            fprintf(stderr, "%s:%d error: bad size", path, line_number);
+            exit(1);
+        }
+    } else if (compare_chars(key_first, key_last, "output.rotate.interval") == 0) {
+        rotate_interval = parse_duration(value_first, value_last);
+        if (rotate_interval < 1000000UL || rotate_interval == ULONG_MAX) {
+            fprintf(stderr, "%s:%d error: bad interval", path, line_number);
+            exit(1);
+        }
+        // rotation windows are measured in seconds
+        rotate_interval /= 1000000UL;
+    } else if (compare_chars(key_first, key_last, "output.rotate.retention") == 0) {
+        rotate_retention = parse_duration(value_first, value_last);
+        if (rotate_retention < 1000000UL || rotate_retention == ULONG_MAX) {
+            fprintf(stderr, "%s:%d error: bad interval", path, line_number);
+            exit(1);
+        }
+        rotate_retention /= 1000000UL;
+    } else if (compare_chars(key_first, key_last, "tier") == 0) {
+        if (tier_parse(value_first, value_last) == -1) {
+            fprintf(stderr, "%s:%d error: bad tier, expected window retention path "
+                    "with the window that is a multiple of the previous one\n", path, line_number);
+            exit(1);
+        }
+    } else if (compare_chars(key_first, key_last, "tier.fields") == 0) {
+        int fields[NUM_STEP_FIELDS + MAX_ENV_FIELDS];
+        const int nfields = parse_field_list(value_first, value_last, fields);
+        if (nfields == -1 || nfields > TIER_MAX_FIELDS) {
+            fprintf(stderr, "%s:%d error: bad fields\n", path, line_number);
+            exit(1);
+        }
+        for (int i=0; i<nfields; ++i) {
+            const field_type* field = step_fields + fields[i];
+            if (!field_is_number(field)) {
+                fprintf(stderr, "%s:%d error: bad numeric field %s\n", path, line_number,
+                        field->name);
+                exit(1);
+            }
+            tier_fields[i] = field;
+            field_flags_add(field);
+        }
+        tier_num_fields = nfields;
+    } else if (compare_chars(key_first, key_last, "tier.group") == 0) {
+        tier_group = find_field(value_first, value_last);
+        if (tier_group == NULL) {
+            fprintf(stderr, "%s:%d error: bad field\n", path, line_number);
+            exit(1);
+        }
+        field_flags_add(tier_group);
+    } else if (compare_chars(key_first, key_last, "tier.groups") == 0) {
+        const unsigned long n = parse_unsigned_long(value_first, value_last);
+        if (n == 0 || n > 1000000UL) {
+            fprintf(stderr, "%s:%d error: bad number of groups", path, line_number);
+            exit(1);
+        }
+        tier_max_groups = (uint32_t)n;
+    } else if (compare_chars(key_first, key_last, "output.rotate.compress") == 0) {
+        rotate_compress = parse_boolean(value_first, value_last);
+        if (rotate_compress == -1) {
+            fprintf(stderr, "%s:%d error: bad boolean", path, line_number);
+            exit(1);
+        }
+        #if !defined(LOCKSTEP_WITH_ZLIB)
+        if (rotate_compress) {
+            fprintf(stderr, "%s:%d error: compression is not supported", path, line_number);
+            exit(1);
+        }
+        #endif
     } else if (compare_chars(key_first, key_last, "system.fields") == 0) {
         system_fields = parse_system_fields(value_first, value_last);
     } else if (compare_chars(key_first, key_last, "system.output") == 0) {
-        strncpy(tmp, key_first, key_last-key_first);
-        tmp[key_last-key_first] = 0;
-        system_out_fd = open_output_file(tmp);
+        strncpy(tmp, value_first, value_last-value_first);
+        tmp[value_last-value_first] = 0;
+        open_output_file(&system_output, tmp);
     } else if (compare_chars(key_first, key_last, "process.fields") == 0) {
         parse_process_fields(value_first, value_last);
+    } else if (compare_chars(key_first, key_last, "process.top") == 0) {
+        parse_top(value_first, value_last, path, line_number);
+    } else if (compare_chars(key_first, key_last, "process.segments") == 0) {
+        const size_t n = value_last-value_first;
+        if (n >= sizeof(segment_directory)) {
+            fprintf(stderr, "%s:%d error: bad path", path, line_number);
+            exit(1);
+        }
+        memcpy(segment_directory, value_first, n);
+        segment_directory[n] = 0;
+    } else if (compare_chars(key_first, key_last, "stream.address") == 0) {
+        strncpy(tmp, value_first, value_last-value_first);
+        tmp[value_last-value_first] = 0;
+        stream_open(tmp);
+    } else if (compare_chars(key_first, key_last, "stream.spool") == 0) {
+        const size_t n = value_last-value_first;
+        if (n >= sizeof(stream_spool_path)) {
+            fprintf(stderr, "%s:%d error: bad path", path, line_number);
+            exit(1);
+        }
+        memcpy(stream_spool_path, value_first, n);
+        stream_spool_path[n] = 0;
+    } else if (compare_chars(key_first, key_last, "stream.spool.size") == 0) {
+        stream_spool_size = parse_size(value_first, value_last);
+        if (stream_spool_size == 0) {
+            fprintf(stderr, "%s:%d error: bad size", path, line_number);
+            exit(1);
+        }
     } else if (compare_chars(key_first, key_last, "process.output") == 0) {
-        strncpy(tmp, key_first, key_last-key_first);
-        tmp[key_last-key_first] = 0;
-        process_out_fd = open_output_file(tmp);
+        strncpy(tmp, value_first, value_last-value_first);
+        tmp[value_last-value_first] = 0;
+        open_output_file(&process_output, tmp);
     } else {
         fprintf(stderr, "%s:%d error: bad field ", path, line_number);
         fwrite(key_first, 1, key_size, stderr);
@@ -1063,11 +2039,36 @@ static void read_configuration(const char* path) {
     if (munmap((void*)buffer, status.st_size) == -1) { perror("munmap"); }
 }
 
+/*
+Exit with an error if the rotated files of two outputs may have the same
+names, or if output_expire of one output may remove the files of another.
+*/
+static void
+check_output_names() {
+    const output_type* outputs[3 + MAX_TIERS];
+    int noutputs = 0;
+    if (rotate_size != 0 || rotate_interval != 0) {
+        outputs[noutputs++] = &process_output;
+        if (system_out == &system_output) { outputs[noutputs++] = &system_output; }
+        if (event_file) { outputs[noutputs++] = &event_output; }
+    }
+    for (int i=0; i<num_tiers; ++i) { outputs[noutputs++] = &tiers[i].output; }
+    for (int i=0; i<noutputs; ++i) {
+        for (int j=i+1; j<noutputs; ++j) {
+            const char* a = outputs[i]->path;
+            const char* b = outputs[j]->path;
+            if (a == NULL || b == NULL || !output_names_collide(a, b)) { continue; }
+            fprintf(stderr, "the rotated files of %s and %s have the same names\n", a, b);
+            exit(1);
+        }
+    }
+}
+
 static void
 parse_options(int argc, char* argv[]) {
     int opt = 0;
     int help = 0;
-    while ((opt = getopt(argc, argv, "c:i:f:o:F:O:h")) != -1) {
+    while ((opt = getopt(argc, argv, "c:i:b:f:o:F:O:h")) != -1) {
         if (opt == 'i') {
             unsigned long new_interval = atol(optarg);
             if (new_interval <= 0) {
@@ -1076,6 +2077,13 @@ parse_options(int argc, char* argv[]) {
             }
             interval = new_interval;
         }
+        if (opt == 'b') {
+            cpu_budget = parse_budget(optarg, optarg + strlen(optarg));
+            if (cpu_budget == -1) {
+                fprintf(stderr, "bad cpu budget %s\n", optarg);
+                exit(1);
+            }
+        }
         if (opt == 'f') {
             parse_process_fields(optarg, optarg + strlen(optarg));
         }
@@ -1083,13 +2091,13 @@ parse_options(int argc, char* argv[]) {
             help = 1;
         }
         if (opt == 'o') {
-            process_out_fd = open_output_file(optarg);
+            open_output_file(&process_output, optarg);
         }
         if (opt == 'F') {
             system_fields = parse_system_fields(optarg, optarg + strlen(optarg));
         }
         if (opt == 'O') {
-            system_out_fd = open_output_file(optarg);
+            open_output_file(&system_output, optarg);
         }
         if (opt == 'c') {
             read_configuration(optarg);
@@ -1104,33 +2112,748 @@ parse_options(int argc, char* argv[]) {
         exit(0);
     }
     if (optind != argc) { child_argv = argv+optind; }
-    if (process_out_fd == -1) { process_out_fd = STDOUT_FILENO; }
-    if (system_out_fd == -1) { system_out_fd = STDOUT_FILENO; }
+    if (cpu_budget != 0) {
+        if (min_interval == 0) { min_interval = interval; }
+        if (max_interval == 0) { max_interval = 10*min_interval; }
+        if (min_interval > max_interval) {
+            fprintf(stderr, "bad interval range %lu..%lu\n", min_interval, max_interval);
+            exit(1);
+        }
+        interval = min_interval;
+    }
+    if (process_output.fd == -1) { process_output.fd = STDOUT_FILENO; }
+    if (system_output.fd == -1) { system_output.fd = STDOUT_FILENO; }
+    if (syslog_events == -1) {
+        // the event records have different columns than the process records,
+        // so they never go to the standard output
+        syslog_events = !event_file && (num_rules != 0 || num_pressure_triggers != 0);
+    }
+    if (process_output.path != NULL && system_output.path != NULL &&
+        strcmp(process_output.path, system_output.path) == 0) {
+        // both outputs share the same file, rotate it only once
+        system_out = &process_output;
+    }
+    check_output_names();
+}
+
+static unsigned long
+timespec_difference(const struct timespec* a, const struct timespec* b) {
+    long long ns = (a->tv_sec - b->tv_sec)*1000000000LL + (a->tv_nsec - b->tv_nsec);
+    return ns < 0 ? 0 : (unsigned long)(ns / 1000LL);
+}
+
+static unsigned long
+adapt_interval(unsigned long old_interval, unsigned long cpu_time) {
+    // the interval at which the last tick would have consumed exactly the budget
+    double target = ((double)cpu_time) / cpu_budget;
+    // smooth out the spikes, then clamp to the configured range
+    double new_interval = 0.75*((double)old_interval) + 0.25*target;
+    if (new_interval < (double)min_interval) { return min_interval; }
+    if (new_interval > (double)max_interval) { return max_interval; }
+    return (unsigned long)new_interval;
+}
+
+typedef struct event_source event_source_type;
+typedef void (*event_callback_type)(event_source_type* source, uint32_t events);
+
+struct event_source {
+    int fd;
+    event_callback_type callback;
+};
+
+static int epoll_fd = -1;
+static event_source_type timer_source = {-1, 0};
+static event_source_type signal_source = {-1, 0};
+static event_source_type child_source = {-1, 0};
+static event_source_type watch_source = {-1, 0};
+static int watch_armed = 0;
+static event_source_type pressure_sources[MAX_PRESSURE_TRIGGERS];
+static event_source_type burst_source = {-1, 0};
+// monotonic time in microseconds, zero when there is no burst
+static uint64_t burst_until = 0;
+static unsigned long burst_interval = 0;
+static char burst_name[32] = {0};
+static event_source_type control_source = {-1, 0};
+typedef struct {
+    event_source_type source;
+    char command[CONTROL_MAX_COMMAND];
+    size_t size;
+} control_client_type;
+static control_client_type control_clients[CONTROL_MAX_CLIENTS];
+static struct timespec tick_start = {0};
+static struct timespec previous_tick_start = {0};
+static unsigned long num_ticks = 0;
+// the CPU time of the last tick in microseconds
+static unsigned long tick_cpu_time = 0;
+static unsigned long syslog_elapsed = 0;
+static int child_status = 0;
+static int child_waited = 0;
+
+static void
+event_loop_add(event_source_type* source, int fd, uint32_t events,
+               event_callback_type callback) {
+    source->fd = fd;
+    source->callback = callback;
+    struct epoll_event ev = {0};
+    ev.events = events;
+    ev.data.ptr = source;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+        perror("epoll_ctl");
+        exit(1);
+    }
+}
+
+static void
+event_loop_remove(event_source_type* source) {
+    if (source->fd == -1) { return; }
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_DEL, source->fd, 0) == -1) { perror("epoll_ctl"); }
+    if (close(source->fd) == -1) { perror("close"); }
+    source->fd = -1;
+}
+
+static void
+timer_arm(const struct timespec* deadline) {
+    struct itimerspec t = {0};
+    t.it_value = *deadline;
+    if (timerfd_settime(timer_source.fd, TFD_TIMER_ABSTIME, &t, 0) == -1) {
+        perror("timerfd_settime");
+        exit(1);
+    }
+}
+
+/* Start or stop the watch timer. */
+static void
+watch_arm() {
+    if ((num_watches != 0) == watch_armed) { return; }
+    struct itimerspec t = {0};
+    if (num_watches != 0) {
+        t.it_interval.tv_sec = watch_interval / 1000000UL;
+        t.it_interval.tv_nsec = (watch_interval % 1000000UL) * 1000UL;
+        t.it_value = t.it_interval;
+    }
+    if (timerfd_settime(watch_source.fd, 0, &t, 0) == -1) {
+        perror("timerfd_settime");
+        exit(1);
+    }
+    watch_armed = num_watches != 0;
+}
+
+static void
+tick() {
+    time_t timestamp = time(NULL);
+    clock_gettime(CLOCK_MONOTONIC, &tick_start);
+    tick_time = tick_start.tv_sec*1000000UL + tick_start.tv_nsec/1000UL;
+    // the first tick has no previous one, use the configured interval
+    unsigned long current_interval = interval;
+    if (previous_tick_start.tv_sec != 0) {
+        current_interval = timespec_difference(&tick_start, &previous_tick_start);
+    }
+    previous_tick_start = tick_start;
+    struct timespec cpu_start, cpu_end;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_start);
+    memset(&summary, 0, sizeof(summary));
+    if (num_process_fields != 0 || num_process_rules != 0 || num_tiers != 0) {
+        #if defined(LOCKSTEP_WITH_NVML)
+        if (nvml_collect_accounting() == -1) {
+            fprintf(stderr, "failed to collect nvml accounting data\n");
+        }
+        #endif
+        if (smaps_fields || smaps_keys) { smaps_tick_begin(); }
+        if (numa_fields || numa_keys) { numa_tick_begin(); }
+        if (child_pid != 0) { collect_tree(timestamp, current_interval); }
+        else { collect_proc(timestamp, current_interval); }
+        if (top_capacity != 0) { top_write(); }
+        if (num_tiers != 0) { tier_tick_end(timestamp); }
+        // the names and the state of the processes that exited since the last tick
+        intern_sweep();
+        if (cgroup_fields) { cgroup_table_sweep(process_table_generation); }
+        if (process_state_enabled()) { process_table_sweep(); }
+    }
+    // fields that go only to syslog are collected only on syslog ticks
+    system_fields_type active = system_fields | (enable_syslog ? syslog_system_fields : 0);
+    if ((active & SYSTEM_HWMON) || num_sensor_rules != 0) { collect_hwmon(timestamp); }
+    if (active & SYSTEM_DRM) { collect_drm(timestamp); }
+    if (active & SYSTEM_THERMAL) { collect_thermal(timestamp); }
+    if (active & SYSTEM_PRESSURE) { collect_pressure(timestamp); }
+    if (active & SYSTEM_CPU) {
+        collect_counters(timestamp, SYSTEM_FILE_STAT, parse_cpu_line, SYSTEM_CPU);
+    }
+    if (active & SYSTEM_MEM) { collect_memory(timestamp); }
+    if (active & SYSTEM_DISK) {
+        collect_counters(timestamp, SYSTEM_FILE_DISKSTATS, parse_diskstats_line, SYSTEM_DISK);
+    }
+    if (active & SYSTEM_NETDEV) {
+        collect_counters(timestamp, SYSTEM_FILE_NETDEV, parse_netdev_line, SYSTEM_NETDEV);
+    }
+    if (active & SYSTEM_NUMA) { collect_numa_nodes(timestamp); }
+    #if defined(LOCKSTEP_WITH_NVML)
+    if (active & SYSTEM_NVML) { collect_nvml_devices(timestamp); }
+    #endif
+    if (enable_syslog && syslog_summary) { summary_write(timestamp); }
+    flush_outputs(0);
+    if (stream_enabled) { stream_flush(); }
+    if (syslog_count != 0) { syslog_flush(); }
+    watch_arm();
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_end);
+    ++num_ticks;
+    tick_cpu_time = timespec_difference(&cpu_end, &cpu_start);
+    if (cpu_budget != 0) { interval = adapt_interval(interval, tick_cpu_time); }
+    syslog_elapsed += interval;
+    if (syslog_elapsed >= syslog_interval) {
+        enable_syslog = 1;
+        syslog_elapsed = 0;
+    } else {
+        enable_syslog = 0;
+    }
+}
+
+static void
+on_timer(event_source_type* source, uint32_t events) {
+    uint64_t expirations = 0;
+    if (read(source->fd, &expirations, sizeof(expirations)) == -1 && errno != EAGAIN) {
+        perror("read");
+    }
+    tick();
+    // schedule the next tick relative to the start of the current one
+    struct timespec t = tick_start;
+    t.tv_sec += interval / 1000000UL;
+    t.tv_nsec += (interval % 1000000UL) * 1000UL;
+    if (t.tv_nsec >= 1000000000L) { t.tv_nsec -= 1000000000L; ++t.tv_sec; }
+    timer_arm(&t);
+}
+
+static void
+on_watch(event_source_type* source, uint32_t events) {
+    uint64_t expirations = 0;
+    if (read(source->fd, &expirations, sizeof(expirations)) == -1 && errno != EAGAIN) {
+        perror("read");
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    // the collectors use the time of the current sample
+    tick_time = now.tv_sec*1000000UL + now.tv_nsec/1000UL;
+    watch_expire(tick_time);
+    if (num_watches != 0) {
+        collect_watches(time(NULL));
+        flush_outputs(0);
+        if (stream_enabled) { stream_flush(); }
+    }
+    watch_arm();
+}
+
+static uint64_t
+monotonic_now() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec*1000000UL + now.tv_nsec/1000UL;
+}
+
+/* Sample all processes between the ticks, the records are tagged with the reason. */
+static void
+collect_burst(unsigned long current_interval) {
+    if (num_process_fields == 0) { return; }
+    tick_time = monotonic_now();
+    const time_t timestamp = time(NULL);
+    const int old_enable_syslog = enable_syslog;
+    enable_syslog = 0;
+    watch_tick = 1;
+    burst_tag = intern_string(burst_name, strlen(burst_name));
+    if (child_pid != 0) { collect_tree(timestamp, current_interval); }
+    else { collect_proc(timestamp, current_interval); }
+    if (top_capacity != 0) { top_write(); }
+    burst_tag = 0;
+    watch_tick = 0;
+    enable_syslog = old_enable_syslog;
+    flush_outputs(0);
+    if (stream_enabled) { stream_flush(); }
+}
+
+/* Start or stop the burst timer. */
+static void
+burst_arm() {
+    struct itimerspec t = {0};
+    if (burst_until != 0) {
+        t.it_interval.tv_sec = burst_interval / 1000000UL;
+        t.it_interval.tv_nsec = (burst_interval % 1000000UL) * 1000UL;
+        t.it_value = t.it_interval;
+    }
+    if (timerfd_settime(burst_source.fd, 0, &t, 0) == -1) {
+        perror("timerfd_settime");
+        exit(1);
+    }
+}
+
+/* Sample all processes now and then every sampling_interval for duration. */
+static void
+burst_start(const char* name, unsigned long sampling_interval, unsigned long duration) {
+    // the burst that starts during another one extends it
+    const uint64_t until = monotonic_now() + duration;
+    if (until > burst_until) { burst_until = until; }
+    burst_interval = sampling_interval;
+    snprintf(burst_name, sizeof(burst_name), "%s", name);
+    // the first sample covers the time since the last regular tick
+    unsigned long current_interval = interval;
+    if (tick_start.tv_sec != 0) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        current_interval = timespec_difference(&now, &tick_start);
+    }
+    collect_burst(current_interval);
+    burst_arm();
+}
+
+static void
+on_burst(event_source_type* source, uint32_t events) {
+    uint64_t expirations = 0;
+    if (read(source->fd, &expirations, sizeof(expirations)) == -1 && errno != EAGAIN) {
+        perror("read");
+    }
+    if (burst_until == 0) { return; }
+    if (monotonic_now() >= burst_until) {
+        burst_until = 0;
+        burst_arm();
+        return;
+    }
+    collect_burst(burst_interval);
+}
+
+static void
+on_pressure(event_source_type* source, uint32_t events) {
+    pressure_trigger_type* t = pressure_triggers + (source - pressure_sources);
+    if (events & EPOLLERR) {
+        fprintf(stderr, "pressure trigger %s is removed by the kernel\n", t->text);
+        event_loop_remove(source);
+        t->fd = -1;
+        return;
+    }
+    double value = 0;
+    pressure_step_t some, full;
+    if (pressure_read(t->resource, &some, &full) == 0) {
+        value = t->full ? full.avg10 : some.avg10;
+    }
+    event_write(time(NULL), t->text, pressure_resources[t->resource],
+                t->full ? "full" : "some", value);
+    burst_start(t->name, pressure_interval, pressure_duration);
+}
+
+static void
+watch_pressure() {
+    for (int i=0; i<num_pressure_triggers; ++i) {
+        pressure_trigger_type* t = pressure_triggers + i;
+        // the kernel without PSI support is not an error, the triggers are skipped
+        if (pressure_trigger_open(t) == -1) { continue; }
+        event_loop_add(pressure_sources + i, t->fd, EPOLLPRI, on_pressure);
+    }
+}
+
+/* Write "name value" lines, returns the number of characters. */
+static size_t
+format_statistics(char* first, size_t n) {
+    struct rusage usage;
+    memset(&usage, 0, sizeof(usage));
+    if (getrusage(RUSAGE_SELF, &usage) == -1) { perror("getrusage"); }
+    const uint64_t now = monotonic_now();
+    int ret = snprintf(
+        first, n,
+        "ticks %lu\ninterval %lu\ntick_cpu_time %lu\n"
+        "user_time %ld\nsystem_time %ld\nmax_resident_set_size %ld\n"
+        "processes %u\nstrings %u\nwatches %d\nburst %lu\n"
+        "dropped_ticks %lu\ndropped_bytes %lu\ndropped_watches %lu\n"
+        "dropped_segment_blocks %lu\ndropped_stream_frames %lu\n"
+        "dropped_syslog_messages %lu\nrate_limited_syslog_messages %lu\n",
+        num_ticks, interval, tick_cpu_time,
+        (long)(usage.ru_utime.tv_sec*1000000L + usage.ru_utime.tv_usec),
+        (long)(usage.ru_stime.tv_sec*1000000L + usage.ru_stime.tv_usec),
+        usage.ru_maxrss,
+        process_table_size, intern_num_strings, num_watches,
+        burst_until > now ? (unsigned long)(burst_until - now) : 0UL,
+        writer_dropped_ticks, writer_dropped_bytes, watch_dropped,
+        segment_dropped_blocks, stream_dropped_frames,
+        syslog_dropped, syslog_rate_limited);
+    if (ret < 0) { return 0; }
+    return (size_t)ret < n ? (size_t)ret : n-1;
+}
+
+/* Returns the duration or ULONG_MAX, zero is not a valid duration. */
+static unsigned long
+control_duration(const char* value) {
+    const char* last = value + strlen(value);
+    if (!isdigit(*value)) { return ULONG_MAX; }
+    const char* digits_last = value;
+    while (isdigit(*digits_last)) { ++digits_last; }
+    if (parse_unsigned_long(value, digits_last) == 0) { return ULONG_MAX; }
+    return parse_duration(value, last);
+}
+
+/* Switch the output to the new file in the writer thread. */
+static int
+control_output(output_type* output, const char* path) {
+    // check that the file can be opened before switching to it
+    int fd = open(path, O_CREAT|O_APPEND|O_WRONLY|O_CLOEXEC, 0644);
+    if (fd == -1) { return -1; }
+    if (close(fd) == -1) { perror("close"); }
+    char* new_path = strdup(path);
+    if (new_path == NULL) { return -1; }
+    free(atomic_exchange(&output->new_path, new_path));
+    return 0;
+}
+
+static const char*
+control_set(const char* key, const char* value) {
+    const char* last = value + strlen(value);
+    if (strcmp(key, "process.fields") == 0) {
+        int fields[NUM_STEP_FIELDS + MAX_ENV_FIELDS];
+        const int nfields = parse_field_list(value, last, fields);
+        if (nfields == -1) { return "bad field"; }
+        set_process_fields(fields, nfields);
+    } else if (strcmp(key, "system.fields") == 0) {
+        system_fields_type fields = 0;
+        if (parse_system_field_list(value, last, &fields) == -1) { return "bad field"; }
+        system_fields = fields;
+    } else if (strcmp(key, "interval") == 0) {
+        if (cpu_budget != 0) { return "the interval is adapted to cpu.budget"; }
+        const unsigned long new_interval = control_duration(value);
+        if (new_interval == ULONG_MAX) { return "bad interval"; }
+        interval = new_interval;
+        // the next tick is relative to the start of the last one
+        struct timespec t = tick_start;
+        t.tv_sec += interval / 1000000UL;
+        t.tv_nsec += (interval % 1000000UL) * 1000UL;
+        if (t.tv_nsec >= 1000000000L) { t.tv_nsec -= 1000000000L; ++t.tv_sec; }
+        timer_arm(&t);
+    } else if (strcmp(key, "output.flush") == 0) {
+        const unsigned long new_interval = control_duration(value);
+        if (new_interval == ULONG_MAX) { return "bad interval"; }
+        writer_flush_interval = new_interval;
+    } else if (strcmp(key, "watch.interval") == 0) {
+        const unsigned long new_interval = control_duration(value);
+        if (new_interval == ULONG_MAX) { return "bad interval"; }
+        watch_interval = new_interval;
+        // restart the timer with the new interval
+        watch_armed = 0;
+        watch_arm();
+    } else if (strcmp(key, "watch.duration") == 0) {
+        const unsigned long duration = control_duration(value);
+        if (duration == ULONG_MAX) { return "bad interval"; }
+        watch_duration = duration;
+    } else if (strcmp(key, "pressure.interval") == 0) {
+        const unsigned long new_interval = control_duration(value);
+        if (new_interval == ULONG_MAX) { return "bad interval"; }
+        pressure_interval = new_interval;
+    } else if (strcmp(key, "pressure.duration") == 0) {
+        const unsigned long duration = control_duration(value);
+        if (duration == ULONG_MAX) { return "bad interval"; }
+        pressure_duration = duration;
+    } else if (strcmp(key, "smaps.interval") == 0) {
+        const unsigned long duration = control_duration(value);
+        if (duration == ULONG_MAX) { return "bad interval"; }
+        smaps_interval = duration;
+    } else if (strcmp(key, "smaps.budget") == 0) {
+        const unsigned long n = parse_unsigned_long(value, value + strlen(value));
+        if (n == 0 || n == ULONG_MAX) { return "bad number of processes"; }
+        smaps_budget = n;
+    } else if (strcmp(key, "numa.interval") == 0) {
+        const unsigned long duration = control_duration(value);
+        if (duration == ULONG_MAX) { return "bad interval"; }
+        numa_interval = duration;
+    } else if (strcmp(key, "numa.budget") == 0) {
+        const unsigned long duration = control_duration(value);
+        if (duration == ULONG_MAX) { return "bad interval"; }
+        numa_budget = duration;
+    } else if (strcmp(key, "process.output") == 0) {
+        if (control_output(&process_output, value) == -1) { return "failed to open the file"; }
+    } else if (strcmp(key, "system.output") == 0) {
+        if (system_out == &process_output) {
+            // the outputs no longer share the file
+            output_flush(&system_buffer);
+            system_out = &system_output;
+        }
+        if (control_output(&system_output, value) == -1) { return "failed to open the file"; }
+    } else if (strcmp(key, "event.output") == 0) {
+        if (control_output(&event_output, value) == -1) { return "failed to open the file"; }
+        event_file = 1;
+    } else {
+        return "bad key";
+    }
+    return NULL;
+}
+
+static const char*
+control_burst(char** words, int nwords) {
+    if (nwords == 3 && strcmp(words[1], "node") == 0) {
+        const unsigned long duration = control_duration(words[2]);
+        if (duration == ULONG_MAX) { return "bad duration"; }
+        burst_start("control", pressure_interval, duration);
+        return NULL;
+    }
+    if (nwords != 4 || strcmp(words[1], "pid") != 0) { return "bad command"; }
+    const unsigned long duration = control_duration(words[3]);
+    if (duration == ULONG_MAX) { return "bad duration"; }
+    if (!is_number(words[2])) { return "bad pid"; }
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%s/stat", words[2]);
+    char line[4096];
+    ssize_t n = read_line_at(AT_FDCWD, path, line, sizeof(line)-1);
+    if (n == -1) { return "no such process"; }
+    line[n] = 0;
+    step_type s;
+    char command[17];
+    if (parse_stat(line, &s, command) < 22) { return "no such process"; }
+    if (watch_add(s.process_id, s.start_time, NULL, NULL, monotonic_now() + duration) == -1) {
+        return "too many watches";
+    }
+    watch_arm();
+    return NULL;
+}
+
+/* Execute the command and write the reply, the command is modified. */
+static size_t
+control_execute(char* command, char* reply, size_t n) {
+    char* words[4];
+    int nwords = 0;
+    for (char* word = strtok(command, " \t\r\n"); word != NULL; word = strtok(NULL, " \t\r\n")) {
+        if (nwords == 4) { nwords = 0; break; }
+        words[nwords++] = word;
+    }
+    const char* error = "bad command";
+    if (nwords == 1 && strcmp(words[0], "stats") == 0) {
+        return format_statistics(reply, n);
+    } else if (nwords == 3 && strcmp(words[0], "set") == 0) {
+        error = control_set(words[1], words[2]);
+    } else if (nwords >= 3 && strcmp(words[0], "burst") == 0) {
+        error = control_burst(words, nwords);
+    }
+    int ret = error == NULL
+        ? snprintf(reply, n, "ok\n")
+        : snprintf(reply, n, "error: %s\n", error);
+    if (ret < 0) { return 0; }
+    return (size_t)ret < n ? (size_t)ret : n-1;
+}
+
+static void
+on_control_client(event_source_type* source, uint32_t events) {
+    control_client_type* c = (control_client_type*)source;
+    while (1) {
+        ssize_t n = read(source->fd, c->command + c->size, sizeof(c->command) - 1 - c->size);
+        if (n == -1) {
+            if (errno == EINTR) { continue; }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) { return; }
+            event_loop_remove(source);
+            return;
+        }
+        c->size += n;
+        c->command[c->size] = 0;
+        if (n != 0 && memchr(c->command, '\n', c->size) == NULL &&
+            c->size != sizeof(c->command)-1) {
+            continue;
+        }
+        break;
+    }
+    // the whole line, the end of file or the command that is too long
+    char reply[4096];
+    size_t n = control_execute(c->command, reply, sizeof(reply));
+    control_reply(source->fd, reply, n);
+    event_loop_remove(source);
+}
+
+static void
+on_control(event_source_type* source, uint32_t events) {
+    while (1) {
+        int fd = accept4(source->fd, NULL, NULL, SOCK_NONBLOCK|SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno == EINTR) { continue; }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) { perror("accept4"); }
+            return;
+        }
+        control_client_type* c = NULL;
+        for (int i=0; i<CONTROL_MAX_CLIENTS && c == NULL; ++i) {
+            if (control_clients[i].source.fd == -1) { c = control_clients + i; }
+        }
+        if (!control_peer_allowed(fd) || c == NULL) {
+            static const char reply[] = "error: permission denied or too many clients\n";
+            control_reply(fd, reply, sizeof(reply)-1);
+            if (close(fd) == -1) { perror("close"); }
+            continue;
+        }
+        c->size = 0;
+        event_loop_add(&c->source, fd, EPOLLIN, on_control_client);
+    }
+}
+
+static void
+watch_control() {
+    for (int i=0; i<CONTROL_MAX_CLIENTS; ++i) { control_clients[i].source.fd = -1; }
+    if (control_path[0] == 0) { return; }
+    int fd = control_listen(control_path);
+    if (fd == -1) { exit(1); }
+    event_loop_add(&control_source, fd, EPOLLIN, on_control);
 }
 
 static void
-stop(int signal) {
-    running = 0;
+reap_children() {
+    if (child_pid > 0 && !child_waited && running) {
+        siginfo_t info;
+        info.si_pid = 0;
+        if (waitid(P_PID, (id_t)child_pid, &info, WEXITED|WNOHANG|WNOWAIT) == -1) {
+            if (errno != ECHILD) { perror("waitid"); }
+        } else if (info.si_pid == child_pid) {
+            // record the final state of the process tree while the command
+            // is not reaped yet and its /proc/<pid> still exists, and stop
+            tick();
+            running = 0;
+        }
+    }
+    int ret = 0;
+    int status = 0;
+    while ((ret = waitpid(-1, &status, WNOHANG)) > 0) {
+        if (ret == child_pid) {
+            child_status = status;
+            child_waited = 1;
+        }
+    }
+    if (ret == -1 && errno != ECHILD) { perror("waitpid"); }
+    if (child_waited) { running = 0; }
+}
+
+static void
+on_signal(event_source_type* source, uint32_t events) {
+    struct signalfd_siginfo info;
+    while (read(source->fd, &info, sizeof(info)) == sizeof(info)) {
+        if (info.ssi_signo == SIGCHLD) {
+            reap_children();
+        } else if (info.ssi_signo == SIGHUP) {
+            // the files were rotated by an external program
+            atomic_store(&process_output.reopen, 1);
+            atomic_store(&system_output.reopen, 1);
+            atomic_store(&event_output.reopen, 1);
+            for (int i=0; i<num_tiers; ++i) { atomic_store(&tiers[i].output.reopen, 1); }
+        } else if (info.ssi_signo == SIGUSR1) {
+            char statistics[4096];
+            fwrite(statistics, 1, format_statistics(statistics, sizeof(statistics)), stderr);
+        } else if (info.ssi_signo == SIGUSR2) {
+            // reserved, blocked only to not terminate the daemon by default
+        } else {
+            running = 0;
+        }
+    }
+}
+
+static void
+on_child_exit(event_source_type* source, uint32_t events) {
+    reap_children();
+    event_loop_remove(source);
+}
+
+static void
+event_loop_init() {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd == -1) { perror("epoll_create1"); exit(1); }
+    int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+    if (timer_fd == -1) { perror("timerfd_create"); exit(1); }
+    event_loop_add(&timer_source, timer_fd, EPOLLIN, on_timer);
+    // the watch timer is armed only when something is watched
+    int watch_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+    if (watch_fd == -1) { perror("timerfd_create"); exit(1); }
+    event_loop_add(&watch_source, watch_fd, EPOLLIN, on_watch);
+    // the burst timer is armed by the pressure triggers and the control socket
+    int burst_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+    if (burst_fd == -1) { perror("timerfd_create"); exit(1); }
+    event_loop_add(&burst_source, burst_fd, EPOLLIN, on_burst);
+    // the first tick is immediate
+    struct timespec t = {0, 1};
+    timer_arm(&t);
 }
 
 static void
 signal_handlers() {
-    int signals[] = {SIGINT, SIGTERM, SIGHUP, SIGPIPE, SIGUSR1, SIGUSR2, SIGALRM};
+    int signals[] = {SIGINT, SIGTERM, SIGHUP, SIGPIPE, SIGUSR1, SIGUSR2, SIGALRM, SIGCHLD};
     const int nsignals = sizeof(signals) / sizeof(int);
+    sigset_t mask;
+    sigemptyset(&mask);
     for (int i=0; i<nsignals; ++i) {
-        struct sigaction s = {0};
-        s.sa_handler = stop;
-        if (sigaction(signals[i], &s, NULL) == -1) {
-            perror("failed to install signal handler");
-            exit(1);
+        sigaddset(&mask, signals[i]);
+    }
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) == -1) {
+        perror("failed to block signals");
+        exit(1);
+    }
+    int fd = signalfd(-1, &mask, SFD_NONBLOCK|SFD_CLOEXEC);
+    if (fd == -1) {
+        perror("failed to create signal file descriptor");
+        exit(1);
+    }
+    event_loop_add(&signal_source, fd, EPOLLIN, on_signal);
+}
+
+static void
+unblock_signals() {
+    sigset_t mask;
+    sigfillset(&mask);
+    if (sigprocmask(SIG_UNBLOCK, &mask, NULL) == -1) { perror("sigprocmask"); }
+}
+
+static void
+watch_child() {
+    int fd = (int)syscall(SYS_pidfd_open, child_pid, 0);
+    if (fd == -1) {
+        // SIGCHLD is the fallback on older kernels
+        if (errno != ENOSYS) { perror("pidfd_open"); }
+        return;
+    }
+    event_loop_add(&child_source, fd, EPOLLIN, on_child_exit);
+}
+
+static void
+event_loop() {
+    struct epoll_event events[16];
+    while (running) {
+        int n = epoll_wait(epoll_fd, events, sizeof(events)/sizeof(struct epoll_event), -1);
+        if (n == -1) {
+            if (errno == EINTR) { continue; }
+            perror("epoll_wait");
+            break;
+        }
+        for (int i=0; i<n && running; ++i) {
+            event_source_type* source = (event_source_type*)events[i].data.ptr;
+            source->callback(source, events[i].events);
         }
     }
 }
 
 int main(int argc, char* argv[]) {
+    int main_ret = 0;
+    event_loop_init();
     signal_handlers();
     setlinebuf(stdout);
     parse_options(argc, argv);
+    if (segment_directory[0] != 0) {
+        // timestamp and pid are always stored to prune the blocks
+        const char* timestamp = "timestamp";
+        const char* pid = "pid";
+        segment_add_column(find_field(timestamp, timestamp + strlen(timestamp)));
+        segment_add_column(find_field(pid, pid + strlen(pid)));
+        for (int i=0; i<num_process_fields; ++i) {
+            segment_add_column(step_fields + process_fields[i]);
+        }
+    }
+    if (stream_enabled) {
+        for (int i=0; i<num_process_fields; ++i) {
+            stream_add_column(step_fields + process_fields[i]);
+        }
+        stream_start();
+    }
+    // process, system and event outputs, the tiers and the segments
+    writer_start(3 + num_tiers + (segment_directory[0] != 0));
+    if (num_tiers != 0 && tier_group == NULL) {
+        const char* pid = "pid";
+        tier_group = find_field(pid, pid + strlen(pid));
+    }
+    tier_start();
+    watch_pressure();
+    watch_control();
+    if (syslog_system_fields != 0 || syslog_process || syslog_summary || syslog_events) {
+        syslog_open(syslog_path);
+    }
     #if defined(LOCKSTEP_WITH_NVML)
     nvmlReturn_t result;
     result = nvmlInit();
@@ -1169,52 +2892,27 @@ int main(int argc, char* argv[]) {
     }
     #endif
     if (child_argv != 0) {
+        // adopt orphaned descendants of the command
+        if (prctl(PR_SET_CHILD_SUBREAPER, 1) == -1) { perror("prctl"); }
         child_pid = fork();
         if (child_pid == -1) { perror("fork"); exit(1); }
         if (child_pid == 0) {
+            unblock_signals();
             if (execvp(child_argv[0], child_argv) == -1) {
                 fprintf(stderr, "failed to execute %s\n", child_argv[0]);
                 exit(1);
             }
         }
+        watch_child();
     }
-    int status = 0;
-    int waited = 0;
-    int main_ret = 0;
-    const unsigned long syslog_interval_multiple = syslog_interval / interval;
-    unsigned long syslog_interval_multiple_count = 0;
-    while (running) {
-        time_t timestamp = time(NULL);
-        if (num_process_fields != 0) { collect_proc(timestamp); }
-        if ((system_fields | syslog_system_fields) & SYSTEM_HWMON) { collect_hwmon(timestamp); }
-        if ((system_fields | syslog_system_fields) & SYSTEM_DRM) { collect_drm(timestamp); }
-        if ((system_fields | syslog_system_fields) & SYSTEM_THERMAL) { collect_thermal(timestamp); }
-        if (child_pid != 0) {
-            int ret = waitpid(child_pid, &status, WNOHANG);
-            if (ret == -1) { perror("waitpid"); }
-            if (ret == child_pid) {
-                running = 0;
-                waited = 1;
-                if (WIFEXITED(status)) { main_ret = WEXITSTATUS(status); }
-                else if (WIFSIGNALED(status)) { main_ret = WTERMSIG(status); }
-            }
-        }
-        struct timespec t;
-        t.tv_sec = interval / 1000000UL;
-        t.tv_nsec = (interval % 1000000UL) * 1000UL;
-        //if (nanosleep(&t, 0) == -1 && errno != EINTR) { perror("nanosleep"); }
-        if (clock_nanosleep(CLOCK_MONOTONIC, 0, &t, 0) == -1 && errno != EINTR) { perror("clock_nanosleep"); }
-        ++syslog_interval_multiple_count;
-        if (syslog_interval_multiple_count == syslog_interval_multiple) {
-            enable_syslog = 1;
-            syslog_interval_multiple_count = 0;
-        } else {
-            enable_syslog = 0;
-        }
-    }
-    if (child_pid != 0 && !waited) {
+    event_loop();
+    if (child_pid != 0 && !child_waited) {
         if (kill(child_pid, SIGTERM) == -1 && errno != ESRCH) { perror("kill"); }
-        if (waitpid(child_pid, &status, 0) == -1) { perror("waitpid"); }
+        if (waitpid(child_pid, &child_status, 0) == -1) { perror("waitpid"); }
+    }
+    if (child_pid != 0) {
+        if (WIFEXITED(child_status)) { main_ret = WEXITSTATUS(child_status); }
+        else if (WIFSIGNALED(child_status)) { main_ret = WTERMSIG(child_status); }
     }
     #if defined(LOCKSTEP_WITH_NVML)
 nvml_shutdown:
@@ -1224,11 +2922,35 @@ nvml_shutdown:
         return 1;
     }
     #endif
-    if (process_out_fd > 2) {
-        if (close(process_out_fd) == -1) { perror("close"); }
-    }
-    if (system_out_fd > 2) {
-        if (close(system_out_fd) == -1) { perror("close"); }
+    tier_stop();
+    flush_outputs(1);
+    segment_close();
+    stream_stop();
+    if (segment_dropped_blocks != 0) {
+        fprintf(stderr, "dropped %lu segment blocks\n", segment_dropped_blocks);
+    }
+    syslog_close();
+    pressure_close();
+    if (control_source.fd != -1 && unlink(control_path) == -1) { perror("unlink"); }
+    system_files_close();
+    numa_close();
+    if (watch_dropped != 0) {
+        fprintf(stderr, "dropped %lu watches\n", watch_dropped);
+    }
+    output_type* outputs[3 + MAX_TIERS] = {&process_output, &system_output, &event_output};
+    for (int i=0; i<num_tiers; ++i) { outputs[3+i] = &tiers[i].output; }
+    writer_stop(outputs, 3 + num_tiers);
+    for (int i=0; i<num_tiers; ++i) {
+        if (close(tiers[i].output.fd) == -1) { perror("close"); }
+    }
+    if (process_output.fd > 2) {
+        if (close(process_output.fd) == -1) { perror("close"); }
+    }
+    if (system_output.fd > 2) {
+        if (close(system_output.fd) == -1) { perror("close"); }
+    }
+    if (event_output.fd > 2) {
+        if (close(event_output.fd) == -1) { perror("close"); }
     }
     return main_ret;
 }
@@ -0,0 +1,250 @@
+/*
+Lockstep — log resources consumed by userland Linux processes.
+© 2026 Ivan Gankevich
+
+This file is part of Lockstep.
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef NUMA_STEP_H
+#define NUMA_STEP_H
+
+#include <sys/types.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <intern.h>
+#include <parse.h>
+#include <process_table.h>
+#include <step.h>
+
+/*
+The placement of the memory of the processes on NUMA nodes. numa_node is
+the node of the processor the process last ran on and is cheap. numa_memory
+(the resident bytes per node) and numa_local_percent come from
+/proc/<pid>/numa_maps that has one line per mapping and takes the kernel
+long to produce for large processes. It is read at most once per
+numa_interval, only for the processes with at least numa_min_rss resident
+bytes and only until numa_budget microseconds were spent on the tick. The
+processes are rotated like in smaps_step.h: when the budget runs out,
+the next tick reads only the processes whose values are at least as old
+as the newest skipped one. numa_age tells how old the carried values are.
+
+The system field numa writes one record per node with the counters from
+/sys/devices/system/node/node<N>/meminfo and numastat.
+*/
+
+typedef struct {
+    int number;
+    int meminfo_fd;
+    int numastat_fd;
+} numa_node_type;
+
+// in microseconds
+static uint64_t numa_interval = 60000000UL;
+static uint64_t numa_budget = 2000UL;
+static size_t numa_min_rss = 64UL*1024UL*1024UL;
+static int64_t numa_budget_left = 0;
+// only the due processes read no later than this are read on this tick
+static uint64_t numa_threshold = UINT64_MAX;
+static uint64_t numa_next_threshold = UINT64_MAX;
+static int numa_initialized = 0;
+static numa_node_type* numa_nodes = NULL;
+static int numa_num_nodes = 0;
+// the node of every CPU
+static int* numa_cpu_nodes = NULL;
+static int numa_num_cpus = 0;
+static long numa_page_size = 4096;
+static char numa_buffer[4096*16];
+
+/* Mark the CPUs from the list (e.g. 0-15,32-47) as belonging to the node. */
+static void
+numa_set_cpu_list(const char* first, int node) {
+    while (*first != 0 && *first != '\n') {
+        char* last = NULL;
+        const long cpu_first = strtol(first, &last, 10);
+        if (last == first) { break; }
+        long cpu_last = cpu_first;
+        if (*last == '-') {
+            first = last+1;
+            cpu_last = strtol(first, &last, 10);
+            if (last == first) { break; }
+        }
+        for (long cpu=cpu_first; cpu<=cpu_last && cpu<numa_num_cpus; ++cpu) {
+            numa_cpu_nodes[cpu] = node;
+        }
+        first = *last == ',' ? last+1 : last;
+    }
+}
+
+static int
+numa_compare_nodes(const void* a, const void* b) {
+    const int x = ((const numa_node_type*)a)->number;
+    const int y = ((const numa_node_type*)b)->number;
+    return (x > y) - (x < y);
+}
+
+/* Find the nodes and their CPUs. Without NUMA every CPU is on node zero. */
+static void
+numa_init() {
+    if (numa_initialized) { return; }
+    numa_initialized = 1;
+    const long page_size = sysconf(_SC_PAGESIZE);
+    if (page_size > 0) { numa_page_size = page_size; }
+    const long ncpus = sysconf(_SC_NPROCESSORS_CONF);
+    numa_num_cpus = ncpus > 0 ? (int)ncpus : 1;
+    numa_cpu_nodes = calloc(numa_num_cpus, sizeof(int));
+    if (numa_cpu_nodes == NULL) { perror("calloc"); exit(1); }
+    DIR* dir = opendir("/sys/devices/system/node");
+    if (dir == NULL) { return; }
+    int dir_fd = dirfd(dir);
+    int capacity = 0;
+    for (struct dirent* entry = readdir(dir); entry != NULL; entry = readdir(dir)) {
+        const char* number = entry->d_name + 4;
+        if (strncmp(entry->d_name, "node", 4) != 0 || *number < '0' || *number > '9') { continue; }
+        char path[sizeof(entry->d_name) + 16];
+        snprintf(path, sizeof(path), "%s/cpulist", entry->d_name);
+        int fd = openat(dir_fd, path, O_RDONLY|O_CLOEXEC);
+        if (fd == -1) { continue; }
+        char cpus[4096];
+        ssize_t n = read(fd, cpus, sizeof(cpus)-1);
+        if (close(fd) == -1) { perror("close"); }
+        if (n == -1) { continue; }
+        cpus[n] = 0;
+        const int node = atoi(number);
+        numa_set_cpu_list(cpus, node);
+        if (numa_num_nodes == capacity) {
+            capacity = capacity == 0 ? 4 : 2*capacity;
+            numa_nodes = realloc(numa_nodes, capacity*sizeof(numa_node_type));
+            if (numa_nodes == NULL) { perror("realloc"); exit(1); }
+        }
+        numa_node_type* nd = numa_nodes + numa_num_nodes++;
+        nd->number = node;
+        snprintf(path, sizeof(path), "%s/meminfo", entry->d_name);
+        nd->meminfo_fd = openat(dir_fd, path, O_RDONLY|O_CLOEXEC);
+        snprintf(path, sizeof(path), "%s/numastat", entry->d_name);
+        nd->numastat_fd = openat(dir_fd, path, O_RDONLY|O_CLOEXEC);
+    }
+    if (closedir(dir) == -1) { perror("closedir"); }
+    qsort(numa_nodes, numa_num_nodes, sizeof(numa_node_type), numa_compare_nodes);
+}
+
+static void
+numa_close() {
+    for (int i=0; i<numa_num_nodes; ++i) {
+        if (numa_nodes[i].meminfo_fd != -1) { close(numa_nodes[i].meminfo_fd); }
+        if (numa_nodes[i].numastat_fd != -1) { close(numa_nodes[i].numastat_fd); }
+    }
+    free(numa_nodes);
+    free(numa_cpu_nodes);
+    numa_nodes = NULL;
+    numa_num_nodes = 0;
+    numa_cpu_nodes = NULL;
+    numa_initialized = 0;
+}
+
+static void
+numa_tick_begin() {
+    numa_init();
+    numa_threshold = numa_next_threshold;
+    numa_next_threshold = UINT64_MAX;
+    numa_budget_left = (int64_t)numa_budget;
+}
+
+static void
+read_numa_maps(int process_dir_fd, process_state_type* p, uint64_t now) {
+    p->numa_time = now;
+    int fd = openat(process_dir_fd, "numa_maps", O_RDONLY|O_CLOEXEC);
+    // kernel threads and the processes of other users without the privileges
+    if (fd == -1) { return; }
+    unsigned long long bytes[MAX_NUMA_NODES] = {0};
+    size_t size = 0;
+    ssize_t n = 0;
+    while ((n = read(fd, numa_buffer + size, sizeof(numa_buffer) - size)) > 0) {
+        const char* last = numa_buffer + size + n;
+        const char* rest = parse_numa_maps(numa_buffer, last, bytes);
+        size = last - rest;
+        // the line does not fit into the buffer
+        if (size == sizeof(numa_buffer)) { size = 0; }
+        memmove(numa_buffer, rest, size);
+    }
+    close(fd);
+    if (n == -1) { return; }
+    memcpy(p->numa_bytes, bytes, sizeof(bytes));
+    char* first = numa_buffer;
+    char* last = numa_buffer + sizeof(numa_buffer);
+    for (int i=0; i<MAX_NUMA_NODES; ++i) {
+        if (bytes[i] == 0) { continue; }
+        first += snprintf(first, last-first, "%sN%d=%llu", first == numa_buffer ? "" : ",",
+                          i, bytes[i]);
+    }
+    p->numa_memory = intern_string(numa_buffer, first - numa_buffer);
+    p->numa_read_time = now;
+}
+
+static inline uint64_t
+numa_now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec*1000000UL + t.tv_nsec/1000UL;
+}
+
+/* Read numa_maps if it is due and the budget allows, otherwise carry the values forward. */
+static void
+collect_numa(int process_dir_fd, process_state_type* p, int regular_tick, uint64_t now,
+             step_type* s) {
+    numa_step_t* numa = &s->numa;
+    numa->node = s->processor >= 0 && s->processor < numa_num_cpus ?
+        numa_cpu_nodes[s->processor] : -1;
+    const size_t rss = (size_t)s->resident_set_size*(size_t)numa_page_size;
+    if (regular_tick && rss >= numa_min_rss &&
+        (p->numa_time == 0 || now - p->numa_time >= numa_interval)) {
+        if (numa_budget_left > 0 && p->numa_time <= numa_threshold) {
+            const uint64_t start = numa_now();
+            read_numa_maps(process_dir_fd, p, now);
+            numa_budget_left -= (int64_t)(numa_now() - start);
+        } else if (numa_next_threshold == UINT64_MAX || p->numa_time > numa_next_threshold) {
+            numa_next_threshold = p->numa_time;
+        }
+    }
+    intern_touch(p->numa_memory);
+    numa->memory = p->numa_memory;
+    unsigned long long total = 0;
+    for (int i=0; i<MAX_NUMA_NODES; ++i) { total += p->numa_bytes[i]; }
+    numa->local_percent = total == 0 || numa->node < 0 || numa->node >= MAX_NUMA_NODES ? 0 :
+        100.0*((double)p->numa_bytes[numa->node])/((double)total);
+    numa->age = p->numa_read_time == 0 ? -1 : (long)(now - p->numa_read_time);
+}
+
+#endif // vim:filetype=c
@@ -33,53 +33,132 @@ For more information, please refer to <http://unlicense.org/>
 #ifndef NVML_STEP_H
 #define NVML_STEP_H
 
+#include <sys/types.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include <nvml.h>
 
+#include <step.h>
+
 typedef unsigned int nvml_pid_t;
 
+static nvmlDevice_t nvml_devices[4096 / sizeof(nvmlDevice_t)];
+static unsigned int nvml_device_count = 0;
+
+/*
+The accounting statistics of all devices are queried once per tick
+with nvmlDeviceGetAccountingPids and are stored in the pid hash table,
+the processes look up their statistics in the table. Most of the processes
+do not use GPUs and do not cost any NVML calls.
+*/
+
 typedef struct {
-    unsigned int gpu_utilisation;
-    unsigned int memory_utilization;
-    unsigned long long max_memory_usage;
-    unsigned long long time_ms;
-} nvml_step_t;
+	nvml_pid_t pid;
+	nvml_step_t step;
+} nvml_entry_type;
 
-nvmlDevice_t nvml_devices[4096 / sizeof(nvmlDevice_t)];
-unsigned int nvml_device_count = 0;
+// open addressing, pid zero is an empty slot
+static nvml_entry_type* nvml_table = NULL;
+static unsigned int nvml_table_capacity = 0;
+static unsigned int nvml_table_size = 0;
+static unsigned int* nvml_pids = NULL;
+static unsigned int nvml_pids_capacity = 0;
+
+static inline unsigned int
+nvml_hash(nvml_pid_t pid) {
+	return pid*2654435761U;
+}
+
+static nvml_entry_type*
+nvml_table_find(nvml_pid_t pid) {
+	const unsigned int mask = nvml_table_capacity-1;
+	unsigned int i = nvml_hash(pid) & mask;
+	while (nvml_table[i].pid != 0 && nvml_table[i].pid != pid) { i = (i+1) & mask; }
+	return nvml_table + i;
+}
+
+static void
+nvml_table_reserve(unsigned int n) {
+	if (2*n <= nvml_table_capacity) { return; }
+	nvml_entry_type* old_table = nvml_table;
+	const unsigned int old_capacity = nvml_table_capacity;
+	if (nvml_table_capacity == 0) { nvml_table_capacity = 64; }
+	while (2*n > nvml_table_capacity) { nvml_table_capacity *= 2; }
+	nvml_table = calloc(nvml_table_capacity, sizeof(nvml_entry_type));
+	if (nvml_table == NULL) { perror("calloc"); exit(1); }
+	for (unsigned int i=0; i<old_capacity; ++i) {
+		if (old_table[i].pid != 0) { *nvml_table_find(old_table[i].pid) = old_table[i]; }
+	}
+	free(old_table);
+}
 
 static int
-collect_nvml(pid_t pid, nvml_step_t* nvml) {
-	int ret = 0;
-	nvmlDevice_t* first = nvml_devices;
-	nvmlDevice_t* last = first + nvml_device_count;
-    nvmlReturn_t result;
+nvml_collect_pids(nvmlDevice_t device, unsigned int* count) {
+	nvmlReturn_t result;
+	while (1) {
+		*count = nvml_pids_capacity;
+		result = nvmlDeviceGetAccountingPids(device, count, nvml_pids);
+		if (result != NVML_ERROR_INSUFFICIENT_SIZE) { break; }
+		nvml_pids_capacity = *count == 0 ? 64 : 2*(*count);
+		nvml_pids = realloc(nvml_pids, nvml_pids_capacity*sizeof(unsigned int));
+		if (nvml_pids == NULL) { perror("realloc"); exit(1); }
+	}
+	if (result != NVML_SUCCESS) {
+		fprintf(stderr, "failed to get nvml accounting pids: %s\n", nvmlErrorString(result));
+		return -1;
+	}
+	return 0;
+}
+
+/* Query the statistics of all devices. Called once per tick. */
+static int
+nvml_collect_accounting() {
+	if (nvml_table_size != 0) {
+		memset(nvml_table, 0, nvml_table_capacity*sizeof(nvml_entry_type));
+		nvml_table_size = 0;
+	}
+	nvmlReturn_t result;
 	nvmlAccountingStats_t stats;
-	int first_update = 1;
-	while (first != last) {
-		result = nvmlDeviceGetAccountingStats(*first, pid, &stats);
-		switch (result) {
-			case NVML_SUCCESS:
-				if (first_update) {
-					memset(nvml, 0, sizeof(nvml_step_t));
-					first_update = 0;
-				}
-				nvml->gpu_utilisation += stats.gpuUtilization;
-				nvml->memory_utilization += stats.memoryUtilization;
-				nvml->max_memory_usage += stats.maxMemoryUsage;
-				nvml->time_ms += stats.time;
-				break;
-			case NVML_ERROR_NOT_FOUND:
-				if (first_update) {
-					memset(nvml, 0, sizeof(nvml_step_t));
-				}
-				break;
-			default:
+	for (unsigned int i=0; i<nvml_device_count; ++i) {
+		unsigned int count = 0;
+		if (nvml_collect_pids(nvml_devices[i], &count) == -1) { return -1; }
+		nvml_table_reserve(nvml_table_size + count);
+		for (unsigned int j=0; j<count; ++j) {
+			const nvml_pid_t pid = nvml_pids[j];
+			result = nvmlDeviceGetAccountingStats(nvml_devices[i], pid, &stats);
+			if (result == NVML_ERROR_NOT_FOUND) { continue; }
+			if (result != NVML_SUCCESS) {
 				fprintf(stderr, "failed to get nvml pid stats: %s\n", nvmlErrorString(result));
 				return -1;
+			}
+			nvml_entry_type* entry = nvml_table_find(pid);
+			if (entry->pid == 0) {
+				entry->pid = pid;
+				++nvml_table_size;
+			}
+			entry->step.gpu_utilisation += stats.gpuUtilization;
+			entry->step.memory_utilization += stats.memoryUtilization;
+			entry->step.max_memory_usage += stats.maxMemoryUsage;
+			entry->step.time_ms += stats.time;
+		}
+	}
+	return 0;
+}
+
+static int
+collect_nvml(pid_t pid, nvml_step_t* nvml) {
+	if (nvml_table_size != 0) {
+		const nvml_entry_type* entry = nvml_table_find((nvml_pid_t)pid);
+		if (entry->pid != 0) {
+			*nvml = entry->step;
+			return 0;
 		}
-		++first;
 	}
-	return ret;
+	memset(nvml, 0, sizeof(nvml_step_t));
+	return 0;
 }
 
 #endif // vim:filetype=c
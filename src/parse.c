@@ -0,0 +1,564 @@
+/*
+Lockstep — log resources consumed by userland Linux processes.
+© 2026 Ivan Gankevich
+
+This file is part of Lockstep.
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+
+#include <ctype.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+
+#include <format.h>
+#include <parse.h>
+
+#define STAT_FORMAT \
+        "%d (%16[^)]) %c %d %d %d %d %d %u %lu %lu %lu %lu %lu %lu %ld %ld %d %d %d " \
+        "%d %llu %lu %ld %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %d %d " \
+        "%u %u %llu %lu %ld %lu %lu %lu %lu %lu %lu %lu %d"
+
+#define UPTIME_FORMAT "%lf %lf"
+
+#define NETSTAT_FORMAT "IpExt: %*u %*u %*u %*u %*u %*u %lu %lu %*u %*u %*u %*u %*u %*u %*u %*u %*u"
+
+#define PRESSURE_FORMAT "avg10=%lf avg60=%lf avg300=%lf total=%llu"
+
+#define SCHEDSTAT_FORMAT "%llu %llu %llu"
+
+#define IO_FORMAT "rchar: %*u\nwchar: %*u\nsyscr: %*u\nsyscw: %*u\nread_bytes: %lu\nwrite_bytes: %lu\ncancelled_write_bytes: %lu"
+
+int
+compare_chars(const char* first, const char* last, const char* str) {
+    const size_t n1 = last-first;
+    const size_t n2 = strlen(str);
+    if (n1 != n2) { return -1; }
+    return strncmp(first, str, n1);
+}
+
+static const char*
+find_newline(const char* first, const char* last) {
+    while (first != last) {
+        if (*first++ == '\n') {
+            break;
+        }
+    }
+    return first;
+}
+
+unsigned long
+parse_unsigned_long(const char* first, const char* last) {
+    unsigned long i = 0;
+    unsigned long power = 1;
+    while (first != last) {
+        --last;
+        if (*last < '0' || *last > '9') { perror("parse_unsigned_long"); }
+        unsigned long addon = power * ((*last)-'0');
+        if (ULONG_MAX - addon < i) { return ULONG_MAX; }
+        i += addon;
+        power *= 10;
+    }
+    return i;
+}
+
+unsigned long
+parse_duration(const char* first, const char* last) {
+    const char* suffix_first = last;
+    while (suffix_first != first && !isdigit(*(suffix_first-1))) {
+        --suffix_first;
+    }
+    unsigned long interval = parse_unsigned_long(first, suffix_first);
+    if (compare_chars(suffix_first, last, "d") == 0) { interval *= 24UL*60UL*60UL*1000000UL; }
+    else if (compare_chars(suffix_first, last, "h") == 0) { interval *= 60UL*60UL*1000000UL; }
+    else if (compare_chars(suffix_first, last, "m") == 0) { interval *= 60UL*1000000UL; }
+    else if (compare_chars(suffix_first, last, "s") == 0) { interval *= 1000000UL; }
+    else if (compare_chars(suffix_first, last, "ms") == 0) { interval *= 1000UL; }
+    else if (compare_chars(suffix_first, last, "us") == 0) {}
+    else if (compare_chars(suffix_first, last, "ns") == 0) { interval /= 1000UL; }
+    else { return ULONG_MAX; }
+    if (interval <= 0) {
+        fprintf(stderr, "bad interval %lu\n", interval);
+        exit(1);
+    }
+    return interval;
+}
+
+size_t
+parse_size(const char* first, const char* last) {
+    const char* suffix_first = last;
+    while (suffix_first != first && !isdigit(*(suffix_first-1))) {
+        --suffix_first;
+    }
+    size_t size = parse_unsigned_long(first, suffix_first);
+    if (compare_chars(suffix_first, last, "") == 0) {}
+    else if (compare_chars(suffix_first, last, "k") == 0) { size <<= 10; }
+    else if (compare_chars(suffix_first, last, "M") == 0) { size <<= 20; }
+    else if (compare_chars(suffix_first, last, "G") == 0) { size <<= 30; }
+    else { return 0; }
+    return size;
+}
+
+int
+parse_boolean(const char* first, const char* last) {
+    if (compare_chars(first, last, "yes") == 0 ||
+        compare_chars(first, last, "true") == 0 ||
+        compare_chars(first, last, "1") == 0) { return 1; }
+    if (compare_chars(first, last, "no") == 0 ||
+        compare_chars(first, last, "false") == 0 ||
+        compare_chars(first, last, "0") == 0) { return 0; }
+    return -1;
+}
+
+double
+parse_budget(const char* first, const char* last) {
+    char tmp[64];
+    const size_t n = last-first;
+    if (n == 0 || n >= sizeof(tmp)) { return -1; }
+    memcpy(tmp, first, n);
+    tmp[n] = 0;
+    char* end = 0;
+    double budget = strtod(tmp, &end);
+    if (end == tmp) { return -1; }
+    if (*end == '%') { budget /= 100.0; ++end; }
+    if (*end != 0 || !(budget > 0 && budget <= 1)) { return -1; }
+    return budget;
+}
+
+int
+parse_stat(const char* buf, step_type* s, char* command) {
+    return sscanf(
+        buf,
+        STAT_FORMAT,
+        &s->process_id,
+        command,
+        &s->state,
+        &s->parent_process_id,
+        &s->process_group_id,
+        &s->session_id,
+        &s->tty_number,
+        &s->tty_process_group_id,
+        &s->flags,
+        &s->minor_faults,
+        &s->child_minor_faults,
+        &s->major_faults,
+        &s->child_major_faults,
+        &s->userspace_time,
+        &s->kernel_time,
+        &s->child_userspace_time,
+        &s->child_kernel_time,
+        &s->priority,
+        &s->nice,
+        &s->num_threads,
+        &s->unused,
+        &s->start_time,
+        &s->virtual_memory_size,
+        &s->resident_set_size,
+        &s->resident_set_limit,
+        &s->code_segment_start,
+        &s->code_segment_end,
+        &s->stack_start,
+        &s->stack_pointer,
+        &s->instruction_pointer,
+        &s->signals,
+        &s->blocked_signals,
+        &s->ignored_signal,
+        &s->caught_signal,
+        &s->wait_channel,
+        &s->num_swapped_pages,
+        &s->children_num_swapped_pages,
+        &s->exit_signal,
+        &s->processor,
+        &s->realtime_priority,
+        &s->policy,
+        &s->cumulative_block_input_output_delay,
+        &s->guest_time,
+        &s->child_guest_time,
+        &s->data_start,
+        &s->data_end,
+        &s->brk_start,
+        &s->arg_start,
+        &s->arg_end,
+        &s->env_start,
+        &s->env_end,
+        &s->exit_code
+    );
+}
+
+int
+parse_io(const char* buf, io_step_t* io) {
+    return sscanf(buf, IO_FORMAT, &io->read_bytes, &io->write_bytes,
+                  &io->cancelled_write_bytes);
+}
+
+int
+parse_schedstat(const char* buf, schedstat_step_t* sched) {
+    return sscanf(buf, SCHEDSTAT_FORMAT, &sched->run_time_ns, &sched->run_queue_wait_ns,
+                  &sched->timeslices);
+}
+
+int
+parse_netstat(const char* buf, network_step_t* network) {
+    const char* first = buf;
+    const char* last = buf + strlen(buf);
+    // skip TcpExt header and values and IpExt header
+    for (int i=0; i<3; ++i) {
+        first = find_newline(first, last);
+    }
+    if (first == last) { return -1; }
+    return sscanf(first, NETSTAT_FORMAT, &network->in_octets, &network->out_octets);
+}
+
+int
+parse_uptime(const char* buf, double* uptime, double* idle_time) {
+    return sscanf(buf, UPTIME_FORMAT, uptime, idle_time);
+}
+
+int
+parse_pressure(const char* buf, pressure_step_t* some, pressure_step_t* full) {
+    memset(some, 0, sizeof(pressure_step_t));
+    memset(full, 0, sizeof(pressure_step_t));
+    int n = 0;
+    const char* first = buf;
+    while (*first != 0) {
+        pressure_step_t* p = NULL;
+        if (strncmp(first, "some ", 5) == 0) { p = some; }
+        else if (strncmp(first, "full ", 5) == 0) { p = full; }
+        if (p != NULL) {
+            n += sscanf(first+5, PRESSURE_FORMAT, &p->avg10, &p->avg60, &p->avg300, &p->total);
+        }
+        const char* newline = strchr(first, '\n');
+        if (newline == NULL) { break; }
+        first = newline+1;
+    }
+    return n;
+}
+
+static inline const char*
+skip_spaces(const char* first, const char* last) {
+    while (first != last && (*first == ' ' || *first == '\t')) { ++first; }
+    return first;
+}
+
+/* Returns the pointer past the digits or NULL if there are none. */
+static inline const char*
+parse_counter(const char* first, const char* last, unsigned long long* x) {
+    const char* digits = first;
+    unsigned long long result = 0;
+    while (first != last && (unsigned)(*first - '0') < 10u) {
+        result = result*10ULL + (unsigned long long)(*first - '0');
+        ++first;
+    }
+    *x = result;
+    return first == digits ? NULL : first;
+}
+
+/* Parse at most max_values counters up to the end of the line. */
+static const char*
+parse_counters(const char* first, const char* last, counters_step_t* c, int max_values) {
+    while (first != last && *first != '\n' && c->nvalues != max_values) {
+        first = skip_spaces(first, last);
+        const char* next = parse_counter(first, last, c->values + c->nvalues);
+        if (next == NULL) { break; }
+        ++c->nvalues;
+        first = next;
+    }
+    return find_newline(first, last);
+}
+
+/* Copy the characters up to the space or the delimiter, returns NULL if the name is too long. */
+static const char*
+parse_name(const char* first, const char* last, char delimiter, char* name, size_t size) {
+    const char* name_first = first;
+    while (first != last && *first != ' ' && *first != '\n' && *first != delimiter) { ++first; }
+    const size_t n = first - name_first;
+    if (n >= size) { return NULL; }
+    memcpy(name, name_first, n);
+    name[n] = 0;
+    return first;
+}
+
+const char*
+parse_cpu_line(const char* first, const char* last, counters_step_t* c) {
+    c->nvalues = 0;
+    if (last-first < 3 || strncmp(first, "cpu", 3) != 0) { return find_newline(first, last); }
+    const char* next = parse_name(first, last, ' ', c->name, sizeof(c->name));
+    if (next == NULL) { return find_newline(first, last); }
+    return parse_counters(next, last, c, 10);
+}
+
+const char*
+parse_diskstats_line(const char* first, const char* last, counters_step_t* c) {
+    c->nvalues = 0;
+    unsigned long long major = 0, minor = 0;
+    const char* next = parse_counter(skip_spaces(first, last), last, &major);
+    if (next != NULL) { next = parse_counter(skip_spaces(next, last), last, &minor); }
+    if (next != NULL) { next = parse_name(skip_spaces(next, last), last, ' ', c->name, sizeof(c->name)); }
+    if (next == NULL) { return find_newline(first, last); }
+    // newer kernels append discard and flush statistics
+    return parse_counters(next, last, c, 11);
+}
+
+const char*
+parse_netdev_line(const char* first, const char* last, counters_step_t* c) {
+    c->nvalues = 0;
+    first = skip_spaces(first, last);
+    const char* next = parse_name(first, last, ':', c->name, sizeof(c->name));
+    // the header lines have no colon after the name
+    if (next == NULL || next == last || *next != ':') { return find_newline(first, last); }
+    return parse_counters(next+1, last, c, 16);
+}
+
+#define KEY(name) {name, sizeof(name)-1}
+
+typedef struct {
+    const char* name;
+    size_t size;
+} key_type;
+
+static const key_type meminfo_keys[] = {
+    KEY("MemTotal"), KEY("MemFree"), KEY("MemAvailable"),
+    KEY("Buffers"), KEY("Cached"), KEY("SwapCached"),
+    KEY("Active"), KEY("Inactive"), KEY("SwapTotal"),
+    KEY("SwapFree"), KEY("Dirty"), KEY("Writeback"),
+    KEY("AnonPages"), KEY("Mapped"), KEY("Shmem"),
+    KEY("Slab"),
+};
+
+static const key_type node_meminfo_keys[] = {
+    KEY("MemTotal"), KEY("MemFree"), KEY("MemUsed"), KEY("Active"), KEY("Inactive"),
+    KEY("Dirty"), KEY("FilePages"), KEY("AnonPages"), KEY("Shmem"), KEY("Slab"),
+};
+
+static const key_type numastat_keys[] = {
+    KEY("numa_hit"), KEY("numa_miss"), KEY("numa_foreign"),
+    KEY("interleave_hit"), KEY("local_node"), KEY("other_node"),
+};
+
+/*
+Parse "key<delimiter> value" lines into the values in the order of the keys,
+the first skip_words words of every line are skipped. Returns the number of
+parsed keys.
+*/
+static inline int
+parse_keys(const char* first, const char* last, const key_type* keys, int nkeys,
+           char delimiter, int skip_words, unsigned long long* values) {
+    memset(values, 0, nkeys*sizeof(unsigned long long));
+    int n = 0;
+    int key = 0;
+    while (first != last) {
+        for (int i=0; i<skip_words; ++i) {
+            while (first != last && *first != ' ' && *first != '\n') { ++first; }
+            first = skip_spaces(first, last);
+        }
+        const char* end = memchr(first, delimiter, last-first);
+        if (end == NULL) { break; }
+        const size_t size = end-first;
+        // the keys are in the order of the kernel, try the next key first
+        for (int i=0; i<nkeys; ++i) {
+            const int j = (key+i) % nkeys;
+            if (keys[j].size == size && memcmp(first, keys[j].name, size) == 0) {
+                if (parse_counter(skip_spaces(end+1, last), last, values + j) != NULL) { ++n; }
+                key = j+1;
+                break;
+            }
+        }
+        first = find_newline(end, last);
+    }
+    return n;
+}
+
+int
+parse_meminfo(const char* first, const char* last, counters_step_t* c) {
+    const int nkeys = sizeof(meminfo_keys)/sizeof(meminfo_keys[0]);
+    strcpy(c->name, "mem");
+    c->nvalues = nkeys;
+    return parse_keys(first, last, meminfo_keys, nkeys, ':', 0, c->values);
+}
+
+int
+parse_node_meminfo(const char* first, const char* last, counters_step_t* c) {
+    const int nkeys = sizeof(node_meminfo_keys)/sizeof(node_meminfo_keys[0]);
+    c->nvalues = nkeys;
+    return parse_keys(first, last, node_meminfo_keys, nkeys, ':', 2, c->values);
+}
+
+int
+parse_numastat(const char* first, const char* last, counters_step_t* c) {
+    const int nkeys = sizeof(numastat_keys)/sizeof(numastat_keys[0]);
+    if (c->nvalues + nkeys > MAX_COUNTERS) { return 0; }
+    const int n = parse_keys(first, last, numastat_keys, nkeys, ' ', 0, c->values + c->nvalues);
+    c->nvalues += nkeys;
+    return n;
+}
+
+/* Returns the number of the node of N<node>=<pages> or -1. */
+static int
+parse_numa_node(const char* first, const char* last, unsigned long long* pages) {
+    if (last-first < 4 || *first != 'N') { return -1; }
+    unsigned long long node = 0;
+    const char* next = parse_counter(first+1, last, &node);
+    if (next == NULL || next == last || *next != '=' || node >= MAX_NUMA_NODES) { return -1; }
+    if (parse_counter(next+1, last, pages) != last) { return -1; }
+    return (int)node;
+}
+
+const char*
+parse_numa_maps(const char* first, const char* last, unsigned long long* bytes) {
+    while (1) {
+        const char* line_last = memchr(first, '\n', last-first);
+        if (line_last == NULL) { return first; }
+        // the pages on the nodes are followed by their size
+        int nodes[MAX_NUMA_NODES];
+        unsigned long long pages[MAX_NUMA_NODES];
+        int n = 0;
+        unsigned long long page_size = 4;
+        while (first != line_last) {
+            const char* word = first;
+            while (first != line_last && *first != ' ') { ++first; }
+            unsigned long long x = 0;
+            const int node = parse_numa_node(word, first, &x);
+            if (node != -1 && n != MAX_NUMA_NODES) {
+                nodes[n] = node;
+                pages[n] = x;
+                ++n;
+            } else if (first-word > 18 && memcmp(word, "kernelpagesize_kB=", 18) == 0) {
+                parse_counter(word+18, first, &page_size);
+            }
+            first = skip_spaces(first, line_last);
+        }
+        for (int i=0; i<n; ++i) { bytes[nodes[i]] += pages[i]*page_size*1024ULL; }
+        first = line_last+1;
+    }
+}
+
+static inline int
+parse_digits(const char* first, int n) {
+    int result = 0;
+    for (int i=0; i<n; ++i) {
+        if ((unsigned)(first[i] - '0') >= 10u) { return -1; }
+        result = result*10 + (first[i] - '0');
+    }
+    return result;
+}
+
+time_t
+parse_segment_time(const char* first, const char* last) {
+    if (last-first != 16 || first[8] != 'T' || first[15] != 'Z') { return -1; }
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const int year = parse_digits(first, 4);
+    const int month = parse_digits(first+4, 2);
+    tm.tm_mday = parse_digits(first+6, 2);
+    tm.tm_hour = parse_digits(first+9, 2);
+    tm.tm_min = parse_digits(first+11, 2);
+    tm.tm_sec = parse_digits(first+13, 2);
+    if (year == -1 || month == -1 || tm.tm_mday == -1 || tm.tm_hour == -1 ||
+        tm.tm_min == -1 || tm.tm_sec == -1) {
+        return -1;
+    }
+    tm.tm_year = year - 1900;
+    tm.tm_mon = month - 1;
+    return timegm(&tm);
+}
+
+int
+parse_smaps_rollup(const char* first, const char* last, smaps_step_t* smaps) {
+    memset(smaps, 0, sizeof(smaps_step_t));
+    int n = 0;
+    while (first != last) {
+        const char* colon = memchr(first, ':', last-first);
+        if (colon == NULL) { break; }
+        unsigned long long* result = NULL;
+        if (compare_chars(first, colon, "Pss") == 0) { result = &smaps->pss; }
+        else if (compare_chars(first, colon, "Pss_Anon") == 0) { result = &smaps->pss_anon; }
+        else if (compare_chars(first, colon, "Pss_Shmem") == 0) { result = &smaps->pss_shmem; }
+        else if (compare_chars(first, colon, "Private_Clean") == 0) { result = &smaps->uss; }
+        else if (compare_chars(first, colon, "Private_Dirty") == 0) { result = &smaps->uss; }
+        else if (compare_chars(first, colon, "SwapPss") == 0) { result = &smaps->swap_pss; }
+        unsigned long long kilobytes = 0;
+        if (result != NULL &&
+            parse_counter(skip_spaces(colon+1, last), last, &kilobytes) != NULL) {
+            *result += kilobytes*1024ULL;
+            ++n;
+        }
+        first = find_newline(colon, last);
+    }
+    return n;
+}
+
+static inline char*
+append_chars(char* first, char* last, const char* str, size_t n) {
+    if (first == NULL || (size_t)(last-first) < n) { return NULL; }
+    memcpy(first, str, n);
+    return first + n;
+}
+
+char*
+format_hwmon_line(char* first, char* last, time_t timestamp,
+                  const char* device, const char* sensor,
+                  const char* value, size_t value_size,
+                  const char* label, size_t label_size,
+                  const char* name, size_t name_size) {
+    static const char prefix[] = "|/sys/class/hwmon/";
+    first = format_signed(first, last, timestamp);
+    first = append_chars(first, last, prefix, sizeof(prefix)-1);
+    first = append_chars(first, last, device, strlen(device));
+    first = append_chars(first, last, "/", 1);
+    first = append_chars(first, last, sensor, strlen(sensor));
+    first = append_chars(first, last, "|", 1);
+    first = append_chars(first, last, value, value_size);
+    first = append_chars(first, last, "|", 1);
+    first = append_chars(first, last, label, label_size);
+    first = append_chars(first, last, "|", 1);
+    first = append_chars(first, last, name, name_size);
+    first = append_chars(first, last, "\n", 1);
+    return first;
+}
+
+char*
+format_counters_line(char* first, char* last, time_t timestamp, const char* path,
+                     const counters_step_t* c) {
+    first = format_signed(first, last, timestamp);
+    first = append_chars(first, last, "|", 1);
+    first = append_chars(first, last, path, strlen(path));
+    first = append_chars(first, last, "|", 1);
+    first = append_chars(first, last, c->name, strlen(c->name));
+    for (int i=0; i<c->nvalues && first != NULL; ++i) {
+        first = append_chars(first, last, "|", 1);
+        if (first != NULL) { first = format_unsigned(first, last, c->values[i]); }
+    }
+    first = append_chars(first, last, "\n", 1);
+    return first;
+}
@@ -0,0 +1,170 @@
+/*
+Lockstep — log resources consumed by userland Linux processes.
+© 2026 Ivan Gankevich
+
+This file is part of Lockstep.
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef PARSE_H
+#define PARSE_H
+
+#include <sys/types.h>
+
+#include <stddef.h>
+#include <time.h>
+
+#include <step.h>
+
+/*
+Parsers of /proc files, configuration values and the system record
+builders. They do not do any I/O and are compiled into a static library
+that the daemon, the benchmarks and fuzzing targets link with.
+*/
+
+int compare_chars(const char* first, const char* last, const char* str);
+
+/* Parse [first,last) as decimal number, returns ULONG_MAX on overflow. */
+unsigned long parse_unsigned_long(const char* first, const char* last);
+
+/* Parse duration with d, h, m, s, ms, us, ns suffix in microseconds. */
+unsigned long parse_duration(const char* first, const char* last);
+
+/* Parse size with k, M, G suffix in bytes, returns 0 on error. */
+size_t parse_size(const char* first, const char* last);
+
+/* Parse the time of the rotated segment (20201231T235959Z), returns -1 on error. */
+time_t parse_segment_time(const char* first, const char* last);
+
+/* Returns 1 (yes, true, 1), 0 (no, false, 0) or -1. */
+int parse_boolean(const char* first, const char* last);
+
+/* Parse the fraction (0.005) or the percentage (0.5%), returns -1 on error. */
+double parse_budget(const char* first, const char* last);
+
+/*
+Parse NUL-terminated /proc/<pid>/stat. The command (at most 16 characters)
+is copied to command. Returns the number of parsed fields.
+*/
+int parse_stat(const char* buf, step_type* s, char* command);
+
+/* Parse NUL-terminated /proc/<pid>/io. */
+int parse_io(const char* buf, io_step_t* io);
+
+/* Parse NUL-terminated /proc/<pid>/schedstat. */
+int parse_schedstat(const char* buf, schedstat_step_t* sched);
+
+/*
+Parse /proc/<pid>/smaps_rollup: Pss, Pss_Anon, Pss_Shmem, Private_Clean plus
+Private_Dirty (uss) and SwapPss in bytes. Returns the number of parsed keys.
+*/
+int parse_smaps_rollup(const char* first, const char* last, smaps_step_t* smaps);
+
+/* Parse NUL-terminated /proc/<pid>/net/netstat. */
+int parse_netstat(const char* buf, network_step_t* network);
+
+/* Parse NUL-terminated /proc/uptime. */
+int parse_uptime(const char* buf, double* uptime, double* idle_time);
+
+typedef struct {
+    double avg10;
+    double avg60;
+    double avg300;
+    unsigned long long total;
+} pressure_step_t;
+
+/*
+Parse NUL-terminated /proc/pressure/<resource>. The line that is missing
+(full for cpu on older kernels) is zeroed. Returns the number of parsed fields.
+*/
+int parse_pressure(const char* buf, pressure_step_t* some, pressure_step_t* full);
+
+// the maximum number of counters in the line of the system file
+#define MAX_COUNTERS 16
+
+/* The name of the CPU, the device or the interface followed by its counters. */
+typedef struct {
+    char name[32];
+    unsigned long long values[MAX_COUNTERS];
+    int nvalues;
+} counters_step_t;
+
+/*
+Parse the line of /proc/stat (user, nice, system, idle, iowait, irq,
+softirq, steal, guest and guest_nice jiffies of the cpu lines), /proc/diskstats
+(the first 11 statistics of the device) or /proc/net/dev (8 receive and
+8 transmit counters of the interface) from first. Return the pointer to
+the next line. nvalues is zero if the line is not a record.
+*/
+const char* parse_cpu_line(const char* first, const char* last, counters_step_t* c);
+const char* parse_diskstats_line(const char* first, const char* last, counters_step_t* c);
+const char* parse_netdev_line(const char* first, const char* last, counters_step_t* c);
+
+/*
+Parse /proc/meminfo: MemTotal, MemFree, MemAvailable, Buffers, Cached,
+SwapCached, Active, Inactive, SwapTotal, SwapFree, Dirty, Writeback,
+AnonPages, Mapped, Shmem and Slab in kB. Returns the number of parsed keys.
+*/
+int parse_meminfo(const char* first, const char* last, counters_step_t* c);
+
+/*
+Parse /sys/devices/system/node/node<N>/meminfo: MemTotal, MemFree, MemUsed,
+Active, Inactive, Dirty, FilePages, AnonPages, Shmem and Slab in kB. Then
+append numa_hit, numa_miss, numa_foreign, interleave_hit, local_node and
+other_node pages from /sys/devices/system/node/node<N>/numastat.
+Return the number of parsed keys.
+*/
+int parse_node_meminfo(const char* first, const char* last, counters_step_t* c);
+int parse_numastat(const char* first, const char* last, counters_step_t* c);
+
+/*
+Add the resident bytes on every node (N<node>=<pages> times kernelpagesize_kB)
+of the complete lines of /proc/<pid>/numa_maps to bytes[MAX_NUMA_NODES].
+Return the pointer to the first incomplete line.
+*/
+const char* parse_numa_maps(const char* first, const char* last, unsigned long long* bytes);
+
+/*
+Build the system record timestamp|path|name|counters...\n, returns the pointer
+past the last written character or NULL if there is not enough space.
+*/
+char* format_counters_line(char* first, char* last, time_t timestamp, const char* path,
+                           const counters_step_t* c);
+
+/*
+Build the system record of the hwmon sensor:
+timestamp|/sys/class/hwmon/<device>/<sensor>|value|label|name\n
+Returns the pointer past the last written character or NULL if there
+is not enough space.
+*/
+char* format_hwmon_line(char* first, char* last, time_t timestamp,
+                        const char* device, const char* sensor,
+                        const char* value, size_t value_size,
+                        const char* label, size_t label_size,
+                        const char* name, size_t name_size);
+
+#endif // vim:filetype=c
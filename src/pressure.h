@@ -0,0 +1,193 @@
+/*
+Lockstep — log resources consumed by userland Linux processes.
+© 2026 Ivan Gankevich
+
+This file is part of Lockstep.
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef PRESSURE_H
+#define PRESSURE_H
+
+#include <sys/types.h>
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <parse.h>
+
+/*
+Pressure stall information from /proc/pressure/{cpu,memory,io}.
+
+pressure.trigger = memory some 150ms 1s
+
+registers the kernel trigger that fires when the tasks stall on the
+resource for 150ms or more within any 1s window (the window is between
+500ms and 10s; unprivileged users need a multiple of 2s). The trigger file
+descriptors are polled in the main loop. When the trigger fires, the event
+record is written, all processes are sampled immediately and then every
+pressure.interval for pressure.duration; the burst field of these
+records is the name of the trigger (e.g. "memory some").
+
+The pressure system field writes one record per resource on every tick:
+timestamp|/proc/pressure/<resource>|some avg10|some avg60|some total|full avg10|full avg60|full total
+*/
+
+#define MAX_PRESSURE_TRIGGERS 8
+
+typedef enum {
+    PRESSURE_CPU = 0,
+    PRESSURE_MEMORY = 1,
+    PRESSURE_IO = 2,
+    NUM_PRESSURE_RESOURCES = 3,
+} pressure_resource_type;
+
+static const char* pressure_resources[NUM_PRESSURE_RESOURCES] = {"cpu", "memory", "io"};
+
+typedef struct {
+    // the trigger as written in the configuration file
+    char text[128];
+    // the resource and the line, e.g. "memory some"
+    char name[16];
+    pressure_resource_type resource;
+    int full;
+    // in microseconds
+    unsigned long stall;
+    unsigned long window;
+    int fd;
+} pressure_trigger_type;
+
+static pressure_trigger_type pressure_triggers[MAX_PRESSURE_TRIGGERS];
+static int num_pressure_triggers = 0;
+// in microseconds
+static unsigned long pressure_interval = 250000UL;
+static unsigned long pressure_duration = 10000000UL;
+// /proc/pressure files that are read on every tick
+static int pressure_fds[NUM_PRESSURE_RESOURCES] = {-1, -1, -1};
+
+/* Parse "resource some|full stall window", returns -1 on error. */
+static int
+pressure_trigger_parse(const char* first, const char* last, pressure_trigger_type* t) {
+    memset(t, 0, sizeof(pressure_trigger_type));
+    t->fd = -1;
+    const size_t n = last-first;
+    if (n >= sizeof(t->text)) { return -1; }
+    memcpy(t->text, first, n);
+    t->text[n] = 0;
+    const char* words[4];
+    const char* words_last[4];
+    int nwords = 0;
+    while (first != last) {
+        while (first != last && isspace(*first)) { ++first; }
+        if (first == last) { break; }
+        if (nwords == 4) { return -1; }
+        words[nwords] = first;
+        while (first != last && !isspace(*first)) { ++first; }
+        words_last[nwords++] = first;
+    }
+    if (nwords != 4) { return -1; }
+    int resource = -1;
+    for (int i=0; i<NUM_PRESSURE_RESOURCES; ++i) {
+        if (compare_chars(words[0], words_last[0], pressure_resources[i]) == 0) { resource = i; }
+    }
+    if (resource == -1) { return -1; }
+    t->resource = (pressure_resource_type)resource;
+    if (compare_chars(words[1], words_last[1], "full") == 0) { t->full = 1; }
+    else if (compare_chars(words[1], words_last[1], "some") != 0) { return -1; }
+    t->stall = parse_duration(words[2], words_last[2]);
+    t->window = parse_duration(words[3], words_last[3]);
+    if (t->stall == ULONG_MAX || t->window == ULONG_MAX || t->stall == 0 ||
+        t->window < 500000UL || t->window > 10000000UL || t->stall > t->window) {
+        return -1;
+    }
+    snprintf(t->name, sizeof(t->name), "%s %s", pressure_resources[resource],
+             t->full ? "full" : "some");
+    return 0;
+}
+
+/* Register the trigger in the kernel, returns the file descriptor or -1. */
+static int
+pressure_trigger_open(pressure_trigger_type* t) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/pressure/%s", pressure_resources[t->resource]);
+    int fd = open(path, O_RDWR|O_NONBLOCK|O_CLOEXEC);
+    if (fd == -1) {
+        fprintf(stderr, "failed to open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    char trigger[64];
+    int n = snprintf(trigger, sizeof(trigger), "%s %lu %lu",
+                     t->full ? "full" : "some", t->stall, t->window);
+    // the terminating NUL is a part of the trigger
+    if (write(fd, trigger, n+1) == -1) {
+        fprintf(stderr, "failed to register pressure trigger %s: %s\n",
+                t->text, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    t->fd = fd;
+    return fd;
+}
+
+/* Read the current values of the resource, returns -1 on error. */
+static int
+pressure_read(pressure_resource_type resource, pressure_step_t* some, pressure_step_t* full) {
+    int* fd = pressure_fds + resource;
+    if (*fd == -1) {
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/pressure/%s", pressure_resources[resource]);
+        *fd = open(path, O_RDONLY|O_CLOEXEC);
+        if (*fd == -1) { return -1; }
+    }
+    char buf[256];
+    ssize_t n = pread(*fd, buf, sizeof(buf)-1, 0);
+    if (n <= 0) { return -1; }
+    buf[n] = 0;
+    return parse_pressure(buf, some, full) >= 4 ? 0 : -1;
+}
+
+static void
+pressure_close() {
+    for (int i=0; i<num_pressure_triggers; ++i) {
+        pressure_trigger_type* t = pressure_triggers + i;
+        if (t->fd != -1 && close(t->fd) == -1) { perror("close"); }
+        t->fd = -1;
+    }
+    for (int i=0; i<NUM_PRESSURE_RESOURCES; ++i) {
+        if (pressure_fds[i] != -1 && close(pressure_fds[i]) == -1) { perror("close"); }
+        pressure_fds[i] = -1;
+    }
+}
+
+#endif // vim:filetype=c
@@ -0,0 +1,185 @@
+/*
+Lockstep — log resources consumed by userland Linux processes.
+© 2026 Ivan Gankevich
+
+This file is part of Lockstep.
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef PROCESS_TABLE_H
+#define PROCESS_TABLE_H
+
+#include <sys/types.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <intern.h>
+#include <rules.h>
+#include <step.h>
+
+/*
+The state that is kept for every process between the ticks, keyed by
+the pid. An entry is reset when the pid is reused (the start time
+differs) and is removed when the process was not seen during the tick.
+*/
+
+typedef struct {
+    pid_t pid;
+    unsigned int generation;
+    unsigned long long start_time;
+    // the descriptors that refer to DRM devices (see drm_step.h)
+    int* drm_fds;
+    unsigned int num_drm_fds;
+    unsigned int drm_fds_capacity;
+    // monotonic time of the last scan of the descriptors in microseconds
+    uint64_t drm_scan_time;
+    // the addresses of the arguments and the environment change after exec
+    unsigned long arg_start;
+    unsigned long env_start;
+    // the command line and the environment (see cmdline_step.h)
+    int cmdline_read;
+    intern_id cmdline;
+    intern_id env[MAX_ENV_FIELDS];
+    // the cgroup (see cgroup_step.h)
+    ino_t cgroup_inode;
+    intern_id cgroup;
+    intern_id cgroup_tag;
+    uint64_t cgroup_time;
+    // the rules that fired and the values of the previous tick (see rules.h)
+    uint32_t rules_fired;
+    int rules_initialized;
+    double rule_values[MAX_RULES];
+    // the counters of the previous sample for the rates (see top.h)
+    uint64_t rate_time;
+    unsigned long rate_cpu_time;
+    unsigned long rate_io_bytes;
+    unsigned long long rate_wait_ns;
+    // the values carried forward between the reads of smaps_rollup (see smaps_step.h)
+    smaps_step_t smaps;
+    // monotonic time of the last attempt and the last successful read in microseconds
+    uint64_t smaps_time;
+    uint64_t smaps_read_time;
+    // resident bytes per node from numa_maps (see numa_step.h)
+    unsigned long long numa_bytes[MAX_NUMA_NODES];
+    intern_id numa_memory;
+    uint64_t numa_time;
+    uint64_t numa_read_time;
+} process_state_type;
+
+// open addressing, pid zero is an empty slot
+static process_state_type* process_table = NULL;
+static unsigned int process_table_capacity = 0;
+static unsigned int process_table_size = 0;
+static unsigned int process_table_generation = 1;
+
+static inline unsigned int
+process_table_hash(pid_t pid) {
+    return (unsigned int)pid*2654435761U;
+}
+
+static process_state_type*
+process_table_slot(process_state_type* table, unsigned int capacity, pid_t pid) {
+    const unsigned int mask = capacity-1;
+    unsigned int i = process_table_hash(pid) & mask;
+    while (table[i].pid != 0 && table[i].pid != pid) { i = (i+1) & mask; }
+    return table + i;
+}
+
+static void
+process_table_rehash(unsigned int capacity) {
+    process_state_type* table = calloc(capacity, sizeof(process_state_type));
+    if (table == NULL) { perror("calloc"); exit(1); }
+    for (unsigned int i=0; i<process_table_capacity; ++i) {
+        if (process_table[i].pid == 0) { continue; }
+        *process_table_slot(table, capacity, process_table[i].pid) = process_table[i];
+    }
+    free(process_table);
+    process_table = table;
+    process_table_capacity = capacity;
+}
+
+static void
+process_state_free(process_state_type* p) {
+    free(p->drm_fds);
+}
+
+/*
+Returns the state of the process. The pointer is valid until the next
+call to process_table_get or process_table_sweep.
+*/
+static process_state_type*
+process_table_get(pid_t pid, unsigned long long start_time) {
+    if (2*(process_table_size+1) > process_table_capacity) {
+        process_table_rehash(process_table_capacity == 0 ? 1024 : 2*process_table_capacity);
+    }
+    process_state_type* p = process_table_slot(process_table, process_table_capacity, pid);
+    if (p->pid == pid && p->start_time != start_time) {
+        // the pid was reused
+        process_state_free(p);
+        memset(p, 0, sizeof(process_state_type));
+        --process_table_size;
+    }
+    if (p->pid == 0) {
+        p->pid = pid;
+        p->start_time = start_time;
+        ++process_table_size;
+    }
+    p->generation = process_table_generation;
+    return p;
+}
+
+/* Returns 1 if the process called exec since the previous tick. */
+static inline int
+process_state_exec(process_state_type* p, unsigned long arg_start, unsigned long env_start) {
+    if (p->arg_start == arg_start && p->env_start == env_start) { return 0; }
+    p->arg_start = arg_start;
+    p->env_start = env_start;
+    return 1;
+}
+
+/* Remove the processes that were not seen since the previous sweep. */
+static void
+process_table_sweep() {
+    unsigned int removed = 0;
+    for (unsigned int i=0; i<process_table_capacity; ++i) {
+        process_state_type* p = process_table + i;
+        if (p->pid == 0 || p->generation == process_table_generation) { continue; }
+        process_state_free(p);
+        memset(p, 0, sizeof(process_state_type));
+        ++removed;
+    }
+    ++process_table_generation;
+    if (removed == 0) { return; }
+    process_table_size -= removed;
+    // removed slots break the probe sequences
+    process_table_rehash(process_table_capacity);
+}
+
+#endif // vim:filetype=c
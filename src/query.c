@@ -0,0 +1,781 @@
+/*
+Lockstep — log resources consumed by userland Linux processes.
+© 2026 Ivan Gankevich
+
+This file is part of Lockstep.
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#define _GNU_SOURCE
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <segment.h>
+
+/*
+Aggregate columns of segment files written with "process.segments".
+Segments are pruned by the time in their names and by the footer index,
+blocks are pruned by their headers, and only the columns that take part
+in the query are decoded. The value predicates prune segments and blocks
+by the minimum and the maximum of the column in the footer and in the
+block headers.
+*/
+
+typedef enum {
+    AGGREGATE_MIN,
+    AGGREGATE_MAX,
+    AGGREGATE_SUM,
+    AGGREGATE_AVG,
+    AGGREGATE_COUNT,
+} aggregate_function_type;
+
+static const char* aggregate_names[] = {"min", "max", "sum", "avg", "count"};
+
+typedef struct {
+    aggregate_function_type function;
+    const char* field;
+    // the type of the column in the first segment that has it
+    int type;
+} aggregate_type;
+
+typedef enum {
+    PREDICATE_LESS,
+    PREDICATE_LESS_EQUAL,
+    PREDICATE_EQUAL,
+    PREDICATE_GREATER_EQUAL,
+    PREDICATE_GREATER,
+} predicate_operator_type;
+
+// longer operators go first
+static const char* predicate_operators[] = {"<=", ">=", "<", ">", "="};
+static const predicate_operator_type predicate_operator_types[] = {
+    PREDICATE_LESS_EQUAL, PREDICATE_GREATER_EQUAL, PREDICATE_LESS, PREDICATE_GREATER,
+    PREDICATE_EQUAL
+};
+
+typedef struct {
+    const char* field;
+    predicate_operator_type operator;
+    double value;
+} predicate_type;
+
+typedef struct {
+    uint64_t min;
+    uint64_t max;
+    double sum;
+    unsigned long count;
+} aggregate_state_type;
+
+typedef struct {
+    char* name;
+    uint64_t value;
+    unsigned long count;
+    aggregate_state_type* states;
+} group_type;
+
+typedef struct {
+    const char* name;
+    int type;
+    const uint8_t* first;
+    const uint8_t* last;
+    uint64_t* values;
+    // the dictionary of string columns
+    const char** strings;
+    uint32_t* string_sizes;
+    uint32_t num_strings;
+} column_type;
+
+#define MAX_AGGREGATES 64
+#define MAX_PREDICATES 64
+
+static int64_t start_time = INT64_MIN;
+static int64_t end_time = INT64_MAX;
+static int64_t query_pid = -1;
+static const char* group_field = NULL;
+static int group_type_of_column = -1;
+static aggregate_type aggregates[MAX_AGGREGATES];
+static int num_aggregates = 0;
+static predicate_type predicates[MAX_PREDICATES];
+static int num_predicates = 0;
+
+static group_type* groups = NULL;
+static uint32_t* group_table = NULL;
+static size_t num_groups = 0;
+static size_t group_table_capacity = 0;
+
+static unsigned long num_segments = 0;
+static unsigned long num_blocks = 0;
+static unsigned long num_rows = 0;
+
+static uint32_t
+hash_bytes(const char* str, size_t n) {
+    uint32_t h = 2166136261U;
+    for (size_t i=0; i<n; ++i) { h ^= (unsigned char)str[i]; h *= 16777619U; }
+    return h;
+}
+
+static uint32_t
+hash_value(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return (uint32_t)x;
+}
+
+static void group_table_insert(uint32_t index, uint32_t hash);
+
+static void
+group_table_grow() {
+    const size_t old_capacity = group_table_capacity;
+    uint32_t* old_table = group_table;
+    group_table_capacity = old_capacity == 0 ? 1024 : 2*old_capacity;
+    group_table = calloc(group_table_capacity, sizeof(uint32_t));
+    if (group_table == NULL) { perror("calloc"); exit(1); }
+    for (size_t i=0; i<old_capacity; ++i) {
+        if (old_table[i] == 0) { continue; }
+        const group_type* g = groups + old_table[i]-1;
+        const uint32_t hash = g->name != NULL
+            ? hash_bytes(g->name, strlen(g->name)) : hash_value(g->value);
+        group_table_insert(old_table[i]-1, hash);
+    }
+    free(old_table);
+    groups = realloc(groups, group_table_capacity/2*sizeof(group_type));
+    if (groups == NULL) { perror("realloc"); exit(1); }
+}
+
+static void
+group_table_insert(uint32_t index, uint32_t hash) {
+    const size_t mask = group_table_capacity-1;
+    size_t i = hash & mask;
+    while (group_table[i] != 0) { i = (i+1) & mask; }
+    group_table[i] = index+1;
+}
+
+static group_type*
+group_new(const char* name, size_t name_size, uint64_t value, uint32_t hash) {
+    if (2*(num_groups+1) > group_table_capacity) { group_table_grow(); }
+    group_type* g = groups + num_groups;
+    g->name = NULL;
+    if (name != NULL) {
+        g->name = strndup(name, name_size);
+        if (g->name == NULL) { perror("strndup"); exit(1); }
+    }
+    g->value = value;
+    g->count = 0;
+    g->states = calloc(num_aggregates == 0 ? 1 : num_aggregates, sizeof(aggregate_state_type));
+    if (g->states == NULL) { perror("calloc"); exit(1); }
+    group_table_insert((uint32_t)num_groups, hash);
+    ++num_groups;
+    return g;
+}
+
+static uint32_t
+group_find_string(const char* name, size_t name_size) {
+    const uint32_t hash = hash_bytes(name, name_size);
+    if (group_table_capacity != 0) {
+        const size_t mask = group_table_capacity-1;
+        for (size_t i = hash & mask; group_table[i] != 0; i = (i+1) & mask) {
+            const group_type* g = groups + group_table[i]-1;
+            if (strncmp(g->name, name, name_size) == 0 && g->name[name_size] == 0) {
+                return group_table[i]-1;
+            }
+        }
+    }
+    return group_new(name, name_size, 0, hash) - groups;
+}
+
+static uint32_t
+group_find_value(uint64_t value) {
+    const uint32_t hash = hash_value(value);
+    if (group_table_capacity != 0) {
+        const size_t mask = group_table_capacity-1;
+        for (size_t i = hash & mask; group_table[i] != 0; i = (i+1) & mask) {
+            if (groups[group_table[i]-1].value == value) { return group_table[i]-1; }
+        }
+    }
+    return group_new(NULL, 0, value, hash) - groups;
+}
+
+static int
+decode_column(column_type* c, uint32_t nrows) {
+    const uint8_t* first = c->first;
+    const uint8_t* last = c->last;
+    if (c->type == SEGMENT_STRING) {
+        uint64_t n = 0;
+        if ((first = segment_get_varint(first, last, &n)) == NULL || n > nrows) { return -1; }
+        c->num_strings = (uint32_t)n;
+        for (uint32_t i=0; i<c->num_strings; ++i) {
+            uint64_t size = 0;
+            first = segment_get_varint(first, last, &size);
+            if (first == NULL || size > (uint64_t)(last-first)) { return -1; }
+            c->strings[i] = (const char*)first;
+            c->string_sizes[i] = (uint32_t)size;
+            first += size;
+        }
+        for (uint32_t i=0; i<nrows; ++i) {
+            first = segment_get_varint(first, last, c->values + i);
+            if (first == NULL || c->values[i] >= c->num_strings) { return -1; }
+        }
+    } else {
+        uint64_t previous = 0;
+        for (uint32_t i=0; i<nrows; ++i) {
+            uint64_t x = 0;
+            if ((first = segment_get_varint(first, last, &x)) == NULL) { return -1; }
+            previous += (uint64_t)segment_unzigzag(x);
+            c->values[i] = previous;
+        }
+    }
+    return 0;
+}
+
+static double
+column_value(int type, uint64_t value) {
+    if (type == SEGMENT_UNSIGNED) { return (double)value; }
+    if (type == SEGMENT_FIXED) { return (double)(int64_t)value*1e-6; }
+    return (double)(int64_t)value;
+}
+
+static int
+predicate_matches(const predicate_type* p, double x) {
+    switch (p->operator) {
+        case PREDICATE_LESS: return x < p->value;
+        case PREDICATE_LESS_EQUAL: return x <= p->value;
+        case PREDICATE_EQUAL: return x == p->value;
+        case PREDICATE_GREATER_EQUAL: return x >= p->value;
+        case PREDICATE_GREATER: return x > p->value;
+    }
+    return 0;
+}
+
+/* Returns 1 if some value between min and max matches the predicate. */
+static int
+predicate_overlaps(const predicate_type* p, double min, double max) {
+    switch (p->operator) {
+        case PREDICATE_LESS: return min < p->value;
+        case PREDICATE_LESS_EQUAL: return min <= p->value;
+        case PREDICATE_EQUAL: return min <= p->value && p->value <= max;
+        case PREDICATE_GREATER_EQUAL: return max >= p->value;
+        case PREDICATE_GREATER: return max > p->value;
+    }
+    return 0;
+}
+
+/* Check the ranges of the block or the segment against the query. */
+static int
+overlaps(const segment_block_header_type* h, const uint8_t* column_headers,
+         const column_type* columns, const int* predicate_columns) {
+    if (h->max_timestamp < start_time || h->min_timestamp > end_time) { return 0; }
+    if (query_pid != -1 && (h->max_pid < query_pid || h->min_pid > query_pid)) { return 0; }
+    for (int j=0; j<num_predicates; ++j) {
+        segment_column_header_type ch;
+        memcpy(&ch, column_headers + predicate_columns[j]*sizeof(ch), sizeof(ch));
+        const int type = columns[predicate_columns[j]].type;
+        if (!predicate_overlaps(predicates + j, column_value(type, ch.min),
+                                column_value(type, ch.max))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void
+aggregate_value(aggregate_state_type* state, int type, uint64_t value) {
+    if (state->count == 0 || segment_less(type, value, state->min)) { state->min = value; }
+    if (state->count == 0 || segment_less(type, state->max, value)) { state->max = value; }
+    if (type == SEGMENT_UNSIGNED) { state->sum += (double)value; }
+    else { state->sum += (double)(int64_t)value; }
+    ++state->count;
+}
+
+/* Returns the size of the block or zero if it is corrupt. */
+static size_t
+scan_block(const uint8_t* first, const uint8_t* last,
+           column_type* columns, uint32_t ncolumns,
+           int timestamp_column, int pid_column, int group_column,
+           int* aggregate_columns, int* predicate_columns, uint32_t* group_indices) {
+    const size_t header_size = 4 + sizeof(segment_block_header_type) +
+        ncolumns*sizeof(segment_column_header_type);
+    if ((size_t)(last-first) < header_size || memcmp(first, segment_block_magic, 4) != 0) {
+        return 0;
+    }
+    segment_block_header_type h;
+    memcpy(&h, first + 4, sizeof(h));
+    if (h.ncolumns != ncolumns || h.nrows > SEGMENT_MAX_ROWS) { return 0; }
+    const uint8_t* data = first + header_size;
+    for (uint32_t i=0; i<ncolumns; ++i) {
+        segment_column_header_type ch;
+        memcpy(&ch, first + 4 + sizeof(h) + i*sizeof(ch), sizeof(ch));
+        if (ch.size > (uint64_t)(last-data)) { return 0; }
+        columns[i].first = data;
+        columns[i].last = data + ch.size;
+        data += ch.size;
+    }
+    const size_t block_size = data-first;
+    if (!overlaps(&h, first + 4 + sizeof(h), columns, predicate_columns)) {
+        return block_size;
+    }
+    ++num_blocks;
+    // decode only the columns of the query
+    for (uint32_t i=0; i<ncolumns; ++i) {
+        int needed = (int)i == timestamp_column || (int)i == pid_column || (int)i == group_column;
+        for (int j=0; j<num_aggregates; ++j) { needed |= aggregate_columns[j] == (int)i; }
+        for (int j=0; j<num_predicates; ++j) { needed |= predicate_columns[j] == (int)i; }
+        if (needed && decode_column(columns + i, h.nrows) == -1) {
+            fprintf(stderr, "corrupt column %s\n", columns[i].name);
+            return 0;
+        }
+    }
+    if (group_column != -1 && columns[group_column].type == SEGMENT_STRING) {
+        // map the dictionary of the block to the groups once
+        const column_type* c = columns + group_column;
+        for (uint32_t i=0; i<c->num_strings; ++i) {
+            group_indices[i] = group_find_string(c->strings[i], c->string_sizes[i]);
+        }
+    }
+    const uint64_t* timestamps = columns[timestamp_column].values;
+    const uint64_t* pids = columns[pid_column].values;
+    for (uint32_t row=0; row<h.nrows; ++row) {
+        const int64_t t = (int64_t)timestamps[row];
+        if (t < start_time || t > end_time) { continue; }
+        if (query_pid != -1 && (int64_t)pids[row] != query_pid) { continue; }
+        int matches = 1;
+        for (int j=0; j<num_predicates && matches; ++j) {
+            const column_type* c = columns + predicate_columns[j];
+            matches = predicate_matches(predicates + j, column_value(c->type, c->values[row]));
+        }
+        if (!matches) { continue; }
+        uint32_t group = 0;
+        if (group_column != -1) {
+            const uint64_t value = columns[group_column].values[row];
+            group = columns[group_column].type == SEGMENT_STRING
+                ? group_indices[value] : group_find_value(value);
+        } else if (num_groups == 0) {
+            group_new(NULL, 0, 0, 0);
+        }
+        group_type* g = groups + group;
+        ++g->count;
+        for (int j=0; j<num_aggregates; ++j) {
+            if (aggregate_columns[j] == -1) { continue; }
+            const column_type* c = columns + aggregate_columns[j];
+            aggregate_value(g->states + j, c->type, c->values[row]);
+        }
+        ++num_rows;
+    }
+    return block_size;
+}
+
+static void
+scan_segment(const char* path) {
+    int fd = open(path, O_RDONLY|O_CLOEXEC);
+    if (fd == -1) {
+        fprintf(stderr, "failed to open %s\n", path);
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size == 0) {
+        close(fd);
+        return;
+    }
+    const size_t file_size = st.st_size;
+    const uint8_t* file = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (file == MAP_FAILED) {
+        perror("mmap");
+        return;
+    }
+    const uint8_t* first = file;
+    const uint8_t* last = file + file_size;
+    column_type* columns = NULL;
+    uint32_t ncolumns = 0;
+    uint32_t version = 0;
+    if (file_size < 12 || memcmp(first, segment_magic, 4) != 0) { goto corrupt; }
+    memcpy(&version, first + 4, 4);
+    memcpy(&ncolumns, first + 8, 4);
+    if (version != SEGMENT_VERSION || ncolumns > SEGMENT_MAX_COLUMNS) { goto corrupt; }
+    first += 12;
+    columns = calloc(ncolumns, sizeof(column_type));
+    if (columns == NULL) { perror("calloc"); exit(1); }
+    int timestamp_column = -1, pid_column = -1, group_column = -1;
+    int aggregate_columns[MAX_AGGREGATES];
+    for (int j=0; j<num_aggregates; ++j) { aggregate_columns[j] = -1; }
+    int predicate_columns[MAX_PREDICATES];
+    for (int j=0; j<num_predicates; ++j) { predicate_columns[j] = -1; }
+    for (uint32_t i=0; i<ncolumns; ++i) {
+        if (last-first < 2 || last-first-2 < first[1]) { goto corrupt; }
+        column_type* c = columns + i;
+        c->type = first[0];
+        c->name = strndup((const char*)first + 2, first[1]);
+        if (c->name == NULL) { perror("strndup"); exit(1); }
+        first += 2 + first[1];
+        if (strcmp(c->name, "timestamp") == 0) { timestamp_column = i; }
+        if (strcmp(c->name, "pid") == 0) { pid_column = i; }
+        if (group_field != NULL && strcmp(c->name, group_field) == 0) {
+            if (group_type_of_column == -1) { group_type_of_column = c->type; }
+            if (c->type == group_type_of_column) { group_column = i; }
+        }
+        for (int j=0; j<num_aggregates; ++j) {
+            if (strcmp(c->name, aggregates[j].field) != 0) { continue; }
+            if (aggregates[j].type == -1) { aggregates[j].type = c->type; }
+            if (c->type == aggregates[j].type && c->type != SEGMENT_STRING) {
+                aggregate_columns[j] = i;
+            }
+        }
+        for (int j=0; j<num_predicates; ++j) {
+            if (strcmp(c->name, predicates[j].field) == 0 && c->type != SEGMENT_STRING) {
+                predicate_columns[j] = i;
+            }
+        }
+    }
+    if (timestamp_column == -1 || pid_column == -1) { goto corrupt; }
+    // segments without the group column do not contribute to the groups
+    if (group_field != NULL && group_column == -1) { goto done; }
+    // no record matches the predicate on the missing or the string column
+    for (int j=0; j<num_predicates; ++j) {
+        if (predicate_columns[j] == -1) { goto done; }
+    }
+    ++num_segments;
+    uint64_t* values = malloc(SEGMENT_MAX_ROWS*sizeof(uint64_t)*ncolumns);
+    const char** strings = malloc(SEGMENT_MAX_ROWS*sizeof(char*));
+    uint32_t* string_sizes = malloc(SEGMENT_MAX_ROWS*sizeof(uint32_t));
+    uint32_t* group_indices = malloc(SEGMENT_MAX_ROWS*sizeof(uint32_t));
+    if (values == NULL || strings == NULL || string_sizes == NULL || group_indices == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    for (uint32_t i=0; i<ncolumns; ++i) {
+        columns[i].values = values + i*SEGMENT_MAX_ROWS;
+        columns[i].strings = strings;
+        columns[i].string_sizes = string_sizes;
+    }
+    const size_t footer_header_size = 8 + sizeof(segment_block_header_type) +
+        ncolumns*sizeof(segment_column_header_type);
+    // the truncated file is too short for the trailer and the footer
+    const int has_trailer = file_size >= sizeof(segment_trailer_type) + footer_header_size;
+    segment_trailer_type trailer;
+    memset(&trailer, 0, sizeof(trailer));
+    if (has_trailer) { memcpy(&trailer, last - sizeof(trailer), sizeof(trailer)); }
+    const uint8_t* footer = NULL;
+    if (has_trailer &&
+        memcmp(trailer.magic, segment_trailer_magic, 4) == 0 &&
+        trailer.footer_offset <= file_size - sizeof(trailer) - footer_header_size) {
+        footer = file + trailer.footer_offset;
+    }
+    if (footer != NULL && memcmp(footer, segment_footer_magic, 4) == 0) {
+        // complete segment: prune it by the footer and jump to the blocks
+        uint32_t nblocks = 0;
+        segment_block_header_type h;
+        memcpy(&nblocks, footer + 4, 4);
+        memcpy(&h, footer + 8, sizeof(h));
+        const uint8_t* offsets = footer + footer_header_size;
+        if (nblocks > (size_t)(last-offsets)/sizeof(uint64_t)) { goto corrupt_blocks; }
+        if (overlaps(&h, footer + 8 + sizeof(h), columns, predicate_columns)) {
+            for (uint32_t i=0; i<nblocks; ++i) {
+                uint64_t offset = 0;
+                memcpy(&offset, offsets + i*sizeof(uint64_t), sizeof(uint64_t));
+                if (offset >= trailer.footer_offset ||
+                    scan_block(file + offset, footer, columns, ncolumns,
+                               timestamp_column, pid_column, group_column,
+                               aggregate_columns, predicate_columns, group_indices) == 0) {
+                    goto corrupt_blocks;
+                }
+            }
+        }
+    } else {
+        // the segment is still being written: read the blocks sequentially
+        while (last-first >= 4 && memcmp(first, segment_block_magic, 4) == 0) {
+            const size_t n = scan_block(first, last, columns, ncolumns,
+                                        timestamp_column, pid_column, group_column,
+                                        aggregate_columns, predicate_columns,
+                                        group_indices);
+            if (n == 0) { break; }
+            first += n;
+        }
+    }
+    goto free_blocks;
+corrupt_blocks:
+    fprintf(stderr, "corrupt segment %s\n", path);
+free_blocks:
+    free(values);
+    free(strings);
+    free(string_sizes);
+    free(group_indices);
+    goto done;
+corrupt:
+    fprintf(stderr, "corrupt segment %s\n", path);
+done:
+    if (columns != NULL) {
+        for (uint32_t i=0; i<ncolumns; ++i) { free((void*)columns[i].name); }
+        free(columns);
+    }
+    munmap((void*)file, file_size);
+}
+
+/* Segment names start with the hour of their records. */
+static int
+segment_in_range(const char* name) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char* end = strptime(name, "%Y%m%dT%H0000Z", &tm);
+    if (end == NULL) { return 1; }
+    const int64_t hour = timegm(&tm);
+    return hour <= end_time && hour + 3600 > start_time;
+}
+
+static int
+compare_strings(const void* a, const void* b) {
+    return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+static void
+scan_path(const char* path) {
+    struct stat st;
+    if (stat(path, &st) == -1) {
+        fprintf(stderr, "failed to stat %s\n", path);
+        return;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        const char* name = strrchr(path, '/');
+        if (segment_in_range(name == NULL ? path : name+1)) { scan_segment(path); }
+        return;
+    }
+    DIR* dir = opendir(path);
+    if (dir == NULL) {
+        fprintf(stderr, "failed to open %s\n", path);
+        return;
+    }
+    char** paths = NULL;
+    size_t npaths = 0;
+    size_t capacity = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        const size_t n = strlen(entry->d_name);
+        if (n < 4 || strcmp(entry->d_name + n - 4, ".lss") != 0) { continue; }
+        if (!segment_in_range(entry->d_name)) { continue; }
+        if (npaths == capacity) {
+            capacity = capacity == 0 ? 64 : 2*capacity;
+            paths = realloc(paths, capacity*sizeof(char*));
+            if (paths == NULL) { perror("realloc"); exit(1); }
+        }
+        if (asprintf(paths + npaths, "%s/%s", path, entry->d_name) == -1) {
+            perror("asprintf");
+            exit(1);
+        }
+        ++npaths;
+    }
+    closedir(dir);
+    qsort(paths, npaths, sizeof(char*), compare_strings);
+    for (size_t i=0; i<npaths; ++i) {
+        scan_segment(paths[i]);
+        free(paths[i]);
+    }
+    free(paths);
+}
+
+static int
+compare_groups(const void* a, const void* b) {
+    const group_type* x = a;
+    const group_type* y = b;
+    if (x->name != NULL) { return strcmp(x->name, y->name); }
+    if (segment_less(group_type_of_column, x->value, y->value)) { return -1; }
+    if (segment_less(group_type_of_column, y->value, x->value)) { return 1; }
+    return 0;
+}
+
+static void
+print_value(int type, uint64_t value) {
+    if (type == SEGMENT_UNSIGNED) { printf("%llu", (unsigned long long)value); }
+    else if (type == SEGMENT_FIXED) { printf("%f", (double)(int64_t)value*1e-6); }
+    else { printf("%lld", (long long)(int64_t)value); }
+}
+
+static void
+print_groups() {
+    if (group_field != NULL) { printf("%s|", group_field); }
+    printf("count");
+    for (int j=0; j<num_aggregates; ++j) {
+        printf("|%s(%s)", aggregate_names[aggregates[j].function], aggregates[j].field);
+    }
+    putchar('\n');
+    qsort(groups, num_groups, sizeof(group_type), compare_groups);
+    for (size_t i=0; i<num_groups; ++i) {
+        const group_type* g = groups + i;
+        if (group_field != NULL) {
+            if (g->name != NULL) { fputs(g->name, stdout); }
+            else { print_value(group_type_of_column, g->value); }
+            putchar('|');
+        }
+        printf("%lu", g->count);
+        for (int j=0; j<num_aggregates; ++j) {
+            const aggregate_state_type* state = g->states + j;
+            const int type = aggregates[j].type;
+            const double scale = type == SEGMENT_FIXED ? 1e-6 : 1;
+            putchar('|');
+            if (state->count == 0 && aggregates[j].function != AGGREGATE_COUNT) { continue; }
+            switch (aggregates[j].function) {
+                case AGGREGATE_MIN: print_value(type, state->min); break;
+                case AGGREGATE_MAX: print_value(type, state->max); break;
+                case AGGREGATE_SUM:
+                    if (type == SEGMENT_FIXED) { printf("%f", state->sum*scale); }
+                    else { printf("%.0f", state->sum); }
+                    break;
+                case AGGREGATE_AVG: printf("%f", state->sum*scale/state->count); break;
+                case AGGREGATE_COUNT: printf("%lu", state->count); break;
+            }
+        }
+        putchar('\n');
+    }
+}
+
+/* Parse unix time or UTC date and time (e.g. 2026-01-31T12:00). */
+static int64_t
+parse_time(const char* str) {
+    char* end = NULL;
+    long long t = strtoll(str, &end, 10);
+    if (*str != 0 && *end == 0) { return t; }
+    static const char* formats[] = {
+        "%Y-%m-%dT%H:%M:%S", "%Y-%m-%dT%H:%M", "%Y-%m-%dT%H", "%Y-%m-%d"
+    };
+    for (size_t i=0; i<sizeof(formats)/sizeof(const char*); ++i) {
+        struct tm tm;
+        memset(&tm, 0, sizeof(tm));
+        end = strptime(str, formats[i], &tm);
+        if (end != NULL && *end == 0) { return timegm(&tm); }
+    }
+    fprintf(stderr, "bad time %s\n", str);
+    exit(1);
+}
+
+static void
+parse_aggregate(char* str) {
+    char* field = strchr(str, ':');
+    if (field == NULL || num_aggregates == MAX_AGGREGATES) {
+        fprintf(stderr, "bad aggregate %s\n", str);
+        exit(1);
+    }
+    *field++ = 0;
+    const size_t n = sizeof(aggregate_names)/sizeof(const char*);
+    size_t i = 0;
+    while (i != n && strcmp(aggregate_names[i], str) != 0) { ++i; }
+    if (i == n || *field == 0) {
+        fprintf(stderr, "bad aggregate %s\n", str);
+        exit(1);
+    }
+    aggregate_type* a = aggregates + num_aggregates++;
+    a->function = (aggregate_function_type)i;
+    a->field = field;
+    a->type = -1;
+}
+
+/* Parse the predicate like "resident_set_size>1000". */
+static void
+parse_predicate(char* str) {
+    char* op = strpbrk(str, "<>=");
+    if (op == NULL || op == str || num_predicates == MAX_PREDICATES) {
+        fprintf(stderr, "bad predicate %s\n", str);
+        exit(1);
+    }
+    const size_t n = sizeof(predicate_operators)/sizeof(const char*);
+    size_t i = 0;
+    while (i != n && strncmp(op, predicate_operators[i], strlen(predicate_operators[i])) != 0) {
+        ++i;
+    }
+    if (i == n) {
+        fprintf(stderr, "bad predicate %s\n", str);
+        exit(1);
+    }
+    const char* value = op + strlen(predicate_operators[i]);
+    char* end = NULL;
+    const double x = strtod(value, &end);
+    if (*value == 0 || *end != 0) {
+        fprintf(stderr, "bad predicate %s\n", str);
+        exit(1);
+    }
+    *op = 0;
+    predicate_type* p = predicates + num_predicates++;
+    p->field = str;
+    p->operator = predicate_operator_types[i];
+    p->value = x;
+}
+
+static void
+help_message(const char* argv0) {
+    printf("usage: %s [-s time] [-e time] [-p pid] [-g field] [-a function:field...] [-w predicate...] [-v] [-h] path...\n", argv0);
+    fputs("  -s time            the first timestamp (unix time or UTC YYYY-mm-dd[THH[:MM[:SS]]])\n", stdout);
+    fputs("  -e time            the last timestamp\n", stdout);
+    fputs("  -p pid             records of this process only\n", stdout);
+    fputs("  -g field           group records by the field\n", stdout);
+    fputs("  -a function:field  aggregate the field (min, max, sum, avg, count)\n", stdout);
+    fputs("  -w field<op>value  records with the numeric field <, <=, =, >= or > than the value\n", stdout);
+    fputs("  -v                 print the number of scanned segments, blocks and rows\n", stdout);
+    fputs("  -h                 help\n", stdout);
+    fputs("  path               segment files or directories\n", stdout);
+}
+
+int main(int argc, char* argv[]) {
+    int opt = 0;
+    int verbose = 0;
+    while ((opt = getopt(argc, argv, "s:e:p:g:a:w:vh")) != -1) {
+        if (opt == 's') { start_time = parse_time(optarg); }
+        if (opt == 'e') { end_time = parse_time(optarg); }
+        if (opt == 'p') { query_pid = atol(optarg); }
+        if (opt == 'g') { group_field = optarg; }
+        if (opt == 'a') { parse_aggregate(optarg); }
+        if (opt == 'w') { parse_predicate(optarg); }
+        if (opt == 'v') { verbose = 1; }
+        if (opt == 'h') {
+            help_message(argv[0]);
+            return 0;
+        }
+        if (opt == '?') {
+            help_message(argv[0]);
+            return 1;
+        }
+    }
+    if (optind == argc) {
+        help_message(argv[0]);
+        return 1;
+    }
+    for (int i=optind; i<argc; ++i) { scan_path(argv[i]); }
+    print_groups();
+    if (verbose) {
+        fprintf(stderr, "scanned %lu segments, %lu blocks, %lu rows\n",
+                num_segments, num_blocks, num_rows);
+    }
+    return 0;
+}
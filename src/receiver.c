@@ -0,0 +1,430 @@
+/*
+Lockstep — log resources consumed by userland Linux processes.
+© 2026 Ivan Gankevich
+
+This file is part of Lockstep.
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#define _GNU_SOURCE
+
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+
+#include <errno.h>
+#include <netdb.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <segment.h>
+#include <stream.h>
+
+/*
+Receive the binary stream (see stream.h) from many nodes over TCP, UDP
+and Unix sockets and write the records of all of them into one file.
+Every line starts with the host name of the node followed by the
+values of the streamed fields:
+
+host|field1|field2|...
+
+SIGHUP reopens the output file after rotation.
+*/
+
+typedef enum {
+    SOURCE_LISTENER = 0,
+    SOURCE_DATAGRAM = 1,
+    SOURCE_CONNECTION = 2,
+    SOURCE_SIGNAL = 3,
+} source_kind_type;
+
+typedef struct {
+    source_kind_type kind;
+    int fd;
+    uint8_t* data;
+    size_t size;
+    size_t capacity;
+} source_type;
+
+static int epoll_fd = -1;
+static FILE* out = NULL;
+static const char* output_path = NULL;
+static int running = 1;
+static unsigned long num_frames = 0;
+static unsigned long num_bad_frames = 0;
+// the lines of the frame that is being decoded
+static char* text = NULL;
+static size_t text_size = 0;
+static size_t text_capacity = 0;
+
+static source_type*
+source_add(source_kind_type kind, int fd) {
+    source_type* s = calloc(1, sizeof(source_type));
+    if (s == NULL) { perror("calloc"); exit(1); }
+    s->kind = kind;
+    s->fd = fd;
+    struct epoll_event ev = {0};
+    ev.events = EPOLLIN;
+    ev.data.ptr = s;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+        perror("epoll_ctl");
+        exit(1);
+    }
+    return s;
+}
+
+static void
+source_remove(source_type* s) {
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_DEL, s->fd, 0) == -1) { perror("epoll_ctl"); }
+    if (close(s->fd) == -1) { perror("close"); }
+    free(s->data);
+    free(s);
+}
+
+static void
+listen_on(const char* str) {
+    stream_address_type a;
+    if (stream_parse_address(str, &a) == -1) {
+        fprintf(stderr, "bad address %s\n", str);
+        exit(1);
+    }
+    int fd = -1;
+    if (a.transport == STREAM_UNIX) {
+        struct sockaddr_un address = {0};
+        address.sun_family = AF_UNIX;
+        memcpy(address.sun_path, a.path, sizeof(a.path));
+        fd = socket(AF_UNIX, SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+        if (fd == -1) { perror("socket"); exit(1); }
+        unlink(a.path);
+        if (bind(fd, (struct sockaddr*)&address, sizeof(address)) == -1) {
+            fprintf(stderr, "unable to bind to %s: %s\n", str, strerror(errno));
+            exit(1);
+        }
+    } else {
+        struct addrinfo hints = {0};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = a.transport == STREAM_UDP ? SOCK_DGRAM : SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+        struct addrinfo* result = NULL;
+        int ret = getaddrinfo(a.host, a.port, &hints, &result);
+        if (ret != 0) {
+            fprintf(stderr, "unable to resolve %s: %s\n", a.host, gai_strerror(ret));
+            exit(1);
+        }
+        fd = socket(result->ai_family, result->ai_socktype|SOCK_NONBLOCK|SOCK_CLOEXEC,
+                    result->ai_protocol);
+        if (fd == -1) { perror("socket"); exit(1); }
+        int one = 1;
+        if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) == -1) {
+            perror("setsockopt");
+        }
+        if (bind(fd, result->ai_addr, result->ai_addrlen) == -1) {
+            fprintf(stderr, "unable to bind to %s: %s\n", str, strerror(errno));
+            exit(1);
+        }
+        freeaddrinfo(result);
+    }
+    if (a.transport == STREAM_UDP) {
+        source_add(SOURCE_DATAGRAM, fd);
+        return;
+    }
+    if (listen(fd, SOMAXCONN) == -1) { perror("listen"); exit(1); }
+    source_add(SOURCE_LISTENER, fd);
+}
+
+static void
+text_reserve(size_t n) {
+    if (text_size + n <= text_capacity) { return; }
+    size_t capacity = text_capacity == 0 ? 65536 : text_capacity;
+    while (capacity < text_size + n) { capacity *= 2; }
+    text = realloc(text, capacity);
+    if (text == NULL) { perror("realloc"); exit(1); }
+    text_capacity = capacity;
+}
+
+static inline void
+text_append(const void* data, size_t n) {
+    text_reserve(n);
+    memcpy(text + text_size, data, n);
+    text_size += n;
+}
+
+/*
+Write the rows of the frame, returns -1 if the frame is malformed.
+The whole frame is decoded before it is written, so that the malformed
+frame leaves no partial lines in the output.
+*/
+static int
+write_frame(const uint8_t* first, size_t n) {
+    const uint8_t* last = first + n;
+    stream_frame_header_type h;
+    if (n < sizeof(h) || !stream_frame_valid(first, n)) { return -1; }
+    memcpy(&h, first, sizeof(h));
+    if (h.size != n) { return -1; }
+    first += sizeof(h);
+    if (first == last) { return -1; }
+    const uint8_t host_size = *first++;
+    if ((size_t)(last-first) < host_size) { return -1; }
+    const char* host = (const char*)first;
+    first += host_size;
+    uint8_t types[SEGMENT_MAX_COLUMNS];
+    const uint8_t* cursors[SEGMENT_MAX_COLUMNS];
+    const uint8_t* ends[SEGMENT_MAX_COLUMNS];
+    uint64_t previous[SEGMENT_MAX_COLUMNS];
+    for (uint32_t i=0; i<h.ncolumns; ++i) {
+        if (last-first < 2) { return -1; }
+        types[i] = first[0];
+        const uint8_t name_size = first[1];
+        if (types[i] > SEGMENT_STRING || (size_t)(last-first) < 2u + name_size) { return -1; }
+        first += 2 + name_size;
+    }
+    if ((size_t)(last-first) < h.ncolumns*sizeof(uint32_t)) { return -1; }
+    const uint8_t* data = first + h.ncolumns*sizeof(uint32_t);
+    for (uint32_t i=0; i<h.ncolumns; ++i) {
+        uint32_t size = 0;
+        memcpy(&size, first + i*sizeof(uint32_t), sizeof(size));
+        if ((size_t)(last-data) < size) { return -1; }
+        cursors[i] = data;
+        ends[i] = data + size;
+        previous[i] = 0;
+        data += size;
+    }
+    text_size = 0;
+    for (uint32_t row=0; row<h.nrows; ++row) {
+        text_append(host, host_size);
+        for (uint32_t i=0; i<h.ncolumns; ++i) {
+            uint64_t x = 0;
+            cursors[i] = segment_get_varint(cursors[i], ends[i], &x);
+            if (cursors[i] == NULL) { return -1; }
+            text_append("|", 1);
+            if (types[i] == SEGMENT_STRING) {
+                if ((uint64_t)(ends[i]-cursors[i]) < x) { return -1; }
+                text_append(cursors[i], x);
+                cursors[i] += x;
+                continue;
+            }
+            previous[i] += (uint64_t)segment_unzigzag(x);
+            text_reserve(64);
+            char* number = text + text_size;
+            int m = 0;
+            switch ((segment_column_type)types[i]) {
+                case SEGMENT_SIGNED:
+                    m = snprintf(number, 64, "%lld", (long long)(int64_t)previous[i]);
+                    break;
+                case SEGMENT_UNSIGNED:
+                    m = snprintf(number, 64, "%llu", (unsigned long long)previous[i]);
+                    break;
+                case SEGMENT_FIXED:
+                    m = snprintf(number, 64, "%.6f", 1e-6*(double)(int64_t)previous[i]);
+                    break;
+                case SEGMENT_STRING:
+                    break;
+            }
+            if (m > 0) { text_size += m < 64 ? (size_t)m : 63; }
+        }
+        text_append("\n", 1);
+    }
+    fwrite(text, 1, text_size, out);
+    ++num_frames;
+    return 0;
+}
+
+static void
+on_connection(source_type* s) {
+    while (1) {
+        if (s->capacity - s->size < 4096) {
+            s->capacity = s->capacity == 0 ? 65536 : 2*s->capacity;
+            s->data = realloc(s->data, s->capacity);
+            if (s->data == NULL) { perror("realloc"); exit(1); }
+        }
+        ssize_t n = read(s->fd, s->data + s->size, s->capacity - s->size);
+        if (n == -1) {
+            if (errno == EINTR) { continue; }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) { break; }
+            // the partially received frame is sent again by the node
+            source_remove(s);
+            break;
+        }
+        if (n == 0) {
+            source_remove(s);
+            break;
+        }
+        s->size += n;
+        const uint8_t* first = s->data;
+        const uint8_t* last = first + s->size;
+        while (first != last) {
+            if (!stream_frame_valid(first, last-first)) {
+                ++num_bad_frames;
+                source_remove(s);
+                fflush(out);
+                return;
+            }
+            const size_t frame_size = stream_frame_size(first, last);
+            if (frame_size == 0) { break; }
+            if (write_frame(first, frame_size) == -1) { ++num_bad_frames; }
+            first += frame_size;
+        }
+        s->size = last-first;
+        memmove(s->data, first, s->size);
+    }
+    fflush(out);
+}
+
+static void
+on_datagram(source_type* s) {
+    static uint8_t data[65536];
+    while (1) {
+        ssize_t n = recv(s->fd, data, sizeof(data), 0);
+        if (n == -1) {
+            if (errno == EINTR) { continue; }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) { perror("recv"); }
+            break;
+        }
+        if (write_frame(data, n) == -1) { ++num_bad_frames; }
+    }
+    fflush(out);
+}
+
+static void
+on_listener(source_type* s) {
+    while (1) {
+        int fd = accept4(s->fd, NULL, NULL, SOCK_NONBLOCK|SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno == EINTR) { continue; }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) { perror("accept4"); }
+            break;
+        }
+        source_add(SOURCE_CONNECTION, fd);
+    }
+}
+
+static void
+open_output() {
+    if (output_path == NULL) {
+        out = stdout;
+        return;
+    }
+    FILE* f = fopen(output_path, "a");
+    if (f == NULL) {
+        fprintf(stderr, "failed to open %s for writing\n", output_path);
+        if (out == NULL) { exit(1); }
+        return;
+    }
+    if (out != NULL && fclose(out) == EOF) { perror("fclose"); }
+    out = f;
+}
+
+static void
+on_signal(source_type* s) {
+    struct signalfd_siginfo info;
+    while (read(s->fd, &info, sizeof(info)) == sizeof(info)) {
+        if (info.ssi_signo == SIGHUP) { open_output(); }
+        else { running = 0; }
+    }
+}
+
+static void
+signal_handlers() {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGHUP);
+    sigaddset(&mask, SIGPIPE);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) == -1) {
+        perror("failed to block signals");
+        exit(1);
+    }
+    int fd = signalfd(-1, &mask, SFD_NONBLOCK|SFD_CLOEXEC);
+    if (fd == -1) {
+        perror("failed to create signal file descriptor");
+        exit(1);
+    }
+    source_add(SOURCE_SIGNAL, fd);
+}
+
+static void
+help_message(const char* argv0) {
+    printf("usage: %s [-o file] [-h] address...\n", argv0);
+    fputs("  -o file  append the records to the file instead of the standard output\n", stdout);
+    fputs("  -h       help\n", stdout);
+    fputs("  address  tcp://host:port, udp://host:port or unix:/path to listen on\n", stdout);
+}
+
+int main(int argc, char* argv[]) {
+    int opt = 0;
+    while ((opt = getopt(argc, argv, "o:h")) != -1) {
+        if (opt == 'o') { output_path = optarg; }
+        if (opt == 'h') {
+            help_message(argv[0]);
+            return 0;
+        }
+        if (opt == '?') {
+            help_message(argv[0]);
+            return 1;
+        }
+    }
+    if (optind == argc) {
+        help_message(argv[0]);
+        return 1;
+    }
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd == -1) { perror("epoll_create1"); return 1; }
+    signal_handlers();
+    open_output();
+    for (int i=optind; i<argc; ++i) { listen_on(argv[i]); }
+    struct epoll_event events[64];
+    while (running) {
+        int n = epoll_wait(epoll_fd, events, sizeof(events)/sizeof(struct epoll_event), -1);
+        if (n == -1) {
+            if (errno == EINTR) { continue; }
+            perror("epoll_wait");
+            break;
+        }
+        for (int i=0; i<n && running; ++i) {
+            source_type* s = (source_type*)events[i].data.ptr;
+            switch (s->kind) {
+                case SOURCE_LISTENER: on_listener(s); break;
+                case SOURCE_DATAGRAM: on_datagram(s); break;
+                case SOURCE_CONNECTION: on_connection(s); break;
+                case SOURCE_SIGNAL: on_signal(s); break;
+            }
+        }
+    }
+    if (fflush(out) == EOF) { perror("fflush"); }
+    if (num_bad_frames != 0) {
+        fprintf(stderr, "received %lu frames, discarded %lu malformed frames\n",
+                num_frames, num_bad_frames);
+    }
+    return 0;
+}
@@ -0,0 +1,277 @@
+/*
+Lockstep — log resources consumed by userland Linux processes.
+© 2026 Ivan Gankevich
+
+This file is part of Lockstep.
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef RULES_H
+#define RULES_H
+
+#include <sys/types.h>
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <field.h>
+
+/*
+Threshold rules are evaluated on every tick:
+
+rule = resident_set_size > 64G
+rule = major_faults_per_tick > 1000
+rule = hwmon temp > 90000
+
+A process rule compares the numeric field of the process record or,
+with the _per_tick suffix, the difference between the current and the
+previous tick. A sensor rule compares the value of every hwmon sensor
+which file name starts with the given prefix. The rule fires when the
+condition becomes true: the event record is written and the process
+or the sensor is sampled every watch_interval for watch_duration.
+The rule fires again only after the condition was false on some tick.
+The event records are written to event.output. Without it they are
+sent to syslog only, i.e. syslog.events defaults to true.
+*/
+
+#define MAX_RULES 32
+#define MAX_WATCHES 64
+
+typedef enum {
+    RULE_PROCESS = 0,
+    RULE_HWMON = 1,
+} rule_kind_type;
+
+typedef enum {
+    RULE_GREATER = 0,
+    RULE_GREATER_EQUAL = 1,
+    RULE_LESS = 2,
+    RULE_LESS_EQUAL = 3,
+    RULE_EQUAL = 4,
+    RULE_NOT_EQUAL = 5,
+} rule_operator_type;
+
+typedef struct {
+    // the rule as written in the configuration file
+    char text[128];
+    rule_kind_type kind;
+    // the field name of the process rule or the prefix of the sensor
+    char name[64];
+    const field_type* field;
+    int per_tick;
+    rule_operator_type op;
+    double threshold;
+} rule_type;
+
+typedef struct {
+    // pid is zero for sensors
+    pid_t pid;
+    unsigned long long start_time;
+    char device[32];
+    char sensor[64];
+    // monotonic time in microseconds
+    uint64_t until;
+} watch_type;
+
+typedef struct {
+    char path[96];
+    uint32_t fired;
+} rule_sensor_type;
+
+static rule_type rules[MAX_RULES];
+static int num_rules = 0;
+static int num_process_rules = 0;
+static int num_sensor_rules = 0;
+// in microseconds
+static unsigned long watch_interval = 100000UL;
+static unsigned long watch_duration = 30000000UL;
+static watch_type watches[MAX_WATCHES];
+static int num_watches = 0;
+static unsigned long watch_dropped = 0;
+// the sensors that the rules fired for
+static rule_sensor_type* rule_sensors = NULL;
+static size_t num_rule_sensors = 0;
+static size_t rule_sensors_capacity = 0;
+
+static inline const char*
+rule_skip_space(const char* first, const char* last) {
+    while (first != last && isspace(*first)) { ++first; }
+    return first;
+}
+
+static inline const char*
+rule_token(const char* first, const char* last) {
+    while (first != last && !isspace(*first) && !strchr("<>=!", *first)) { ++first; }
+    return first;
+}
+
+/* Parse the number with optional k, M, G, T suffix. */
+static int
+rule_parse_value(const char* first, const char* last, double* result) {
+    char tmp[64];
+    const size_t n = last-first;
+    if (n == 0 || n >= sizeof(tmp)) { return -1; }
+    memcpy(tmp, first, n);
+    tmp[n] = 0;
+    char* end = NULL;
+    double x = strtod(tmp, &end);
+    if (end == tmp) { return -1; }
+    if (*end == 'k') { x *= 1024.0; ++end; }
+    else if (*end == 'M') { x *= 1024.0*1024.0; ++end; }
+    else if (*end == 'G') { x *= 1024.0*1024.0*1024.0; ++end; }
+    else if (*end == 'T') { x *= 1024.0*1024.0*1024.0*1024.0; ++end; }
+    if (*end != 0) { return -1; }
+    *result = x;
+    return 0;
+}
+
+/*
+Parse "[hwmon] name operator value". The field of the process rule
+is resolved by the caller. Returns -1 on error.
+*/
+static int
+rule_parse(const char* first, const char* last, rule_type* rule) {
+    memset(rule, 0, sizeof(rule_type));
+    const size_t text_size = last-first;
+    if (text_size >= sizeof(rule->text)) { return -1; }
+    memcpy(rule->text, first, text_size);
+    rule->text[text_size] = 0;
+    first = rule_skip_space(first, last);
+    const char* name_last = rule_token(first, last);
+    rule->kind = RULE_PROCESS;
+    if (name_last-first == 5 && strncmp(first, "hwmon", 5) == 0) {
+        rule->kind = RULE_HWMON;
+        first = rule_skip_space(name_last, last);
+        name_last = rule_token(first, last);
+    }
+    const size_t name_size = name_last-first;
+    if (name_size == 0 || name_size >= sizeof(rule->name)) { return -1; }
+    memcpy(rule->name, first, name_size);
+    rule->name[name_size] = 0;
+    static const char suffix[] = "_per_tick";
+    const size_t suffix_size = sizeof(suffix)-1;
+    if (rule->kind == RULE_PROCESS && name_size > suffix_size &&
+        strcmp(rule->name + name_size - suffix_size, suffix) == 0) {
+        rule->per_tick = 1;
+        rule->name[name_size - suffix_size] = 0;
+    }
+    first = rule_skip_space(name_last, last);
+    const char* op_last = first;
+    while (op_last != last && strchr("<>=!", *op_last)) { ++op_last; }
+    const size_t op_size = op_last-first;
+    if (op_size == 1 && *first == '>') { rule->op = RULE_GREATER; }
+    else if (op_size == 2 && strncmp(first, ">=", 2) == 0) { rule->op = RULE_GREATER_EQUAL; }
+    else if (op_size == 1 && *first == '<') { rule->op = RULE_LESS; }
+    else if (op_size == 2 && strncmp(first, "<=", 2) == 0) { rule->op = RULE_LESS_EQUAL; }
+    else if (op_size == 2 && strncmp(first, "==", 2) == 0) { rule->op = RULE_EQUAL; }
+    else if (op_size == 2 && strncmp(first, "!=", 2) == 0) { rule->op = RULE_NOT_EQUAL; }
+    else { return -1; }
+    first = rule_skip_space(op_last, last);
+    return rule_parse_value(first, last, &rule->threshold);
+}
+
+static inline int
+rule_matches(const rule_type* rule, double x) {
+    switch (rule->op) {
+        case RULE_GREATER: return x > rule->threshold;
+        case RULE_GREATER_EQUAL: return x >= rule->threshold;
+        case RULE_LESS: return x < rule->threshold;
+        case RULE_LESS_EQUAL: return x <= rule->threshold;
+        case RULE_EQUAL: return x == rule->threshold;
+        case RULE_NOT_EQUAL: return x != rule->threshold;
+    }
+    return 0;
+}
+
+/* Returns the bit mask of the rules that fired for the sensor. */
+static uint32_t*
+rule_sensor_fired(const char* device, const char* sensor) {
+    char path[sizeof(((rule_sensor_type*)0)->path)];
+    snprintf(path, sizeof(path), "%s/%s", device, sensor);
+    for (size_t i=0; i<num_rule_sensors; ++i) {
+        if (strcmp(rule_sensors[i].path, path) == 0) { return &rule_sensors[i].fired; }
+    }
+    if (num_rule_sensors == rule_sensors_capacity) {
+        rule_sensors_capacity = rule_sensors_capacity == 0 ? 16 : 2*rule_sensors_capacity;
+        rule_sensors = realloc(rule_sensors, rule_sensors_capacity*sizeof(rule_sensor_type));
+        if (rule_sensors == NULL) { perror("realloc"); exit(1); }
+    }
+    rule_sensor_type* s = rule_sensors + num_rule_sensors++;
+    memcpy(s->path, path, sizeof(path));
+    s->fired = 0;
+    return &s->fired;
+}
+
+/*
+Start watching the process (device is NULL) or the sensor until the
+given time, the existing watch is extended. Returns -1 if there are too
+many watches.
+*/
+static int
+watch_add(pid_t pid, unsigned long long start_time,
+          const char* device, const char* sensor, uint64_t until) {
+    for (int i=0; i<num_watches; ++i) {
+        watch_type* w = watches + i;
+        int same = device == NULL
+            ? (w->pid == pid && w->start_time == start_time)
+            : (w->pid == 0 && strcmp(w->device, device) == 0 &&
+               strcmp(w->sensor, sensor) == 0);
+        if (same) {
+            if (w->until < until) { w->until = until; }
+            return 0;
+        }
+    }
+    if (num_watches == MAX_WATCHES) {
+        ++watch_dropped;
+        return -1;
+    }
+    watch_type* w = watches + num_watches++;
+    memset(w, 0, sizeof(watch_type));
+    w->pid = device == NULL ? pid : 0;
+    w->start_time = start_time;
+    if (device != NULL) {
+        snprintf(w->device, sizeof(w->device), "%s", device);
+        snprintf(w->sensor, sizeof(w->sensor), "%s", sensor);
+    }
+    w->until = until;
+    return 0;
+}
+
+/* Remove the watches that ended before now. */
+static void
+watch_expire(uint64_t now) {
+    int n = 0;
+    for (int i=0; i<num_watches; ++i) {
+        if (watches[i].until > now) { watches[n++] = watches[i]; }
+    }
+    num_watches = n;
+}
+
+#endif // vim:filetype=c
@@ -0,0 +1,187 @@
+/*
+Lockstep — log resources consumed by userland Linux processes.
+© 2026 Ivan Gankevich
+
+This file is part of Lockstep.
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef SEGMENT_H
+#define SEGMENT_H
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <field.h>
+
+/*
+Columnar segment files.
+
+A segment contains process records of one hour. It starts with the header
+that describes the columns, continues with blocks of at most
+SEGMENT_MAX_ROWS rows each and ends with the footer that indexes the
+blocks and the trailer that points to the footer.
+
+header:  "LSS1" version:u32 ncolumns:u32 {type:u8 name_size:u8 name}...
+block:   "LSB1" segment_block_header_type segment_column_header_type[ncolumns]
+         column data...
+footer:  "LSF1" nblocks:u32 segment_block_header_type
+         segment_column_header_type[ncolumns] block_offset:u64[nblocks]
+trailer: footer_offset:u64 "LSFE"
+
+Numeric columns are stored as zigzag-encoded varint deltas of consecutive
+values. Floating-point values are stored as fixed-point numbers with six
+decimal digits (the precision of the text output). String columns are
+stored as a dictionary of the block followed by varint indices.
+Integers are stored in the byte order of the host.
+
+Files without the trailer are still being written; their blocks can be
+read sequentially from the header.
+*/
+
+#define SEGMENT_VERSION 1
+#define SEGMENT_MAX_ROWS 16384
+#define SEGMENT_MAX_COLUMNS 256
+
+static const char segment_magic[4] = {'L','S','S','1'};
+static const char segment_block_magic[4] = {'L','S','B','1'};
+static const char segment_footer_magic[4] = {'L','S','F','1'};
+static const char segment_trailer_magic[4] = {'L','S','F','E'};
+
+typedef enum {
+    SEGMENT_SIGNED = 0,
+    SEGMENT_UNSIGNED = 1,
+    SEGMENT_FIXED = 2,
+    SEGMENT_STRING = 3,
+} segment_column_type;
+
+typedef struct {
+    uint32_t nrows;
+    uint32_t ncolumns;
+    int64_t min_timestamp;
+    int64_t max_timestamp;
+    int64_t min_pid;
+    int64_t max_pid;
+} segment_block_header_type;
+
+typedef struct {
+    // the size of the encoded column in bytes
+    uint64_t size;
+    // the minimum and the maximum values, zero for strings
+    uint64_t min;
+    uint64_t max;
+} segment_column_header_type;
+
+typedef struct {
+    uint64_t footer_offset;
+    char magic[4];
+} segment_trailer_type;
+
+static inline segment_column_type
+segment_column_type_of(field_format_type format) {
+    switch (format) {
+        case FIELD_INT:
+        case FIELD_LONG:
+            return SEGMENT_SIGNED;
+        case FIELD_CHAR:
+        case FIELD_UNSIGNED_INT:
+        case FIELD_UNSIGNED_LONG:
+        case FIELD_UNSIGNED_LONG_LONG:
+            return SEGMENT_UNSIGNED;
+        case FIELD_DOUBLE:
+            return SEGMENT_FIXED;
+        case FIELD_STRING:
+        case FIELD_STRING_ID:
+            return SEGMENT_STRING;
+    }
+    return SEGMENT_UNSIGNED;
+}
+
+/* Read the numeric value of the field in the representation of the column. */
+static inline uint64_t
+segment_value(const void* object, const field_type* field) {
+    const void* ptr = ((const char*)object) + field->offset;
+    switch (field->format) {
+        case FIELD_CHAR: return (unsigned char)*((const char*)ptr);
+        case FIELD_INT: return (uint64_t)(int64_t)*((const int*)ptr);
+        case FIELD_UNSIGNED_INT: return *((const unsigned int*)ptr);
+        case FIELD_LONG: return (uint64_t)(int64_t)*((const long*)ptr);
+        case FIELD_UNSIGNED_LONG: return *((const unsigned long*)ptr);
+        case FIELD_UNSIGNED_LONG_LONG: return *((const unsigned long long*)ptr);
+        case FIELD_DOUBLE: return (uint64_t)llround(*((const double*)ptr)*1e6);
+        case FIELD_STRING:
+        case FIELD_STRING_ID:
+            return 0;
+    }
+    return 0;
+}
+
+static inline int
+segment_less(segment_column_type type, uint64_t a, uint64_t b) {
+    if (type == SEGMENT_UNSIGNED) { return a < b; }
+    return (int64_t)a < (int64_t)b;
+}
+
+static inline uint64_t
+segment_zigzag(int64_t x) {
+    return ((uint64_t)x << 1) ^ (uint64_t)(x >> 63);
+}
+
+static inline int64_t
+segment_unzigzag(uint64_t x) {
+    return (int64_t)(x >> 1) ^ -(int64_t)(x & 1);
+}
+
+static inline uint8_t*
+segment_put_varint(uint8_t* first, uint64_t x) {
+    while (x >= 0x80) {
+        *first++ = (uint8_t)(x | 0x80);
+        x >>= 7;
+    }
+    *first++ = (uint8_t)x;
+    return first;
+}
+
+/* Returns NULL if the varint is truncated. */
+static inline const uint8_t*
+segment_get_varint(const uint8_t* first, const uint8_t* last, uint64_t* result) {
+    uint64_t x = 0;
+    int shift = 0;
+    while (first != last && shift < 64) {
+        const uint8_t byte = *first++;
+        x |= ((uint64_t)(byte & 0x7f)) << shift;
+        if ((byte & 0x80) == 0) {
+            *result = x;
+            return first;
+        }
+        shift += 7;
+    }
+    return NULL;
+}
+
+#endif // vim:filetype=c
@@ -0,0 +1,352 @@
+/*
+Lockstep — log resources consumed by userland Linux processes.
+© 2026 Ivan Gankevich
+
+This file is part of Lockstep.
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef SEGMENT_WRITER_H
+#define SEGMENT_WRITER_H
+
+#include <intern.h>
+#include <segment.h>
+#include <writer.h>
+
+/*
+Accumulates process records in columns and writes them as blocks
+of hourly segment files (see segment.h) through the writer thread.
+*/
+
+typedef struct {
+    const field_type* field;
+    segment_column_type type;
+    // numeric values or indices into the dictionary
+    uint64_t* values;
+    uint64_t min;
+    uint64_t max;
+    uint64_t file_min;
+    uint64_t file_max;
+    // the dictionary of the strings of the current block
+    char** strings;
+    uint32_t num_strings;
+    uint32_t* string_table;
+    uint32_t string_table_capacity;
+} segment_column_writer_type;
+
+static char segment_directory[PATH_MAX] = {0};
+static segment_column_writer_type segment_columns[SEGMENT_MAX_COLUMNS];
+static size_t segment_ncolumns = 0;
+static size_t segment_nrows = 0;
+static segment_block_header_type segment_block;
+static segment_block_header_type segment_file;
+static output_type* segment_output = NULL;
+static writer_buffer_type* segment_buffer = NULL;
+static time_t segment_hour = 0;
+static uint64_t segment_offset = 0;
+static uint64_t* segment_block_offsets = NULL;
+static uint32_t segment_nblocks = 0;
+static uint32_t segment_block_offsets_capacity = 0;
+static int segment_header_pending = 0;
+static unsigned long segment_dropped_blocks = 0;
+
+static uint32_t
+segment_hash(const char* str) {
+    // FNV-1a
+    uint32_t h = 2166136261U;
+    while (*str) { h ^= (unsigned char)*str++; h *= 16777619U; }
+    return h;
+}
+
+static void
+segment_add_column(const field_type* field) {
+    for (size_t i=0; i<segment_ncolumns; ++i) {
+        if (segment_columns[i].field == field) { return; }
+    }
+    if (segment_ncolumns == SEGMENT_MAX_COLUMNS) { return; }
+    segment_column_writer_type* c = segment_columns + segment_ncolumns++;
+    memset(c, 0, sizeof(segment_column_writer_type));
+    c->field = field;
+    c->type = segment_column_type_of(field->format);
+    c->values = malloc(SEGMENT_MAX_ROWS*sizeof(uint64_t));
+    if (c->values == NULL) { perror("malloc"); exit(1); }
+    if (c->type == SEGMENT_STRING) {
+        c->strings = malloc(SEGMENT_MAX_ROWS*sizeof(char*));
+        c->string_table_capacity = 2*SEGMENT_MAX_ROWS;
+        c->string_table = calloc(c->string_table_capacity, sizeof(uint32_t));
+        if (c->strings == NULL || c->string_table == NULL) { perror("malloc"); exit(1); }
+    }
+}
+
+static void
+segment_reset_stats(segment_block_header_type* h) {
+    h->nrows = 0;
+    h->ncolumns = (uint32_t)segment_ncolumns;
+    h->min_timestamp = INT64_MAX;
+    h->max_timestamp = INT64_MIN;
+    h->min_pid = INT64_MAX;
+    h->max_pid = INT64_MIN;
+}
+
+static void
+segment_update_stats(segment_block_header_type* h, int64_t timestamp, int64_t pid) {
+    if (timestamp < h->min_timestamp) { h->min_timestamp = timestamp; }
+    if (timestamp > h->max_timestamp) { h->max_timestamp = timestamp; }
+    if (pid < h->min_pid) { h->min_pid = pid; }
+    if (pid > h->max_pid) { h->max_pid = pid; }
+}
+
+static void
+segment_append(const void* data, size_t n) {
+    if (segment_buffer == NULL) { return; }
+    output_write(segment_buffer, (const char*)data, n);
+    segment_offset += n;
+}
+
+static void
+segment_open(time_t timestamp) {
+    segment_hour = timestamp - timestamp%3600;
+    char path[sizeof(segment_directory) + 64];
+    char name[32];
+    struct tm tm;
+    gmtime_r(&segment_hour, &tm);
+    strftime(name, sizeof(name), "%Y%m%dT%H0000Z", &tm);
+    snprintf(path, sizeof(path), "%s/%s.lss", segment_directory, name);
+    for (int i=1; access(path, F_OK) == 0; ++i) {
+        snprintf(path, sizeof(path), "%s/%s.%d.lss", segment_directory, name, i);
+    }
+    segment_output = calloc(1, sizeof(output_type));
+    if (segment_output == NULL) { perror("calloc"); exit(1); }
+    segment_output->fd = open(path, O_CREAT|O_EXCL|O_WRONLY|O_CLOEXEC, 0644);
+    if (segment_output->fd == -1) {
+        fprintf(stderr, "failed to open %s for writing\n", path);
+        free(segment_output);
+        segment_output = NULL;
+        return;
+    }
+    segment_offset = 0;
+    segment_nblocks = 0;
+    segment_reset_stats(&segment_file);
+    for (size_t i=0; i<segment_ncolumns; ++i) {
+        segment_column_writer_type* c = segment_columns + i;
+        c->file_min = c->type == SEGMENT_UNSIGNED ? UINT64_MAX : (uint64_t)INT64_MAX;
+        c->file_max = c->type == SEGMENT_UNSIGNED ? 0 : (uint64_t)INT64_MIN;
+    }
+    segment_header_pending = 1;
+}
+
+/* The header is written together with the first block. */
+static void
+segment_write_header() {
+    uint32_t version = SEGMENT_VERSION;
+    uint32_t ncolumns = (uint32_t)segment_ncolumns;
+    segment_append(segment_magic, sizeof(segment_magic));
+    segment_append(&version, sizeof(version));
+    segment_append(&ncolumns, sizeof(ncolumns));
+    for (size_t i=0; i<segment_ncolumns; ++i) {
+        const field_type* field = segment_columns[i].field;
+        uint8_t type = (uint8_t)segment_columns[i].type;
+        uint8_t name_size = (uint8_t)strlen(field->name);
+        segment_append(&type, sizeof(type));
+        segment_append(&name_size, sizeof(name_size));
+        segment_append(field->name, name_size);
+    }
+    segment_header_pending = 0;
+}
+
+static uint32_t
+segment_intern(segment_column_writer_type* c, const char* str) {
+    const uint32_t mask = c->string_table_capacity-1;
+    uint32_t i = segment_hash(str) & mask;
+    while (c->string_table[i] != 0) {
+        const uint32_t index = c->string_table[i]-1;
+        if (strcmp(c->strings[index], str) == 0) { return index; }
+        i = (i+1) & mask;
+    }
+    char* copy = strdup(str);
+    if (copy == NULL) { perror("strdup"); exit(1); }
+    c->strings[c->num_strings] = copy;
+    c->string_table[i] = ++c->num_strings;
+    return c->num_strings-1;
+}
+
+static size_t
+segment_encode_column(segment_column_writer_type* c, uint8_t* first) {
+    uint8_t* begin = first;
+    if (c->type == SEGMENT_STRING) {
+        first = segment_put_varint(first, c->num_strings);
+        for (uint32_t i=0; i<c->num_strings; ++i) {
+            const size_t n = strlen(c->strings[i]);
+            first = segment_put_varint(first, n);
+            memcpy(first, c->strings[i], n);
+            first += n;
+        }
+        for (size_t i=0; i<segment_nrows; ++i) {
+            first = segment_put_varint(first, c->values[i]);
+        }
+    } else {
+        uint64_t previous = 0;
+        for (size_t i=0; i<segment_nrows; ++i) {
+            first = segment_put_varint(first, segment_zigzag((int64_t)(c->values[i] - previous)));
+            previous = c->values[i];
+        }
+    }
+    return first-begin;
+}
+
+static size_t
+segment_column_capacity(const segment_column_writer_type* c) {
+    size_t n = segment_nrows*10 + 10;
+    if (c->type == SEGMENT_STRING) {
+        for (uint32_t i=0; i<c->num_strings; ++i) { n += strlen(c->strings[i]) + 10; }
+    }
+    return n;
+}
+
+static void
+segment_flush_block() {
+    if (segment_nrows == 0) { return; }
+    if (segment_buffer == NULL && segment_output != NULL) {
+        segment_buffer = output_buffer(segment_output, &segment_buffer, segment_block.max_timestamp);
+    }
+    if (segment_buffer != NULL) {
+        if (segment_header_pending) { segment_write_header(); }
+        // the block is encoded directly into the buffer of the writer thread
+        const size_t header_size = 4 + sizeof(segment_block_header_type) +
+            segment_ncolumns*sizeof(segment_column_header_type);
+        size_t capacity = header_size;
+        for (size_t i=0; i<segment_ncolumns; ++i) {
+            capacity += segment_column_capacity(segment_columns + i);
+        }
+        output_reserve(segment_buffer, capacity);
+        if (segment_nblocks == segment_block_offsets_capacity) {
+            segment_block_offsets_capacity = segment_nblocks == 0 ? 64 : 2*segment_nblocks;
+            segment_block_offsets = realloc(segment_block_offsets,
+                segment_block_offsets_capacity*sizeof(uint64_t));
+            if (segment_block_offsets == NULL) { perror("realloc"); exit(1); }
+        }
+        segment_block_offsets[segment_nblocks++] = segment_offset;
+        uint8_t* block = (uint8_t*)segment_buffer->data + segment_buffer->size;
+        uint8_t* first = block + header_size;
+        segment_block.nrows = (uint32_t)segment_nrows;
+        memcpy(block, segment_block_magic, 4);
+        memcpy(block + 4, &segment_block, sizeof(segment_block_header_type));
+        uint8_t* column_headers = block + 4 + sizeof(segment_block_header_type);
+        for (size_t i=0; i<segment_ncolumns; ++i) {
+            segment_column_writer_type* c = segment_columns + i;
+            segment_column_header_type h;
+            h.size = segment_encode_column(c, first);
+            h.min = c->type == SEGMENT_STRING ? 0 : c->min;
+            h.max = c->type == SEGMENT_STRING ? 0 : c->max;
+            memcpy(column_headers + i*sizeof(h), &h, sizeof(h));
+            first += h.size;
+            if (c->type != SEGMENT_STRING) {
+                if (segment_less(c->type, c->min, c->file_min)) { c->file_min = c->min; }
+                if (segment_less(c->type, c->file_max, c->max)) { c->file_max = c->max; }
+            }
+        }
+        const size_t n = first-block;
+        segment_buffer->size += n;
+        segment_offset += n;
+        segment_file.nrows += segment_block.nrows;
+        segment_update_stats(&segment_file, segment_block.min_timestamp, segment_block.min_pid);
+        segment_update_stats(&segment_file, segment_block.max_timestamp, segment_block.max_pid);
+        output_flush(&segment_buffer);
+    } else {
+        ++segment_dropped_blocks;
+    }
+    for (size_t i=0; i<segment_ncolumns; ++i) {
+        segment_column_writer_type* c = segment_columns + i;
+        if (c->type == SEGMENT_STRING) {
+            for (uint32_t j=0; j<c->num_strings; ++j) { free(c->strings[j]); }
+            c->num_strings = 0;
+            memset(c->string_table, 0, c->string_table_capacity*sizeof(uint32_t));
+        }
+    }
+    segment_nrows = 0;
+}
+
+static void
+segment_close() {
+    if (segment_output == NULL) { return; }
+    segment_flush_block();
+    // the previous blocks may still be in the queue, wait for the writer
+    // thread to close the file
+    segment_buffer = output_acquire(segment_output, &segment_buffer,
+                                    segment_file.max_timestamp, WRITER_BLOCK);
+    if (segment_header_pending) { segment_write_header(); }
+    const uint64_t footer_offset = segment_offset;
+    segment_file.ncolumns = (uint32_t)segment_ncolumns;
+    segment_append(segment_footer_magic, 4);
+    segment_append(&segment_nblocks, sizeof(segment_nblocks));
+    segment_append(&segment_file, sizeof(segment_file));
+    for (size_t i=0; i<segment_ncolumns; ++i) {
+        segment_column_writer_type* c = segment_columns + i;
+        segment_column_header_type h = {0, 0, 0};
+        if (c->type != SEGMENT_STRING) {
+            h.min = c->file_min;
+            h.max = c->file_max;
+        }
+        segment_append(&h, sizeof(h));
+    }
+    segment_append(segment_block_offsets, segment_nblocks*sizeof(uint64_t));
+    segment_trailer_type trailer;
+    trailer.footer_offset = footer_offset;
+    memcpy(trailer.magic, segment_trailer_magic, 4);
+    segment_append(&trailer, sizeof(trailer));
+    segment_buffer->close_output = 1;
+    output_flush(&segment_buffer);
+    segment_output = NULL;
+}
+
+static void
+segment_add(const void* step, time_t timestamp, int64_t pid) {
+    if (segment_output != NULL && timestamp - timestamp%3600 != segment_hour) {
+        segment_close();
+    }
+    if (segment_output == NULL) {
+        segment_open(timestamp);
+        if (segment_output == NULL) { return; }
+    }
+    if (segment_nrows == 0) { segment_reset_stats(&segment_block); }
+    for (size_t i=0; i<segment_ncolumns; ++i) {
+        segment_column_writer_type* c = segment_columns + i;
+        uint64_t value;
+        if (c->type == SEGMENT_STRING) {
+            value = segment_intern(c, field_string(step, c->field));
+        } else {
+            value = segment_value(step, c->field);
+            if (segment_nrows == 0 || segment_less(c->type, value, c->min)) { c->min = value; }
+            if (segment_nrows == 0 || segment_less(c->type, c->max, value)) { c->max = value; }
+        }
+        c->values[segment_nrows] = value;
+    }
+    segment_update_stats(&segment_block, timestamp, pid);
+    if (++segment_nrows == SEGMENT_MAX_ROWS) { segment_flush_block(); }
+}
+
+#endif // vim:filetype=c
@@ -0,0 +1,100 @@
+/*
+Lockstep — log resources consumed by userland Linux processes.
+© 2026 Ivan Gankevich
+
+This file is part of Lockstep.
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef SMAPS_STEP_H
+#define SMAPS_STEP_H
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <parse.h>
+#include <process_table.h>
+#include <step.h>
+
+/*
+Proportional memory from /proc/<pid>/smaps_rollup. The kernel walks the page
+tables of the process to produce the file, so it is read at most once per
+smaps_interval and for at most smaps_budget processes per tick. On the other
+ticks the previous values are carried forward and smaps_age tells how old
+they are. When the budget runs out, the next tick reads only the processes
+whose values are at least as old as the newest skipped one, so that every
+process is read regardless of the order of the scan.
+*/
+
+// in microseconds
+static uint64_t smaps_interval = 30000000UL;
+static unsigned long smaps_budget = 32;
+static unsigned long smaps_budget_left = 0;
+// only the due processes read no later than this are read on this tick
+static uint64_t smaps_threshold = UINT64_MAX;
+static uint64_t smaps_next_threshold = UINT64_MAX;
+
+static void
+smaps_tick_begin() {
+    smaps_threshold = smaps_next_threshold;
+    smaps_next_threshold = UINT64_MAX;
+    smaps_budget_left = smaps_budget;
+}
+
+static void
+read_smaps_rollup(int process_dir_fd, process_state_type* p, uint64_t now) {
+    char buf[4096];
+    p->smaps_time = now;
+    int fd = openat(process_dir_fd, "smaps_rollup", O_RDONLY|O_CLOEXEC);
+    // kernel threads and the processes of other users without the privileges
+    if (fd == -1) { return; }
+    ssize_t n = read(fd, buf, sizeof(buf));
+    close(fd);
+    if (n == -1) { return; }
+    parse_smaps_rollup(buf, buf + n, &p->smaps);
+    p->smaps_read_time = now;
+}
+
+/* Read smaps_rollup if it is due and the budget allows, otherwise carry the values forward. */
+static void
+collect_smaps(int process_dir_fd, process_state_type* p, int regular_tick, uint64_t now,
+              step_type* s) {
+    if (regular_tick && (p->smaps_time == 0 || now - p->smaps_time >= smaps_interval)) {
+        if (smaps_budget_left != 0 && p->smaps_time <= smaps_threshold) {
+            --smaps_budget_left;
+            read_smaps_rollup(process_dir_fd, p, now);
+        } else if (smaps_next_threshold == UINT64_MAX || p->smaps_time > smaps_next_threshold) {
+            smaps_next_threshold = p->smaps_time;
+        }
+    }
+    s->smaps = p->smaps;
+    s->smaps.age = p->smaps_read_time == 0 ? -1 : (long)(now - p->smaps_read_time);
+}
+
+#endif // vim:filetype=c
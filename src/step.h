@@ -35,6 +35,8 @@ For more information, please refer to <http://unlicense.org/>
 
 #include "config.h"
 
+#include <intern.h>
+
 typedef struct {
 	unsigned long int in_octets;
 	unsigned long int out_octets;
@@ -46,6 +48,54 @@ typedef struct {
 	unsigned long int cancelled_write_bytes;
 } io_step_t;
 
+typedef struct {
+	unsigned long long int run_time_ns;
+	unsigned long long int run_queue_wait_ns;
+	unsigned long long int timeslices;
+} schedstat_step_t;
+
+typedef struct {
+	unsigned long long int pss;
+	unsigned long long int pss_anon;
+	unsigned long long int pss_shmem;
+	unsigned long long int uss;
+	unsigned long long int swap_pss;
+	// microseconds since the values were read, -1 if they were never read
+	long int age;
+} smaps_step_t;
+
+typedef struct {
+	// the node of the processor, -1 if unknown
+	int node;
+	// N<node>=<bytes> of the nodes with resident pages
+	intern_id memory;
+	double local_percent;
+	// microseconds since numa_maps was read, -1 if it was never read
+	long int age;
+} numa_step_t;
+
+// the maximum number of env:NAME fields
+#define MAX_ENV_FIELDS 8
+
+// the pages on the nodes with larger numbers are not counted
+#define MAX_NUMA_NODES 16
+
+typedef struct {
+	unsigned long int clients;
+	unsigned long long int engine_ns;
+	unsigned long long int memory_vram;
+	unsigned long long int memory_gtt;
+} drm_step_t;
+
+#if defined(LOCKSTEP_WITH_NVML)
+typedef struct {
+	unsigned int gpu_utilisation;
+	unsigned int memory_utilization;
+	unsigned long long max_memory_usage;
+	unsigned long long time_ms;
+} nvml_step_t;
+#endif
+
 typedef struct {
 	int process_id;
 	char state;
@@ -63,12 +113,12 @@ typedef struct {
 	unsigned long int kernel_time;
 	long int child_userspace_time;
 	long int child_kernel_time;
-	long int priority;
-	long int nice;
-	long int num_threads;
-	long int unused;
-	//unsigned long long int start_time;
-	char start_time[21];
+	// the kernel prints these as long but their values fit in int
+	int priority;
+	int nice;
+	int num_threads;
+	int unused;
+	unsigned long long int start_time;
 	unsigned long int virtual_memory_size;
 	long int resident_set_size;
 	unsigned long int resident_set_limit;
@@ -101,18 +151,138 @@ typedef struct {
 	int exit_code;
 	uid_t user_id;
 	gid_t group_id;
+	intern_id command;
+	intern_id executable;
+	intern_id cmdline;
+	intern_id cgroup;
+	intern_id cgroup_tag;
+	intern_id env[MAX_ENV_FIELDS];
+	// the reason of the sample between the ticks (see main.c burst_start)
+	intern_id burst;
 	double uptime;
 	double idle_time;
 	long ticks_per_second;
 	time_t timestamp;
-	char command[4096];
-	char executable[4096];
+	unsigned long interval;
 	io_step_t io;
 	network_step_t network;
+	drm_step_t drm;
+	schedstat_step_t sched;
+	smaps_step_t smaps;
+	numa_step_t numa;
+	// the rates since the previous sample (see top.h)
+	double cpu_percent;
+	double io_rate;
+	double run_queue_wait_percent;
 	#if defined(LOCKSTEP_WITH_NVML)
 	nvml_step_t nvml;
 	#endif
 } step_type;
 
+/*
+The list of process fields: the name, the format and the member of step_type.
+*/
+#define STEP_FIELDS(X) \
+	X(pid, FIELD_INT, process_id) \
+	X(state, FIELD_CHAR, state) \
+	X(ppid, FIELD_INT, parent_process_id) \
+	X(pgrp, FIELD_INT, process_group_id) \
+	X(session, FIELD_INT, session_id) \
+	X(tty_number, FIELD_INT, tty_number) \
+	X(tty_process_group_id, FIELD_INT, tty_process_group_id) \
+	X(flags, FIELD_UNSIGNED_INT, flags) \
+	X(minor_faults, FIELD_UNSIGNED_LONG, minor_faults) \
+	X(child_minor_faults, FIELD_UNSIGNED_LONG, child_minor_faults) \
+	X(major_faults, FIELD_UNSIGNED_LONG, major_faults) \
+	X(child_major_faults, FIELD_UNSIGNED_LONG, child_major_faults) \
+	X(userspace_time, FIELD_UNSIGNED_LONG, userspace_time) \
+	X(kernel_time, FIELD_UNSIGNED_LONG, kernel_time) \
+	X(child_userspace_time, FIELD_LONG, child_userspace_time) \
+	X(child_kernel_time, FIELD_LONG, child_kernel_time) \
+	X(priority, FIELD_INT, priority) \
+	X(nice, FIELD_INT, nice) \
+	X(num_threads, FIELD_INT, num_threads) \
+	X(itrealvalue, FIELD_INT, unused) \
+	X(start_time, FIELD_UNSIGNED_LONG_LONG, start_time) \
+	X(virtual_memory_size, FIELD_UNSIGNED_LONG, virtual_memory_size) \
+	X(resident_set_size, FIELD_LONG, resident_set_size) \
+	X(resident_set_limit, FIELD_UNSIGNED_LONG, resident_set_limit) \
+	X(code_segment_start, FIELD_UNSIGNED_LONG, code_segment_start) \
+	X(code_segment_end, FIELD_UNSIGNED_LONG, code_segment_end) \
+	X(stack_start, FIELD_UNSIGNED_LONG, stack_start) \
+	X(stack_pointer, FIELD_UNSIGNED_LONG, stack_pointer) \
+	X(instruction_pointer, FIELD_UNSIGNED_LONG, instruction_pointer) \
+	X(signals, FIELD_UNSIGNED_LONG, signals) \
+	X(blocked_signals, FIELD_UNSIGNED_LONG, blocked_signals) \
+	X(ignored_signal, FIELD_UNSIGNED_LONG, ignored_signal) \
+	X(caught_signal, FIELD_UNSIGNED_LONG, caught_signal) \
+	X(wait_channel, FIELD_UNSIGNED_LONG, wait_channel) \
+	X(num_swapped_pages, FIELD_UNSIGNED_LONG, num_swapped_pages) \
+	X(children_num_swapped_pages, FIELD_UNSIGNED_LONG, children_num_swapped_pages) \
+	X(exit_signal, FIELD_INT, exit_signal) \
+	X(processor, FIELD_INT, processor) \
+	X(realtime_priority, FIELD_UNSIGNED_INT, realtime_priority) \
+	X(policy, FIELD_UNSIGNED_INT, policy) \
+	X(cumulative_block_input_output_delay, FIELD_UNSIGNED_LONG_LONG, cumulative_block_input_output_delay) \
+	X(guest_time, FIELD_UNSIGNED_LONG, guest_time) \
+	X(child_guest_time, FIELD_LONG, child_guest_time) \
+	X(data_start, FIELD_UNSIGNED_LONG, data_start) \
+	X(data_end, FIELD_UNSIGNED_LONG, data_end) \
+	X(brk_start, FIELD_UNSIGNED_LONG, brk_start) \
+	X(arg_start, FIELD_UNSIGNED_LONG, arg_start) \
+	X(arg_end, FIELD_UNSIGNED_LONG, arg_end) \
+	X(env_start, FIELD_UNSIGNED_LONG, env_start) \
+	X(env_end, FIELD_UNSIGNED_LONG, env_end) \
+	X(exit_code, FIELD_INT, exit_code) \
+	X(user, FIELD_UNSIGNED_INT, user_id) \
+	X(group, FIELD_UNSIGNED_INT, group_id) \
+	X(uptime, FIELD_DOUBLE, uptime) \
+	X(idle_time, FIELD_DOUBLE, idle_time) \
+	X(timestamp, FIELD_LONG, timestamp) \
+	X(ticks_per_second, FIELD_LONG, ticks_per_second) \
+	X(interval, FIELD_UNSIGNED_LONG, interval) \
+	X(command, FIELD_STRING_ID, command) \
+	X(executable, FIELD_STRING_ID, executable) \
+	X(cmdline, FIELD_STRING_ID, cmdline) \
+	X(cgroup, FIELD_STRING_ID, cgroup) \
+	X(cgroup_tag, FIELD_STRING_ID, cgroup_tag) \
+	X(burst, FIELD_STRING_ID, burst) \
+	X(read_bytes, FIELD_UNSIGNED_LONG, io.read_bytes) \
+	X(write_bytes, FIELD_UNSIGNED_LONG, io.write_bytes) \
+	X(cancelled_write_bytes, FIELD_UNSIGNED_LONG, io.cancelled_write_bytes) \
+	X(in_octets, FIELD_UNSIGNED_LONG, network.in_octets) \
+	X(out_octets, FIELD_UNSIGNED_LONG, network.out_octets) \
+	X(drm_clients, FIELD_UNSIGNED_LONG, drm.clients) \
+	X(drm_engine_ns, FIELD_UNSIGNED_LONG_LONG, drm.engine_ns) \
+	X(drm_memory_vram, FIELD_UNSIGNED_LONG_LONG, drm.memory_vram) \
+	X(drm_memory_gtt, FIELD_UNSIGNED_LONG_LONG, drm.memory_gtt) \
+	X(run_time_ns, FIELD_UNSIGNED_LONG_LONG, sched.run_time_ns) \
+	X(run_queue_wait_ns, FIELD_UNSIGNED_LONG_LONG, sched.run_queue_wait_ns) \
+	X(timeslices, FIELD_UNSIGNED_LONG_LONG, sched.timeslices) \
+	X(pss, FIELD_UNSIGNED_LONG_LONG, smaps.pss) \
+	X(pss_anon, FIELD_UNSIGNED_LONG_LONG, smaps.pss_anon) \
+	X(pss_shmem, FIELD_UNSIGNED_LONG_LONG, smaps.pss_shmem) \
+	X(uss, FIELD_UNSIGNED_LONG_LONG, smaps.uss) \
+	X(swap_pss, FIELD_UNSIGNED_LONG_LONG, smaps.swap_pss) \
+	X(smaps_age, FIELD_LONG, smaps.age) \
+	X(numa_node, FIELD_INT, numa.node) \
+	X(numa_memory, FIELD_STRING_ID, numa.memory) \
+	X(numa_local_percent, FIELD_DOUBLE, numa.local_percent) \
+	X(numa_age, FIELD_LONG, numa.age) \
+	X(cpu_percent, FIELD_DOUBLE, cpu_percent) \
+	X(io_rate, FIELD_DOUBLE, io_rate) \
+	X(run_queue_wait_percent, FIELD_DOUBLE, run_queue_wait_percent) \
+	STEP_NVML_FIELDS(X)
+
+#if defined(LOCKSTEP_WITH_NVML)
+#define STEP_NVML_FIELDS(X) \
+	X(nvml_gpu_utilisation, FIELD_UNSIGNED_INT, nvml.gpu_utilisation) \
+	X(nvml_memory_utilisation, FIELD_UNSIGNED_INT, nvml.memory_utilization) \
+	X(nvml_max_memory_usage, FIELD_UNSIGNED_LONG_LONG, nvml.max_memory_usage) \
+	X(nvml_time_ms, FIELD_UNSIGNED_LONG_LONG, nvml.time_ms)
+#else
+#define STEP_NVML_FIELDS(X)
+#endif
+
 
 #endif // vim:filetype=c
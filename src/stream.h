@@ -0,0 +1,141 @@
+/*
+Lockstep — log resources consumed by userland Linux processes.
+© 2026 Ivan Gankevich
+
+This file is part of Lockstep.
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <segment.h>
+
+/*
+Binary stream of process records.
+
+Every frame is self-contained, so that frames can be sent as UDP
+datagrams, spooled to disk and replayed in any connection:
+
+frame:  "LSN1" size:u32 nrows:u32 ncolumns:u32 host_size:u8 host
+        {type:u8 name_size:u8 name}[ncolumns] column_size:u32[ncolumns]
+        column data...
+
+The size includes the whole frame. The column types and the encoding
+of the numeric columns are the same as in the segment files (see
+segment.h), every string is stored as varint size and the characters.
+Integers are stored in the byte order of the host.
+
+Addresses are written as tcp://host:port, udp://host:port or
+unix:/path, IPv6 hosts are written in brackets.
+*/
+
+#define STREAM_MAX_FRAME 65000
+
+static const char stream_magic[4] = {'L','S','N','1'};
+
+typedef struct {
+    char magic[4];
+    uint32_t size;
+    uint32_t nrows;
+    uint32_t ncolumns;
+} stream_frame_header_type;
+
+typedef enum {
+    STREAM_TCP = 0,
+    STREAM_UDP = 1,
+    STREAM_UNIX = 2,
+} stream_transport_type;
+
+typedef struct {
+    stream_transport_type transport;
+    char host[256];
+    char port[16];
+    char path[108];
+} stream_address_type;
+
+/* Returns -1 on error. */
+static int
+stream_parse_address(const char* str, stream_address_type* a) {
+    memset(a, 0, sizeof(stream_address_type));
+    if (strncmp(str, "unix:", 5) == 0) {
+        a->transport = STREAM_UNIX;
+        const size_t n = strlen(str+5);
+        if (n == 0 || n >= sizeof(a->path)) { return -1; }
+        memcpy(a->path, str+5, n);
+        return 0;
+    }
+    if (strncmp(str, "tcp://", 6) == 0) { a->transport = STREAM_TCP; }
+    else if (strncmp(str, "udp://", 6) == 0) { a->transport = STREAM_UDP; }
+    else { return -1; }
+    const char* host = str+6;
+    const char* host_last = NULL;
+    const char* colon = NULL;
+    if (*host == '[') {
+        ++host;
+        host_last = strchr(host, ']');
+        if (host_last == NULL || host_last[1] != ':') { return -1; }
+        colon = host_last+1;
+    } else {
+        colon = strrchr(host, ':');
+        if (colon == NULL) { return -1; }
+        host_last = colon;
+    }
+    const size_t host_size = host_last-host;
+    const size_t port_size = strlen(colon+1);
+    if (host_size == 0 || host_size >= sizeof(a->host)) { return -1; }
+    if (port_size == 0 || port_size >= sizeof(a->port)) { return -1; }
+    memcpy(a->host, host, host_size);
+    memcpy(a->port, colon+1, port_size);
+    return 0;
+}
+
+/* Returns the size of the frame at the beginning of [first,last) or zero if it is incomplete. */
+static inline size_t
+stream_frame_size(const uint8_t* first, const uint8_t* last) {
+    stream_frame_header_type h;
+    if ((size_t)(last-first) < sizeof(h)) { return 0; }
+    memcpy(&h, first, sizeof(h));
+    if ((size_t)(last-first) < h.size) { return 0; }
+    return h.size;
+}
+
+/* Returns 1 if the header starts a valid frame. */
+static inline int
+stream_frame_valid(const uint8_t* first, size_t n) {
+    stream_frame_header_type h;
+    if (n < sizeof(h)) { return 1; }
+    memcpy(&h, first, sizeof(h));
+    return memcmp(h.magic, stream_magic, 4) == 0 && h.size >= sizeof(h) &&
+        h.size <= STREAM_MAX_FRAME && h.ncolumns <= SEGMENT_MAX_COLUMNS;
+}
+
+#endif // vim:filetype=c
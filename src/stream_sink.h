@@ -0,0 +1,517 @@
+/*
+Lockstep — log resources consumed by userland Linux processes.
+© 2026 Ivan Gankevich
+
+This file is part of Lockstep.
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef STREAM_SINK_H
+#define STREAM_SINK_H
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <field.h>
+#include <intern.h>
+#include <segment.h>
+#include <stream.h>
+
+/*
+Streams process records to the collector (see stream.h) from the main
+thread without blocking the tick. The records of the tick are encoded
+into one or more frames that are sent with non-blocking calls at the end
+of the tick. The frames that the socket does not accept stay in memory
+(at most stream_max_pending bytes). While the collector is unreachable
+the frames are appended to the spool file (at most stream_spool_size
+bytes, the newer frames are dropped when it is full) and are replayed in
+order after the reconnection. Without the spool file the frames are kept
+in memory only. Reconnection attempts back off from one
+second to one minute. UDP frames are sent as datagrams and are never
+spooled.
+*/
+
+typedef enum {
+    STREAM_DISCONNECTED = 0,
+    STREAM_CONNECTING = 1,
+    STREAM_CONNECTED = 2,
+} stream_state_type;
+
+typedef struct {
+    uint8_t* data;
+    size_t size;
+    size_t capacity;
+} stream_buffer_type;
+
+typedef struct {
+    const field_type* field;
+    segment_column_type type;
+    uint64_t previous;
+    stream_buffer_type data;
+} stream_column_type;
+
+static stream_address_type stream_address;
+static int stream_enabled = 0;
+static int stream_fd = -1;
+static stream_state_type stream_state = STREAM_DISCONNECTED;
+static char stream_host[256] = "-";
+static stream_column_type stream_columns[SEGMENT_MAX_COLUMNS];
+static size_t stream_ncolumns = 0;
+static uint32_t stream_nrows = 0;
+static size_t stream_frame_bytes = 0;
+// frames that were not sent yet, sent bytes of the first frame
+static stream_buffer_type stream_pending;
+static size_t stream_pending_sent = 0;
+static size_t stream_max_pending = 4UL*1024UL*1024UL;
+static char stream_spool_path[PATH_MAX] = {0};
+static size_t stream_spool_size = 64UL*1024UL*1024UL;
+static int stream_spool_fd = -1;
+static off_t stream_spool_read = 0;
+static off_t stream_spool_end = 0;
+// in microseconds
+static uint64_t stream_next_attempt = 0;
+static uint64_t stream_backoff = 0;
+static unsigned long stream_dropped_frames = 0;
+
+static void
+stream_reserve(stream_buffer_type* b, size_t n) {
+    if (b->size + n <= b->capacity) { return; }
+    size_t capacity = b->capacity == 0 ? 4096 : b->capacity;
+    while (capacity < b->size + n) { capacity *= 2; }
+    b->data = realloc(b->data, capacity);
+    if (b->data == NULL) { perror("realloc"); exit(1); }
+    b->capacity = capacity;
+}
+
+static inline void
+stream_append(stream_buffer_type* b, const void* data, size_t n) {
+    stream_reserve(b, n);
+    memcpy(b->data + b->size, data, n);
+    b->size += n;
+}
+
+static void
+stream_add_column(const field_type* field) {
+    if (stream_ncolumns == SEGMENT_MAX_COLUMNS) { return; }
+    stream_column_type* c = stream_columns + stream_ncolumns++;
+    memset(c, 0, sizeof(stream_column_type));
+    c->field = field;
+    c->type = segment_column_type_of(field->format);
+}
+
+static size_t
+stream_header_size() {
+    size_t n = sizeof(stream_frame_header_type) + 1 + strlen(stream_host);
+    for (size_t i=0; i<stream_ncolumns; ++i) {
+        n += 2 + strlen(stream_columns[i].field->name) + sizeof(uint32_t);
+    }
+    return n;
+}
+
+static void
+stream_open_spool() {
+    if (stream_spool_path[0] == 0 || stream_spool_fd != -1) { return; }
+    stream_spool_fd = open(stream_spool_path, O_CREAT|O_RDWR|O_CLOEXEC, 0644);
+    if (stream_spool_fd == -1) {
+        fprintf(stderr, "failed to open %s: %s\n", stream_spool_path, strerror(errno));
+        return;
+    }
+    // the frames that the previous instance did not send
+    struct stat st;
+    stream_spool_end = fstat(stream_spool_fd, &st) == 0 ? st.st_size : 0;
+    stream_spool_read = 0;
+}
+
+static void
+stream_spool_append(const uint8_t* data, size_t n) {
+    if (stream_spool_fd == -1 || (size_t)stream_spool_end + n > stream_spool_size) {
+        ++stream_dropped_frames;
+        return;
+    }
+    ssize_t nwritten = pwrite(stream_spool_fd, data, n, stream_spool_end);
+    if (nwritten != (ssize_t)n) {
+        if (nwritten == -1) { perror("pwrite"); }
+        ++stream_dropped_frames;
+        return;
+    }
+    stream_spool_end += n;
+}
+
+/* Move the frames from the spool file to the memory while there is space. */
+static void
+stream_spool_load() {
+    if (stream_spool_fd == -1) { return; }
+    while (stream_spool_read != stream_spool_end && stream_pending.size < stream_max_pending) {
+        stream_frame_header_type h;
+        if (pread(stream_spool_fd, &h, sizeof(h), stream_spool_read) != sizeof(h) ||
+            !stream_frame_valid((const uint8_t*)&h, sizeof(h))) {
+            fprintf(stderr, "bad frame in %s, discarding the spool\n", stream_spool_path);
+            stream_spool_read = stream_spool_end;
+            break;
+        }
+        stream_reserve(&stream_pending, h.size);
+        if (pread(stream_spool_fd, stream_pending.data + stream_pending.size,
+                  h.size, stream_spool_read) != (ssize_t)h.size) {
+            stream_spool_read = stream_spool_end;
+            break;
+        }
+        stream_pending.size += h.size;
+        stream_spool_read += h.size;
+    }
+    if (stream_spool_read == stream_spool_end && stream_spool_end != 0) {
+        if (ftruncate(stream_spool_fd, 0) == -1) { perror("ftruncate"); }
+        stream_spool_read = 0;
+        stream_spool_end = 0;
+    }
+}
+
+static uint64_t
+stream_now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec*1000000UL + t.tv_nsec/1000UL;
+}
+
+static void
+stream_disconnect(uint64_t now) {
+    if (stream_fd != -1 && close(stream_fd) == -1) { perror("close"); }
+    stream_fd = -1;
+    stream_state = STREAM_DISCONNECTED;
+    stream_backoff = stream_backoff == 0 ? 1000000UL : 2*stream_backoff;
+    if (stream_backoff > 60000000UL) { stream_backoff = 60000000UL; }
+    stream_next_attempt = now + stream_backoff;
+    // the receiver discards the partially sent frame, it is sent again
+    // in the next connection
+    stream_pending_sent = 0;
+}
+
+/* Put the pending frames before the spooled ones for the next instance. */
+static void
+stream_spool_pending() {
+    if (stream_pending.size == 0 || stream_spool_fd == -1) { return; }
+    const size_t spooled = (size_t)(stream_spool_end - stream_spool_read);
+    uint8_t* tmp = spooled == 0 ? NULL : malloc(spooled);
+    if (spooled != 0 && (tmp == NULL ||
+        pread(stream_spool_fd, tmp, spooled, stream_spool_read) != (ssize_t)spooled)) {
+        perror("pread");
+        free(tmp);
+        return;
+    }
+    if (ftruncate(stream_spool_fd, 0) == -1) { perror("ftruncate"); }
+    stream_spool_read = 0;
+    stream_spool_end = 0;
+    const uint8_t* first = stream_pending.data;
+    const uint8_t* last = first + stream_pending.size;
+    for (size_t n = 0; (n = stream_frame_size(first, last)) != 0; first += n) {
+        stream_spool_append(first, n);
+    }
+    first = tmp;
+    last = tmp + spooled;
+    for (size_t n = 0; tmp != NULL && (n = stream_frame_size(first, last)) != 0; first += n) {
+        stream_spool_append(first, n);
+    }
+    free(tmp);
+    stream_pending.size = 0;
+}
+
+static void
+stream_connect(uint64_t now) {
+    if (now < stream_next_attempt) { return; }
+    const stream_address_type* a = &stream_address;
+    if (a->transport == STREAM_UNIX) {
+        struct sockaddr_un address = {0};
+        address.sun_family = AF_UNIX;
+        memcpy(address.sun_path, a->path, sizeof(a->path));
+        stream_fd = socket(AF_UNIX, SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+        if (stream_fd == -1) { perror("socket"); stream_disconnect(now); return; }
+        if (connect(stream_fd, (struct sockaddr*)&address, sizeof(address)) == -1) {
+            stream_disconnect(now);
+            return;
+        }
+    } else {
+        struct addrinfo hints = {0};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = a->transport == STREAM_UDP ? SOCK_DGRAM : SOCK_STREAM;
+        struct addrinfo* result = NULL;
+        int ret = getaddrinfo(a->host, a->port, &hints, &result);
+        if (ret != 0) {
+            fprintf(stderr, "unable to resolve %s: %s\n", a->host, gai_strerror(ret));
+            stream_disconnect(now);
+            return;
+        }
+        stream_fd = socket(result->ai_family, result->ai_socktype|SOCK_NONBLOCK|SOCK_CLOEXEC,
+                           result->ai_protocol);
+        if (stream_fd == -1) {
+            perror("socket");
+            freeaddrinfo(result);
+            stream_disconnect(now);
+            return;
+        }
+        ret = connect(stream_fd, result->ai_addr, result->ai_addrlen);
+        freeaddrinfo(result);
+        if (ret == -1 && errno != EINPROGRESS) {
+            stream_disconnect(now);
+            return;
+        }
+    }
+    stream_state = STREAM_CONNECTING;
+}
+
+/* Returns 1 if the connection is established. */
+static int
+stream_connected(uint64_t now) {
+    if (stream_state == STREAM_DISCONNECTED) { stream_connect(now); }
+    if (stream_state == STREAM_CONNECTING) {
+        struct pollfd p = {stream_fd, POLLOUT, 0};
+        if (poll(&p, 1, 0) != 1) { return 0; }
+        int error = 0;
+        socklen_t n = sizeof(error);
+        if (getsockopt(stream_fd, SOL_SOCKET, SO_ERROR, &error, &n) == -1 || error != 0) {
+            stream_disconnect(now);
+            return 0;
+        }
+        stream_state = STREAM_CONNECTED;
+        stream_backoff = 0;
+    }
+    return stream_state == STREAM_CONNECTED;
+}
+
+/* Send the pending frames without blocking. */
+static void
+stream_send(uint64_t now) {
+    if (!stream_connected(now)) { return; }
+    while (1) {
+        if (stream_pending_sent == stream_pending.size) {
+            stream_pending.size = 0;
+            stream_pending_sent = 0;
+            stream_spool_load();
+            if (stream_pending.size == 0) { break; }
+        }
+        ssize_t n = send(stream_fd, stream_pending.data + stream_pending_sent,
+                         stream_pending.size - stream_pending_sent, MSG_DONTWAIT|MSG_NOSIGNAL);
+        if (n == -1) {
+            if (errno == EINTR) { continue; }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) { stream_disconnect(now); }
+            break;
+        }
+        stream_pending_sent += n;
+    }
+    // keep the first unsent frame at the beginning of the buffer
+    size_t first_frame = 0;
+    while (1) {
+        size_t n = stream_frame_size(stream_pending.data + first_frame,
+                                     stream_pending.data + stream_pending.size);
+        if (n == 0 || first_frame + n > stream_pending_sent) { break; }
+        first_frame += n;
+    }
+    if (first_frame != 0) {
+        memmove(stream_pending.data, stream_pending.data + first_frame,
+                stream_pending.size - first_frame);
+        stream_pending.size -= first_frame;
+        stream_pending_sent -= first_frame;
+    }
+}
+
+static void
+stream_send_frame(const uint8_t* frame, size_t n, uint64_t now) {
+    if (stream_address.transport == STREAM_UDP) {
+        if (!stream_connected(now)) {
+            ++stream_dropped_frames;
+            return;
+        }
+        if (send(stream_fd, frame, n, MSG_DONTWAIT|MSG_NOSIGNAL) == -1) {
+            ++stream_dropped_frames;
+            // the port is unreachable, resolve the address again later
+            if (errno == ECONNREFUSED || errno == ENETUNREACH) { stream_disconnect(now); }
+        }
+        return;
+    }
+    // the connection may have been established since the previous frame
+    stream_connected(now);
+    // keep the order: memory, then spool, then the new frames;
+    // the frames stay in memory while connecting or without the spool
+    if (stream_spool_read == stream_spool_end &&
+        (stream_state != STREAM_DISCONNECTED || stream_spool_fd == -1) &&
+        stream_pending.size + n <= stream_max_pending) {
+        stream_append(&stream_pending, frame, n);
+    } else {
+        stream_spool_append(frame, n);
+    }
+    stream_send(now);
+}
+
+/* Encode the frame from the columns and send it. */
+static void
+stream_flush() {
+    if (stream_nrows == 0) {
+        // retry the connection and drain the spool on idle ticks
+        if (stream_address.transport != STREAM_UDP) { stream_send(stream_now()); }
+        return;
+    }
+    static stream_buffer_type frame;
+    frame.size = 0;
+    stream_frame_header_type h;
+    memcpy(h.magic, stream_magic, 4);
+    h.size = 0;
+    h.nrows = stream_nrows;
+    h.ncolumns = (uint32_t)stream_ncolumns;
+    stream_append(&frame, &h, sizeof(h));
+    const uint8_t host_size = (uint8_t)strlen(stream_host);
+    stream_append(&frame, &host_size, 1);
+    stream_append(&frame, stream_host, host_size);
+    for (size_t i=0; i<stream_ncolumns; ++i) {
+        const field_type* field = stream_columns[i].field;
+        const uint8_t type = (uint8_t)stream_columns[i].type;
+        const uint8_t name_size = (uint8_t)strlen(field->name);
+        stream_append(&frame, &type, 1);
+        stream_append(&frame, &name_size, 1);
+        stream_append(&frame, field->name, name_size);
+    }
+    for (size_t i=0; i<stream_ncolumns; ++i) {
+        const uint32_t size = (uint32_t)stream_columns[i].data.size;
+        stream_append(&frame, &size, sizeof(size));
+    }
+    for (size_t i=0; i<stream_ncolumns; ++i) {
+        stream_column_type* c = stream_columns + i;
+        stream_append(&frame, c->data.data, c->data.size);
+        c->data.size = 0;
+        c->previous = 0;
+    }
+    h.size = (uint32_t)frame.size;
+    memcpy(frame.data, &h, sizeof(h));
+    stream_nrows = 0;
+    stream_frame_bytes = 0;
+    stream_send_frame(frame.data, frame.size, stream_now());
+}
+
+static void
+stream_encode_row(const void* step) {
+    for (size_t i=0; i<stream_ncolumns; ++i) {
+        stream_column_type* c = stream_columns + i;
+        stream_buffer_type* b = &c->data;
+        const size_t old_size = b->size;
+        if (c->type == SEGMENT_STRING) {
+            const char* str = field_string(step, c->field);
+            const size_t n = strlen(str);
+            stream_reserve(b, n + 10);
+            uint8_t* first = segment_put_varint(b->data + b->size, n);
+            memcpy(first, str, n);
+            b->size = first + n - b->data;
+        } else {
+            const uint64_t value = segment_value(step, c->field);
+            stream_reserve(b, 10);
+            uint8_t* first = segment_put_varint(b->data + b->size,
+                                                segment_zigzag((int64_t)(value - c->previous)));
+            b->size = first - b->data;
+            c->previous = value;
+        }
+        stream_frame_bytes += b->size - old_size;
+    }
+    ++stream_nrows;
+}
+
+static void
+stream_add(const void* step) {
+    if (stream_nrows == 0) { stream_frame_bytes = stream_header_size(); }
+    size_t sizes[SEGMENT_MAX_COLUMNS];
+    uint64_t previous[SEGMENT_MAX_COLUMNS];
+    for (size_t i=0; i<stream_ncolumns; ++i) {
+        sizes[i] = stream_columns[i].data.size;
+        previous[i] = stream_columns[i].previous;
+    }
+    const size_t old_frame_bytes = stream_frame_bytes;
+    stream_encode_row(step);
+    if (stream_frame_bytes <= STREAM_MAX_FRAME) { return; }
+    // roll the row back, the deltas of the next frame start from zero
+    for (size_t i=0; i<stream_ncolumns; ++i) {
+        stream_columns[i].data.size = sizes[i];
+        stream_columns[i].previous = previous[i];
+    }
+    stream_frame_bytes = old_frame_bytes;
+    --stream_nrows;
+    if (stream_nrows == 0) {
+        // the record does not fit into any frame
+        ++stream_dropped_frames;
+        return;
+    }
+    stream_flush();
+    stream_frame_bytes = stream_header_size();
+    stream_encode_row(step);
+}
+
+static void
+stream_open(const char* address) {
+    if (stream_parse_address(address, &stream_address) == -1) {
+        fprintf(stderr, "bad stream address %s\n", address);
+        exit(1);
+    }
+    stream_enabled = 1;
+}
+
+static void
+stream_start() {
+    if (!stream_enabled) { return; }
+    if (gethostname(stream_host, sizeof(stream_host)) == -1) { strcpy(stream_host, "-"); }
+    stream_host[sizeof(stream_host)-1] = 0;
+    if (stream_address.transport != STREAM_UDP) { stream_open_spool(); }
+    stream_connect(stream_now());
+}
+
+static void
+stream_stop() {
+    if (!stream_enabled) { return; }
+    stream_flush();
+    const uint64_t now = stream_now();
+    stream_send(now);
+    // keep the unsent frames for the next instance
+    if (stream_address.transport != STREAM_UDP) {
+        stream_pending_sent = 0;
+        stream_spool_pending();
+    }
+    if (stream_fd != -1 && close(stream_fd) == -1) { perror("close"); }
+    stream_fd = -1;
+    if (stream_spool_fd != -1 && close(stream_spool_fd) == -1) { perror("close"); }
+    stream_spool_fd = -1;
+    if (stream_dropped_frames != 0) {
+        fprintf(stderr, "stream: dropped %lu frames\n", stream_dropped_frames);
+    }
+}
+
+#endif // vim:filetype=c
@@ -0,0 +1,244 @@
+/*
+Lockstep — log resources consumed by userland Linux processes.
+© 2026 Ivan Gankevich
+
+This file is part of Lockstep.
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef SYSLOG_SINK_H
+#define SYSLOG_SINK_H
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/*
+RFC 5424 messages are accumulated during the tick and are sent in one
+sendmmsg call on the datagram socket connected to /dev/log. When the
+syslog daemon restarts, the socket is reconnected at most once per flush
+with the backoff from one second to one minute, like syslog(3) does.
+*/
+
+#define SYSLOG_MAX_MESSAGES 1024
+#define SYSLOG_MAX_MESSAGE_SIZE 2048
+
+typedef enum {
+    SYSLOG_MESSAGE_SYSTEM = 0,
+    SYSLOG_MESSAGE_PROCESS = 1,
+    SYSLOG_MESSAGE_SUMMARY = 2,
+    SYSLOG_MESSAGE_EVENT = 3,
+} syslog_message_type;
+
+static const char* syslog_message_ids[] = {"system", "process", "summary", "event"};
+
+static int syslog_fd = -1;
+static struct sockaddr_un syslog_address;
+// in microseconds
+static uint64_t syslog_next_attempt = 0;
+static uint64_t syslog_backoff = 0;
+static char syslog_hostname[256] = "-";
+static char syslog_procid[32] = "-";
+static char* syslog_data = NULL;
+static size_t syslog_count = 0;
+static struct mmsghdr syslog_messages[SYSLOG_MAX_MESSAGES];
+static struct iovec syslog_iovecs[SYSLOG_MAX_MESSAGES];
+// messages per second, zero means no limit
+static unsigned long syslog_rate = 0;
+static double syslog_tokens = 0;
+static struct timespec syslog_last_refill = {0};
+static unsigned long syslog_dropped = 0;
+static unsigned long syslog_rate_limited = 0;
+
+/* Returns 0 on success, errno is set otherwise. */
+static int
+syslog_connect() {
+    syslog_fd = socket(AF_UNIX, SOCK_DGRAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+    if (syslog_fd == -1) { return -1; }
+    if (connect(syslog_fd, (struct sockaddr*)&syslog_address, sizeof(syslog_address)) == -1) {
+        const int error = errno;
+        close(syslog_fd);
+        syslog_fd = -1;
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+static uint64_t
+syslog_now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec*1000000UL + t.tv_nsec/1000UL;
+}
+
+/* Connect the socket again after the syslog daemon restarted. Returns 1 on success. */
+static int
+syslog_reconnect() {
+    if (syslog_fd != -1 && close(syslog_fd) == -1) { perror("close"); }
+    syslog_fd = -1;
+    const uint64_t now = syslog_now();
+    if (now < syslog_next_attempt) { return 0; }
+    if (syslog_connect() == -1) {
+        syslog_backoff = syslog_backoff == 0 ? 1000000UL : 2*syslog_backoff;
+        if (syslog_backoff > 60000000UL) { syslog_backoff = 60000000UL; }
+        syslog_next_attempt = now + syslog_backoff;
+        return 0;
+    }
+    syslog_backoff = 0;
+    return 1;
+}
+
+static int
+syslog_open(const char* path) {
+    const size_t path_size = strlen(path);
+    memset(&syslog_address, 0, sizeof(syslog_address));
+    if (path_size >= sizeof(syslog_address.sun_path)) {
+        fprintf(stderr, "socket path is too long: %s\n", path);
+        return -1;
+    }
+    syslog_address.sun_family = AF_UNIX;
+    memcpy(syslog_address.sun_path, path, path_size);
+    if (syslog_connect() == -1) {
+        fprintf(stderr, "unable to connect to %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    syslog_data = malloc(SYSLOG_MAX_MESSAGES*SYSLOG_MAX_MESSAGE_SIZE);
+    if (syslog_data == NULL) { perror("malloc"); exit(1); }
+    if (gethostname(syslog_hostname, sizeof(syslog_hostname)) == -1) {
+        strcpy(syslog_hostname, "-");
+    }
+    syslog_hostname[sizeof(syslog_hostname)-1] = 0;
+    snprintf(syslog_procid, sizeof(syslog_procid), "%d", getpid());
+    syslog_tokens = (double)syslog_rate;
+    clock_gettime(CLOCK_MONOTONIC, &syslog_last_refill);
+    return 0;
+}
+
+static int
+syslog_take_token() {
+    if (syslog_rate == 0) { return 1; }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double elapsed = (double)(now.tv_sec - syslog_last_refill.tv_sec) +
+        1e-9*(double)(now.tv_nsec - syslog_last_refill.tv_nsec);
+    syslog_last_refill = now;
+    syslog_tokens += elapsed*(double)syslog_rate;
+    // the burst is limited to one second worth of messages
+    if (syslog_tokens > (double)syslog_rate) { syslog_tokens = (double)syslog_rate; }
+    if (syslog_tokens < 1) { return 0; }
+    syslog_tokens -= 1;
+    return 1;
+}
+
+static void syslog_flush();
+
+static void
+syslog_append(int priority, syslog_message_type type, time_t timestamp,
+              const char* first, size_t n) {
+    // the socket may be closed until the reconnection
+    if (syslog_data == NULL) { return; }
+    if (!syslog_take_token()) {
+        ++syslog_rate_limited;
+        return;
+    }
+    if (syslog_count == SYSLOG_MAX_MESSAGES) { syslog_flush(); }
+    // strip the trailing newline
+    while (n != 0 && first[n-1] == '\n') { --n; }
+    char* message = syslog_data + syslog_count*SYSLOG_MAX_MESSAGE_SIZE;
+    struct tm tm;
+    gmtime_r(&timestamp, &tm);
+    int header_size = snprintf(
+        message, SYSLOG_MAX_MESSAGE_SIZE,
+        "<%d>1 %04d-%02d-%02dT%02d:%02d:%02dZ %s lockstep %s %s - ",
+        priority, tm.tm_year+1900, tm.tm_mon+1, tm.tm_mday,
+        tm.tm_hour, tm.tm_min, tm.tm_sec,
+        syslog_hostname, syslog_procid, syslog_message_ids[type]);
+    if (header_size < 0 || header_size >= SYSLOG_MAX_MESSAGE_SIZE) { return; }
+    if (n > (size_t)(SYSLOG_MAX_MESSAGE_SIZE - header_size)) {
+        n = SYSLOG_MAX_MESSAGE_SIZE - header_size;
+    }
+    memcpy(message + header_size, first, n);
+    struct iovec* iov = syslog_iovecs + syslog_count;
+    iov->iov_base = message;
+    iov->iov_len = header_size + n;
+    struct mmsghdr* m = syslog_messages + syslog_count;
+    memset(m, 0, sizeof(struct mmsghdr));
+    m->msg_hdr.msg_iov = iov;
+    m->msg_hdr.msg_iovlen = 1;
+    ++syslog_count;
+}
+
+static void
+syslog_flush() {
+    size_t nsent = 0;
+    int reconnected = 0;
+    while (nsent != syslog_count) {
+        if (syslog_fd == -1) {
+            if (reconnected || !syslog_reconnect()) {
+                syslog_dropped += syslog_count - nsent;
+                break;
+            }
+            reconnected = 1;
+        }
+        int ret = sendmmsg(syslog_fd, syslog_messages + nsent, syslog_count - nsent, 0);
+        if (ret == -1) {
+            if (errno == EINTR) { continue; }
+            if (!reconnected && (errno == ECONNREFUSED || errno == ENOTCONN || errno == ENOENT)) {
+                // the syslog daemon restarted, retry the batch on the new socket
+                if (syslog_reconnect()) {
+                    reconnected = 1;
+                    continue;
+                }
+                syslog_dropped += syslog_count - nsent;
+                break;
+            }
+            if (errno != EAGAIN && errno != ECONNREFUSED && errno != ENOTCONN &&
+                errno != ENOENT) {
+                perror("sendmmsg");
+            }
+            // the receiver does not keep up, drop the rest of the batch
+            syslog_dropped += syslog_count - nsent;
+            break;
+        }
+        nsent += ret;
+    }
+    syslog_count = 0;
+}
+
+static void
+syslog_close() {
+    if (syslog_data == NULL) { return; }
+    syslog_flush();
+    if (syslog_fd != -1 && close(syslog_fd) == -1) { perror("close"); }
+    syslog_fd = -1;
+    if (syslog_dropped != 0 || syslog_rate_limited != 0) {
+        fprintf(stderr, "syslog: dropped %lu messages, rate limited %lu messages\n",
+                syslog_dropped, syslog_rate_limited);
+    }
+}
+
+#endif // vim:filetype=c
@@ -0,0 +1,106 @@
+/*
+Lockstep — log resources consumed by userland Linux processes.
+© 2026 Ivan Gankevich
+
+This file is part of Lockstep.
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef SYSTEM_STEP_H
+#define SYSTEM_STEP_H
+
+#include <sys/types.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*
+The node-wide counters: the system fields cpu (/proc/stat), mem
+(/proc/meminfo), disk (/proc/diskstats) and netdev (/proc/net/dev).
+The files are opened once and are read with pread on every tick into
+the buffer that grows to the size of the largest file, then they are
+parsed with the tokenizers from parse.h.
+*/
+
+typedef enum {
+    SYSTEM_FILE_STAT = 0,
+    SYSTEM_FILE_MEMINFO = 1,
+    SYSTEM_FILE_DISKSTATS = 2,
+    SYSTEM_FILE_NETDEV = 3,
+    NUM_SYSTEM_FILES = 4,
+} system_file_type;
+
+static const char* system_file_paths[NUM_SYSTEM_FILES] = {
+    "/proc/stat", "/proc/meminfo", "/proc/diskstats", "/proc/net/dev",
+};
+static int system_file_fds[NUM_SYSTEM_FILES] = {-1, -1, -1, -1};
+static char* system_file_buffer = NULL;
+static size_t system_file_capacity = 0;
+
+/* Read the whole file from the beginning into system_file_buffer, returns the size or -1. */
+static ssize_t
+system_fd_read(int fd) {
+    if (system_file_capacity == 0) {
+        system_file_capacity = 4096*4;
+        system_file_buffer = malloc(system_file_capacity);
+        if (system_file_buffer == NULL) { perror("malloc"); exit(1); }
+    }
+    while (1) {
+        ssize_t n = pread(fd, system_file_buffer, system_file_capacity, 0);
+        if (n == -1) { return -1; }
+        // the file may be truncated, read it again into the larger buffer
+        if ((size_t)n < system_file_capacity) { return n; }
+        system_file_capacity *= 2;
+        system_file_buffer = realloc(system_file_buffer, system_file_capacity);
+        if (system_file_buffer == NULL) { perror("realloc"); exit(1); }
+    }
+}
+
+static ssize_t
+system_file_read(system_file_type file) {
+    int* fd = system_file_fds + file;
+    if (*fd == -1) {
+        *fd = open(system_file_paths[file], O_RDONLY|O_CLOEXEC);
+        if (*fd == -1) { return -1; }
+    }
+    return system_fd_read(*fd);
+}
+
+static void
+system_files_close() {
+    for (int i=0; i<NUM_SYSTEM_FILES; ++i) {
+        if (system_file_fds[i] != -1 && close(system_file_fds[i]) == -1) { perror("close"); }
+        system_file_fds[i] = -1;
+    }
+    free(system_file_buffer);
+    system_file_buffer = NULL;
+    system_file_capacity = 0;
+}
+
+#endif // vim:filetype=c
@@ -0,0 +1,359 @@
+/*
+Lockstep — log resources consumed by userland Linux processes.
+© 2026 Ivan Gankevich
+
+This file is part of Lockstep.
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef TIER_H
+#define TIER_H
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <field.h>
+#include <format.h>
+#include <step.h>
+#include <writer.h>
+
+/*
+Tiered downsampling. Every tier has a window (e.g. 1m) and a retention
+period (e.g. 30d) and writes one record per group and window to its own
+file:
+
+window start|window|group|samples|min|max|mean|last of the first field|...
+
+The group is the value of tier.group (pid by default) and the values of
+tier.fields of the processes of the same group are summed on every tick.
+The first tier folds the ticks, every next tier folds the closed windows of
+the previous one, so the windows must be multiples of each other. The groups
+are kept in fixed-size tables: the groups that do not fit into tier.groups
+go to the "other" group. The labels of the groups are stored in the string
+buffer of the table, so that long values like cgroup paths are kept whole.
+The files are rotated every quarter of the retention period and the rotated
+segments older than the retention period are removed by the writer thread
+(see output_expire), so the disk usage does not depend on the sampling
+interval. The partial windows are written on exit.
+*/
+
+#define MAX_TIERS 4
+#define TIER_MAX_FIELDS 16
+// the longest label, longer values go to the "other" group
+#define TIER_LABEL_SIZE PATH_MAX
+
+typedef struct {
+    double min;
+    double max;
+    double sum;
+    double last;
+} tier_value_type;
+
+typedef struct {
+    // zero is an empty slot
+    uint32_t hash;
+    // the number of the ticks
+    uint32_t count;
+    // the offset of the label in the labels of the table
+    uint32_t label;
+    tier_value_type values[TIER_MAX_FIELDS];
+} tier_group_type;
+
+typedef struct {
+    // open addressing, the slots are cleared only when the window closes
+    tier_group_type* groups;
+    uint32_t capacity;
+    // the used slots in the order of insertion
+    uint32_t* used;
+    uint32_t num_used;
+    // NUL-terminated labels of the used slots
+    char* labels;
+    size_t labels_size;
+    size_t labels_capacity;
+} tier_table_type;
+
+typedef struct {
+    // in seconds
+    unsigned long window;
+    unsigned long retention;
+    time_t window_start;
+    tier_table_type table;
+    output_type output;
+    writer_buffer_type* buffer;
+} tier_type;
+
+static tier_type tiers[MAX_TIERS];
+static int num_tiers = 0;
+static const field_type* tier_fields[TIER_MAX_FIELDS];
+static int tier_num_fields = 0;
+static const field_type* tier_group = NULL;
+static uint32_t tier_max_groups = 1000;
+// the sums of the groups of the current tick
+static tier_table_type tier_tick;
+// the samples that went to the "other" group because the label was too long
+// or because the table was full
+static unsigned long tier_long_labels = 0;
+static unsigned long tier_overflows = 0;
+
+static uint32_t
+tier_hash(const char* str) {
+    // FNV-1a
+    uint32_t h = 2166136261U;
+    while (*str) { h ^= (unsigned char)*str++; h *= 16777619U; }
+    return h == 0 ? 1 : h;
+}
+
+static void
+tier_table_init(tier_table_type* table) {
+    // the "other" group is always inserted
+    uint32_t capacity = 16;
+    while (capacity < 2*(tier_max_groups+1)) { capacity *= 2; }
+    table->groups = calloc(capacity, sizeof(tier_group_type));
+    table->used = calloc(tier_max_groups+1, sizeof(uint32_t));
+    if (table->groups == NULL || table->used == NULL) { perror("calloc"); exit(1); }
+    table->capacity = capacity;
+    table->num_used = 0;
+    table->labels = NULL;
+    table->labels_size = 0;
+    table->labels_capacity = 0;
+}
+
+static void
+tier_table_clear(tier_table_type* table) {
+    for (uint32_t i=0; i<table->num_used; ++i) {
+        memset(table->groups + table->used[i], 0, sizeof(tier_group_type));
+    }
+    table->num_used = 0;
+    table->labels_size = 0;
+}
+
+static inline const char*
+tier_label(const tier_table_type* table, const tier_group_type* g) {
+    return table->labels + g->label;
+}
+
+static tier_group_type*
+tier_table_get(tier_table_type* table, const char* label) {
+    const uint32_t hash = tier_hash(label);
+    const uint32_t mask = table->capacity-1;
+    uint32_t i = hash & mask;
+    tier_group_type* g = table->groups;
+    while (g[i].hash != 0) {
+        if (g[i].hash == hash && strcmp(table->labels + g[i].label, label) == 0) { return g + i; }
+        i = (i+1) & mask;
+    }
+    if (table->num_used == tier_max_groups && strcmp(label, "other") != 0) {
+        ++tier_overflows;
+        return tier_table_get(table, "other");
+    }
+    const size_t n = strlen(label) + 1;
+    if (table->labels_size + n > table->labels_capacity) {
+        size_t capacity = table->labels_capacity == 0 ? 4096 : table->labels_capacity;
+        while (capacity < table->labels_size + n) { capacity *= 2; }
+        char* labels = realloc(table->labels, capacity);
+        if (labels == NULL) { perror("realloc"); exit(1); }
+        table->labels = labels;
+        table->labels_capacity = capacity;
+    }
+    memcpy(table->labels + table->labels_size, label, n);
+    g[i].hash = hash;
+    g[i].label = (uint32_t)table->labels_size;
+    table->labels_size += n;
+    table->used[table->num_used++] = i;
+    return g + i;
+}
+
+/* Parse "window retention path" of the next tier, returns -1 on error. */
+static int
+tier_parse(const char* first, const char* last) {
+    if (num_tiers == MAX_TIERS) { return -1; }
+    const char* words[3];
+    const char* words_last[3];
+    for (int i=0; i<3; ++i) {
+        while (first != last && *first == ' ') { ++first; }
+        words[i] = first;
+        while (first != last && (i == 2 || *first != ' ')) { ++first; }
+        words_last[i] = first;
+        if (words[i] == words_last[i]) { return -1; }
+    }
+    const unsigned long window = parse_duration(words[0], words_last[0]);
+    const unsigned long retention = parse_duration(words[1], words_last[1]);
+    if (window < 1000000UL || window == ULONG_MAX || retention == ULONG_MAX ||
+        retention < window) {
+        return -1;
+    }
+    tier_type* t = tiers + num_tiers;
+    memset(t, 0, sizeof(tier_type));
+    t->window = window/1000000UL;
+    t->retention = retention/1000000UL;
+    if (num_tiers != 0) {
+        const unsigned long previous = tiers[num_tiers-1].window;
+        if (t->window <= previous || t->window % previous != 0) { return -1; }
+    }
+    t->output.fd = -1;
+    t->output.path = strndup(words[2], words_last[2]-words[2]);
+    if (t->output.path == NULL) { perror("strndup"); exit(1); }
+    // rotate in multiples of the window to never split one
+    t->output.rotate_interval = t->retention/4 < t->window ? t->window :
+        t->retention/4 - (t->retention/4)%t->window;
+    t->output.retention = t->retention;
+    ++num_tiers;
+    return 0;
+}
+
+static void
+tier_start() {
+    if (num_tiers == 0) { return; }
+    if (tier_num_fields == 0) {
+        fputs("tier.fields are not specified\n", stderr);
+        exit(1);
+    }
+    tier_table_init(&tier_tick);
+    for (int i=0; i<num_tiers; ++i) {
+        tier_type* t = tiers + i;
+        tier_table_init(&t->table);
+        if (output_open(&t->output) == -1) { exit(1); }
+    }
+}
+
+/* Add the values of the process to its group on this tick. */
+static void
+tier_add(const step_type* s) {
+    char label[TIER_LABEL_SIZE];
+    char* end = format_field(label, label + sizeof(label)-1, s, tier_group);
+    if (end == NULL) { ++tier_long_labels; }
+    if (end == NULL || end == label) { strcpy(label, "other"); }
+    else { *end = 0; }
+    tier_group_type* g = tier_table_get(&tier_tick, label);
+    for (int i=0; i<tier_num_fields; ++i) {
+        g->values[i].sum += field_number(s, tier_fields[i]);
+    }
+}
+
+static void
+tier_fold_value(tier_value_type* v, const tier_value_type* x, int first) {
+    if (first || x->min < v->min) { v->min = x->min; }
+    if (first || x->max > v->max) { v->max = x->max; }
+    v->sum += x->sum;
+    v->last = x->last;
+}
+
+static void
+tier_fold(tier_group_type* to, const tier_group_type* from) {
+    for (int i=0; i<tier_num_fields; ++i) {
+        tier_fold_value(to->values + i, from->values + i, to->count == 0);
+    }
+    to->count += from->count;
+}
+
+static void
+tier_write_group(tier_type* t, const tier_group_type* g) {
+    char line[TIER_LABEL_SIZE + TIER_MAX_FIELDS*4*32 + 64];
+    char* last = line + sizeof(line);
+    int n = snprintf(line, sizeof(line), "%ld|%lu|%s|%u", (long)t->window_start, t->window,
+                     tier_label(&t->table, g), g->count);
+    if (n <= 0 || (size_t)n >= sizeof(line)) { return; }
+    char* first = line + n;
+    for (int i=0; i<tier_num_fields; ++i) {
+        const tier_value_type* v = g->values + i;
+        const double x[4] = {v->min, v->max, v->sum/(double)g->count, v->last};
+        for (int j=0; j<4; ++j) {
+            if (first == last) { return; }
+            *first++ = '|';
+            first = format_double(first, last, x[j]);
+            if (first == NULL) { return; }
+        }
+    }
+    if (first == last) { return; }
+    *first++ = '\n';
+    writer_buffer_type* b = output_buffer(&t->output, &t->buffer, t->window_start);
+    if (b == NULL) {
+        writer_dropped_bytes += first-line;
+        return;
+    }
+    output_write(b, line, first-line);
+}
+
+/* Write the groups of the window, fold them into the next tier and start the new window. */
+static void
+tier_close_window(int index) {
+    tier_type* t = tiers + index;
+    tier_table_type* table = &t->table;
+    for (uint32_t i=0; i<table->num_used; ++i) {
+        const tier_group_type* g = table->groups + table->used[i];
+        tier_write_group(t, g);
+        if (index+1 != num_tiers) {
+            tier_fold(tier_table_get(&tiers[index+1].table, tier_label(table, g)), g);
+        }
+    }
+    tier_table_clear(table);
+    output_flush(&t->buffer);
+}
+
+/* Close the windows that ended before this tick, then fold the tick into the first tier. */
+static void
+tier_tick_end(time_t timestamp) {
+    for (int i=0; i<num_tiers; ++i) {
+        tier_type* t = tiers + i;
+        const time_t window_start = timestamp - timestamp%(time_t)t->window;
+        if (t->window_start == window_start) { continue; }
+        if (t->table.num_used != 0) { tier_close_window(i); }
+        t->window_start = window_start;
+    }
+    for (uint32_t i=0; i<tier_tick.num_used; ++i) {
+        tier_group_type* tick = tier_tick.groups + tier_tick.used[i];
+        for (int j=0; j<tier_num_fields; ++j) {
+            tier_value_type* v = tick->values + j;
+            v->min = v->max = v->last = v->sum;
+        }
+        tick->count = 1;
+        tier_fold(tier_table_get(&tiers[0].table, tier_label(&tier_tick, tick)), tick);
+    }
+    tier_table_clear(&tier_tick);
+}
+
+/* Write the partial windows. */
+static void
+tier_stop() {
+    for (int i=0; i<num_tiers; ++i) {
+        if (tiers[i].table.num_used != 0) { tier_close_window(i); }
+    }
+    if (tier_long_labels != 0) {
+        fprintf(stderr, "tier: %lu samples with too long tier.group went to \"other\"\n",
+                tier_long_labels);
+    }
+    if (tier_overflows != 0) {
+        fprintf(stderr, "tier: %lu samples beyond tier.groups went to \"other\"\n",
+                tier_overflows);
+    }
+}
+
+#endif // vim:filetype=c
@@ -0,0 +1,239 @@
+/*
+Lockstep — log resources consumed by userland Linux processes.
+© 2026 Ivan Gankevich
+
+This file is part of Lockstep.
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef TOP_H
+#define TOP_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <field.h>
+#include <intern.h>
+#include <process_table.h>
+#include <step.h>
+
+/*
+With process.top = N by field only N processes with the largest values
+of the field are written on every tick. The scan keeps them in a min-heap
+of size N, the processes that do not make it are summed into the "other"
+record (pid zero), so that the totals of the additive fields are
+preserved. Only the N records are sorted before they are written.
+
+cpu_percent, io_rate and run_queue_wait_percent (the wall-clock time the
+threads of the process spent waiting on the run queue, like cpu_percent it
+exceeds 100 when several threads wait) are the rates since the previous
+sample of the process; the first sample uses the lifetime of the process.
+*/
+
+typedef struct {
+    double key;
+    step_type step;
+} top_entry_type;
+
+static const field_type* top_field = NULL;
+// zero disables the mode
+static size_t top_capacity = 0;
+static top_entry_type* top_entries = NULL;
+static size_t top_size = 0;
+static step_type top_other;
+static unsigned long top_num_other = 0;
+
+static void
+top_init(size_t capacity, const field_type* field) {
+    top_entries = realloc(top_entries, capacity*sizeof(top_entry_type));
+    if (top_entries == NULL) { perror("realloc"); exit(1); }
+    top_capacity = capacity;
+    top_field = field;
+    top_size = 0;
+}
+
+/*
+Compute the rates since the previous regular tick. Watch and burst ticks do
+not move the baseline, otherwise the next regular tick would report the rate
+over the short period since the burst sample.
+*/
+static void
+collect_rates(process_state_type* p, int regular_tick, uint64_t now, step_type* s) {
+    const unsigned long cpu_time = s->userspace_time + s->kernel_time;
+    const unsigned long io_bytes = s->io.read_bytes + s->io.write_bytes;
+    const unsigned long long wait_ns = s->sched.run_queue_wait_ns;
+    double seconds = 0;
+    double cpu_ticks = 0;
+    double io_bytes_delta = 0;
+    double wait_ns_delta = 0;
+    if (p->rate_time == 0 || p->rate_cpu_time > cpu_time || p->rate_io_bytes > io_bytes) {
+        seconds = s->uptime - ((double)s->start_time)/((double)s->ticks_per_second);
+        cpu_ticks = (double)cpu_time;
+        io_bytes_delta = (double)io_bytes;
+        wait_ns_delta = (double)wait_ns;
+    } else {
+        seconds = 1e-6*(double)(now - p->rate_time);
+        cpu_ticks = (double)(cpu_time - p->rate_cpu_time);
+        io_bytes_delta = (double)(io_bytes - p->rate_io_bytes);
+        // the sum over the threads decreases when a thread exits
+        wait_ns_delta = wait_ns > p->rate_wait_ns ? (double)(wait_ns - p->rate_wait_ns) : 0;
+    }
+    if (seconds > 0) {
+        s->cpu_percent = 100.0*cpu_ticks/((double)s->ticks_per_second)/seconds;
+        s->io_rate = io_bytes_delta/seconds;
+        s->run_queue_wait_percent = 1e-7*wait_ns_delta/seconds;
+    } else {
+        s->cpu_percent = 0;
+        s->io_rate = 0;
+        s->run_queue_wait_percent = 0;
+    }
+    if (!regular_tick) { return; }
+    p->rate_time = now;
+    p->rate_cpu_time = cpu_time;
+    p->rate_io_bytes = io_bytes;
+    p->rate_wait_ns = wait_ns;
+}
+
+/* Add the additive fields of the process to the "other" record. */
+static void
+top_accumulate(const step_type* s) {
+    step_type* t = &top_other;
+    if (top_num_other == 0) {
+        memset(t, 0, sizeof(step_type));
+        t->state = '-';
+        t->uptime = s->uptime;
+        t->idle_time = s->idle_time;
+        t->ticks_per_second = s->ticks_per_second;
+        t->timestamp = s->timestamp;
+        t->interval = s->interval;
+        t->network = s->network;
+        t->smaps.age = -1;
+        t->numa.node = -1;
+        t->numa.age = -1;
+    }
+    ++top_num_other;
+    t->minor_faults += s->minor_faults;
+    t->child_minor_faults += s->child_minor_faults;
+    t->major_faults += s->major_faults;
+    t->child_major_faults += s->child_major_faults;
+    t->userspace_time += s->userspace_time;
+    t->kernel_time += s->kernel_time;
+    t->child_userspace_time += s->child_userspace_time;
+    t->child_kernel_time += s->child_kernel_time;
+    t->num_threads += s->num_threads;
+    t->virtual_memory_size += s->virtual_memory_size;
+    t->resident_set_size += s->resident_set_size;
+    t->num_swapped_pages += s->num_swapped_pages;
+    t->children_num_swapped_pages += s->children_num_swapped_pages;
+    t->cumulative_block_input_output_delay += s->cumulative_block_input_output_delay;
+    t->guest_time += s->guest_time;
+    t->child_guest_time += s->child_guest_time;
+    t->io.read_bytes += s->io.read_bytes;
+    t->io.write_bytes += s->io.write_bytes;
+    t->io.cancelled_write_bytes += s->io.cancelled_write_bytes;
+    t->drm.clients += s->drm.clients;
+    t->drm.engine_ns += s->drm.engine_ns;
+    t->drm.memory_vram += s->drm.memory_vram;
+    t->drm.memory_gtt += s->drm.memory_gtt;
+    t->sched.run_time_ns += s->sched.run_time_ns;
+    t->sched.run_queue_wait_ns += s->sched.run_queue_wait_ns;
+    t->sched.timeslices += s->sched.timeslices;
+    t->smaps.pss += s->smaps.pss;
+    t->smaps.pss_anon += s->smaps.pss_anon;
+    t->smaps.pss_shmem += s->smaps.pss_shmem;
+    t->smaps.uss += s->smaps.uss;
+    t->smaps.swap_pss += s->smaps.swap_pss;
+    t->cpu_percent += s->cpu_percent;
+    t->io_rate += s->io_rate;
+    t->run_queue_wait_percent += s->run_queue_wait_percent;
+}
+
+static void
+top_sift_down(size_t i) {
+    top_entry_type* e = top_entries;
+    while (1) {
+        size_t smallest = i;
+        const size_t left = 2*i+1, right = 2*i+2;
+        if (left < top_size && e[left].key < e[smallest].key) { smallest = left; }
+        if (right < top_size && e[right].key < e[smallest].key) { smallest = right; }
+        if (smallest == i) { break; }
+        top_entry_type tmp = e[i];
+        e[i] = e[smallest];
+        e[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+static void
+top_push(const step_type* s) {
+    const double key = field_number(s, top_field);
+    top_entry_type* e = top_entries;
+    if (top_size != top_capacity) {
+        size_t i = top_size++;
+        e[i].key = key;
+        e[i].step = *s;
+        // sift up
+        while (i != 0 && e[(i-1)/2].key > e[i].key) {
+            top_entry_type tmp = e[i];
+            e[i] = e[(i-1)/2];
+            e[(i-1)/2] = tmp;
+            i = (i-1)/2;
+        }
+        return;
+    }
+    if (!(key > e[0].key)) {
+        top_accumulate(s);
+        return;
+    }
+    top_accumulate(&e[0].step);
+    e[0].key = key;
+    e[0].step = *s;
+    top_sift_down(0);
+}
+
+static int
+top_compare(const void* a, const void* b) {
+    const double x = ((const top_entry_type*)a)->key;
+    const double y = ((const top_entry_type*)b)->key;
+    return (x < y) - (x > y);
+}
+
+/* Sort the records in the descending order of the key. */
+static void
+top_sort() {
+    qsort(top_entries, top_size, sizeof(top_entry_type), top_compare);
+}
+
+static void
+top_reset() {
+    top_size = 0;
+    top_num_other = 0;
+}
+
+#endif // vim:filetype=c
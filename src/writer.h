@@ -0,0 +1,526 @@
+/*
+Lockstep — log resources consumed by userland Linux processes.
+© 2026 Ivan Gankevich
+
+This file is part of Lockstep.
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <ctype.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+
+#include <compress.h>
+#include <parse.h>
+
+typedef struct {
+    int fd;
+    // the path of the file or NULL for the standard output
+    const char* path;
+    // the last time the file was synchronised by the writer thread
+    struct timespec last_sync;
+    // the size and the time range of the records of the current segment
+    size_t size;
+    time_t first_timestamp;
+    time_t last_timestamp;
+    // set by SIGHUP handler
+    atomic_int reopen;
+    // the file to switch to, set by the control socket
+    _Atomic(char*) new_path;
+    // the rotation interval and the retention period of the rotated segments
+    // in seconds, zero means the global output.rotate.interval and .retention
+    unsigned long rotate_interval;
+    unsigned long retention;
+} output_type;
+
+typedef struct {
+    output_type* output;
+    char* data;
+    size_t size;
+    size_t capacity;
+    time_t first_timestamp;
+    time_t last_timestamp;
+    // close and free the output after writing the buffer
+    int close_output;
+} writer_buffer_type;
+
+/*
+Bounded lock-free single-producer single-consumer queue of buffers.
+The semaphore counts the buffers in the queue and is used only to put
+the consumer to sleep.
+*/
+typedef struct {
+    writer_buffer_type** slots;
+    size_t capacity;
+    _Atomic size_t head;
+    _Atomic size_t tail;
+    sem_t size;
+} writer_queue_type;
+
+typedef enum {
+    WRITER_DROP = 0,
+    WRITER_BLOCK = 1,
+} writer_policy_type;
+
+static writer_policy_type writer_policy = WRITER_DROP;
+static size_t writer_queue_capacity = 16;
+static unsigned long writer_flush_interval = 0;
+static unsigned long writer_sync_interval = 0;
+static unsigned long writer_dropped_ticks = 0;
+static unsigned long writer_dropped_bytes = 0;
+static size_t rotate_size = 0;
+static unsigned long rotate_interval = 0;
+static unsigned long rotate_retention = 0;
+static int rotate_compress = 0;
+static writer_queue_type writer_full;
+static writer_queue_type writer_free;
+static pthread_t writer_thread;
+static atomic_int writer_running = 1;
+
+static void
+writer_queue_init(writer_queue_type* q, size_t capacity) {
+    // one slot is always empty to tell full queue from empty one
+    q->capacity = capacity + 1;
+    q->slots = calloc(q->capacity, sizeof(writer_buffer_type*));
+    if (q->slots == NULL) { perror("calloc"); exit(1); }
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    if (sem_init(&q->size, 0, 0) == -1) { perror("sem_init"); exit(1); }
+}
+
+static int
+writer_queue_push(writer_queue_type* q, writer_buffer_type* b) {
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    size_t new_tail = (tail + 1) % q->capacity;
+    if (new_tail == atomic_load_explicit(&q->head, memory_order_acquire)) {
+        return -1;
+    }
+    q->slots[tail] = b;
+    atomic_store_explicit(&q->tail, new_tail, memory_order_release);
+    sem_post(&q->size);
+    return 0;
+}
+
+static writer_buffer_type*
+writer_queue_pop(writer_queue_type* q) {
+    size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    if (head == atomic_load_explicit(&q->tail, memory_order_acquire)) {
+        return NULL;
+    }
+    writer_buffer_type* b = q->slots[head];
+    atomic_store_explicit(&q->head, (head + 1) % q->capacity, memory_order_release);
+    return b;
+}
+
+static writer_buffer_type*
+writer_queue_wait(writer_queue_type* q) {
+    while (sem_wait(&q->size) == -1) {
+        if (errno != EINTR) { perror("sem_wait"); return NULL; }
+    }
+    return writer_queue_pop(q);
+}
+
+static writer_buffer_type*
+writer_queue_try(writer_queue_type* q) {
+    if (sem_trywait(&q->size) == -1) { return NULL; }
+    return writer_queue_pop(q);
+}
+
+static void
+writer_write(int fd, const char* first, size_t n) {
+    while (n != 0) {
+        ssize_t nwritten = write(fd, first, n);
+        if (nwritten == -1) {
+            if (errno == EINTR) { continue; }
+            perror("write");
+            if (errno == EPIPE) {
+                // SIGPIPE is directed to this thread, forward it to the main thread
+                kill(getpid(), SIGPIPE);
+            }
+            break;
+        }
+        n -= nwritten;
+        first += nwritten;
+    }
+}
+
+static void
+writer_sync(output_type* output, int force) {
+    if (output->fd == -1 || (writer_sync_interval == 0 && !force)) { return; }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    unsigned long elapsed =
+        (now.tv_sec - output->last_sync.tv_sec)*1000000UL +
+        (now.tv_nsec - output->last_sync.tv_nsec)/1000L;
+    if (force || elapsed >= writer_sync_interval) {
+        if (fdatasync(output->fd) == -1 && errno != EINVAL && errno != EROFS) {
+            perror("fdatasync");
+        }
+        output->last_sync = now;
+    }
+}
+
+static int
+output_open(output_type* output) {
+    int fd = open(output->path, O_CREAT|O_APPEND|O_WRONLY|O_CLOEXEC, 0644);
+    if (fd == -1) {
+        fprintf(stderr, "failed to open %s for writing\n", output->path);
+        return -1;
+    }
+    output->fd = fd;
+    output->size = 0;
+    output->first_timestamp = 0;
+    output->last_timestamp = 0;
+    struct statx st;
+    if (statx(fd, "", AT_EMPTY_PATH, STATX_SIZE|STATX_MTIME|STATX_BTIME, &st) == 0) {
+        output->size = st.stx_size;
+        if (st.stx_size != 0) {
+            // the segment was created by the previous instance of lockstep
+            output->last_timestamp = st.stx_mtime.tv_sec;
+            output->first_timestamp = (st.stx_mask & STATX_BTIME)
+                ? st.stx_btime.tv_sec : st.stx_mtime.tv_sec;
+        }
+    }
+    return 0;
+}
+
+static void
+output_reopen(output_type* output) {
+    if (output->path == NULL) { return; }
+    int old_fd = output->fd;
+    if (output_open(output) == -1) { return; }
+    if (close(old_fd) == -1) { perror("close"); }
+}
+
+/* Switch to the new file between the buffers, called by the writer thread. */
+static void
+output_switch(output_type* output) {
+    char* path = atomic_exchange(&output->new_path, NULL);
+    if (path == NULL) { return; }
+    writer_sync(output, 1);
+    const int old_fd = output->fd;
+    const char* old_path = output->path;
+    output->path = path;
+    if (output_open(output) == -1) {
+        output->path = old_path;
+        free(path);
+        return;
+    }
+    // the standard output is never closed
+    if (old_fd > 2 && close(old_fd) == -1) { perror("close"); }
+    free((void*)old_path);
+}
+
+static void
+format_segment_time(char* first, size_t n, time_t t) {
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    strftime(first, n, "%Y%m%dT%H%M%SZ", &tm);
+}
+
+/*
+Segments are named after the time range of their records:
+lockstep.log -> lockstep.20201231T000000Z--20201231T235959Z.log
+*/
+/* The size of the path without the extension. */
+static size_t
+output_stem_size(const char* path) {
+    const char* slash = strrchr(path, '/');
+    const char* dot = strrchr(path, '.');
+    if (dot == NULL || (slash != NULL && dot < slash) || dot == path || dot == slash+1) {
+        return strlen(path);
+    }
+    return dot-path;
+}
+
+static void
+segment_path(const output_type* output, char* result, size_t n) {
+    const char* path = output->path;
+    const char* dot = path + output_stem_size(path);
+    char first[32], last[32];
+    format_segment_time(first, sizeof(first), output->first_timestamp);
+    format_segment_time(last, sizeof(last), output->last_timestamp);
+    int base_size = (int)(dot-path);
+    snprintf(result, n, "%.*s.%s--%s%s", base_size, path, first, last, dot);
+    for (int i=1; access(result, F_OK) == 0; ++i) {
+        snprintf(result, n, "%.*s.%s--%s.%d%s", base_size, path, first, last, i, dot);
+    }
+}
+
+static void
+output_rotate(output_type* output) {
+    char path[PATH_MAX];
+    segment_path(output, path, sizeof(path));
+    if (rename(output->path, path) == -1) {
+        fprintf(stderr, "failed to rename %s to %s\n", output->path, path);
+        return;
+    }
+    writer_sync(output, 1);
+    output_reopen(output);
+    if (rotate_compress) { compress_push(path); }
+}
+
+/* Returns 1 if the suffix is the extension optionally followed by ".gz". */
+static int
+segment_extension_matches(const char* suffix, const char* extension) {
+    const size_t n = strlen(extension);
+    if (strncmp(suffix, extension, n) != 0) { return 0; }
+    return suffix[n] == 0 || strcmp(suffix+n, ".gz") == 0;
+}
+
+/* Returns 1 if the suffix after the time range is [.N]<extension>[.gz]. */
+static int
+segment_suffix_matches(const char* suffix, const char* extension) {
+    if (segment_extension_matches(suffix, extension)) { return 1; }
+    if (suffix[0] != '.' || !isdigit((unsigned char)suffix[1])) { return 0; }
+    ++suffix;
+    while (isdigit((unsigned char)*suffix)) { ++suffix; }
+    return segment_extension_matches(suffix, extension);
+}
+
+/*
+Returns 1 if the rotated segments of the two paths may have the same names
+or may be matched by output_expire of each other: the stems are the same
+and the extensions are the same, or one of them is empty and the other one
+looks like the ".N" or ".gz" suffix.
+*/
+static inline int
+output_names_collide(const char* a, const char* b) {
+    const size_t stem_size = output_stem_size(a);
+    if (stem_size != output_stem_size(b) || strncmp(a, b, stem_size) != 0) { return 0; }
+    const char* extension_a = a + stem_size;
+    const char* extension_b = b + stem_size;
+    if (*extension_a == 0) {
+        const char* tmp = extension_a;
+        extension_a = extension_b;
+        extension_b = tmp;
+    }
+    if (*extension_b != 0) { return strcmp(extension_a, extension_b) == 0; }
+    return segment_suffix_matches(extension_a, "");
+}
+
+/*
+Remove the rotated segments of the output (see segment_path) that end
+more than retention seconds before now, compressed or not. The names
+must match <stem>.<first time>--<last time>[.N]<extension>[.gz], so that
+the segments of the other outputs with the same stem are kept.
+*/
+static void
+output_expire(const output_type* output, unsigned long retention, time_t now) {
+    const char* path = output->path;
+    const char* slash = strrchr(path, '/');
+    const char* name = slash == NULL ? path : slash+1;
+    const char* extension = path + output_stem_size(path);
+    const size_t stem_size = extension-name;
+    char directory[PATH_MAX];
+    if (slash == NULL) { strcpy(directory, "."); }
+    else if (slash == path) { strcpy(directory, "/"); }
+    else { snprintf(directory, sizeof(directory), "%.*s", (int)(slash-path), path); }
+    DIR* dir = opendir(directory);
+    if (dir == NULL) { return; }
+    for (struct dirent* entry = readdir(dir); entry != NULL; entry = readdir(dir)) {
+        const char* first = entry->d_name;
+        if (strncmp(first, name, stem_size) != 0 || first[stem_size] != '.') { continue; }
+        // <stem>.<first time>--<last time>...
+        first += stem_size + 1;
+        if (strlen(first) < 34 || first[16] != '-' || first[17] != '-') { continue; }
+        if (!segment_suffix_matches(first+34, extension)) { continue; }
+        const time_t last_timestamp = parse_segment_time(first+18, first+34);
+        if (last_timestamp == -1 || last_timestamp + (time_t)retention >= now) { continue; }
+        if (unlinkat(dirfd(dir), entry->d_name, 0) == -1) {
+            fprintf(stderr, "failed to remove %s/%s\n", directory, entry->d_name);
+        }
+    }
+    if (closedir(dir) == -1) { perror("closedir"); }
+}
+
+static int
+output_needs_rotation(const output_type* output, const writer_buffer_type* b) {
+    if (output->path == NULL || output->size == 0) { return 0; }
+    if (rotate_size != 0 && output->size + b->size > rotate_size) { return 1; }
+    const unsigned long interval =
+        output->rotate_interval != 0 ? output->rotate_interval : rotate_interval;
+    if (interval != 0 && b->last_timestamp/interval != output->first_timestamp/interval) {
+        return 1;
+    }
+    return 0;
+}
+
+static void
+output_write_buffer(output_type* output, const writer_buffer_type* b) {
+    output_switch(output);
+    if (atomic_exchange(&output->reopen, 0)) { output_reopen(output); }
+    if (output_needs_rotation(output, b)) {
+        output_rotate(output);
+        const unsigned long retention =
+            output->retention != 0 ? output->retention : rotate_retention;
+        if (retention != 0) { output_expire(output, retention, b->last_timestamp); }
+    }
+    writer_write(output->fd, b->data, b->size);
+    if (output->size == 0) { output->first_timestamp = b->first_timestamp; }
+    output->last_timestamp = b->last_timestamp;
+    output->size += b->size;
+    writer_sync(output, 0);
+}
+
+static void*
+writer_main(void* arg) {
+    while (1) {
+        writer_buffer_type* b = writer_queue_wait(&writer_full);
+        if (b == NULL) {
+            if (!atomic_load(&writer_running)) { break; }
+            continue;
+        }
+        output_write_buffer(b->output, b);
+        if (b->close_output) {
+            if (writer_sync_interval != 0) { writer_sync(b->output, 1); }
+            if (close(b->output->fd) == -1) { perror("close"); }
+            free(b->output);
+        }
+        b->size = 0;
+        if (writer_queue_push(&writer_free, b) == -1) {
+            fputs("writer: free queue overflow\n", stderr);
+        }
+    }
+    return NULL;
+}
+
+/*
+Each of the noutputs outputs may hold one buffer that is being filled
+(see output_acquire), so the pool has that many buffers more than the queue.
+Otherwise the collector with WRITER_BLOCK policy could wait for the free
+buffer while all of them are held unflushed by the collector itself.
+*/
+static void
+writer_start(size_t noutputs) {
+    const size_t nbuffers = writer_queue_capacity + noutputs;
+    writer_queue_init(&writer_full, nbuffers);
+    writer_queue_init(&writer_free, nbuffers);
+    for (size_t i=0; i<nbuffers; ++i) {
+        writer_buffer_type* b = calloc(1, sizeof(writer_buffer_type));
+        if (b == NULL) { perror("calloc"); exit(1); }
+        writer_queue_push(&writer_free, b);
+    }
+    if (rotate_compress) { compress_start(); }
+    int ret = pthread_create(&writer_thread, NULL, writer_main, NULL);
+    if (ret != 0) {
+        errno = ret;
+        perror("pthread_create");
+        exit(1);
+    }
+}
+
+/*
+The buffer that is currently being filled by the collector.
+Each output has its own buffer, so that records of one output
+are never interleaved with records of another one.
+*/
+static writer_buffer_type*
+output_acquire(output_type* output, writer_buffer_type** current, time_t timestamp,
+               writer_policy_type policy) {
+    if (*current == NULL) {
+        writer_buffer_type* b = NULL;
+        if (policy == WRITER_BLOCK) {
+            b = writer_queue_wait(&writer_free);
+        } else {
+            b = writer_queue_try(&writer_free);
+        }
+        if (b == NULL) { return NULL; }
+        b->output = output;
+        b->size = 0;
+        b->close_output = 0;
+        b->first_timestamp = timestamp;
+        *current = b;
+    }
+    (*current)->last_timestamp = timestamp;
+    return *current;
+}
+
+static writer_buffer_type*
+output_buffer(output_type* output, writer_buffer_type** current, time_t timestamp) {
+    return output_acquire(output, current, timestamp, writer_policy);
+}
+
+/* Make room for at least n more bytes. */
+static void
+output_reserve(writer_buffer_type* b, size_t n) {
+    if (b->size + n > b->capacity) {
+        size_t new_capacity = b->capacity == 0 ? 4096*16 : b->capacity;
+        while (new_capacity < b->size + n) { new_capacity *= 2; }
+        char* data = realloc(b->data, new_capacity);
+        if (data == NULL) { perror("realloc"); exit(1); }
+        b->data = data;
+        b->capacity = new_capacity;
+    }
+}
+
+static void
+output_write(writer_buffer_type* b, const char* first, size_t n) {
+    output_reserve(b, n);
+    memcpy(b->data + b->size, first, n);
+    b->size += n;
+}
+
+/* Hand the buffer over to the writer thread. */
+static void
+output_flush(writer_buffer_type** current) {
+    writer_buffer_type* b = *current;
+    if (b == NULL) { return; }
+    if (b->size == 0 && !b->close_output) { return; }
+    if (writer_queue_push(&writer_full, b) == -1) {
+        // cannot happen: the number of buffers equals the capacity of the queue
+        fputs("writer: full queue overflow\n", stderr);
+        return;
+    }
+    *current = NULL;
+}
+
+static void
+writer_stop(output_type** outputs, size_t noutputs) {
+    atomic_store(&writer_running, 0);
+    sem_post(&writer_full.size);
+    int ret = pthread_join(writer_thread, NULL);
+    if (ret != 0) {
+        errno = ret;
+        perror("pthread_join");
+    }
+    for (size_t i=0; i<noutputs; ++i) {
+        writer_sync(outputs[i], 1);
+    }
+    compress_stop();
+    if (writer_dropped_ticks != 0) {
+        fprintf(stderr, "writer: dropped %lu ticks (%lu bytes)\n",
+                writer_dropped_ticks, writer_dropped_bytes);
+    }
+}
+
+#endif // vim:filetype=c
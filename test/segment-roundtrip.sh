@@ -0,0 +1,46 @@
+#!/bin/sh
+# Write the records of a short command both to the text file and to the
+# segments and check that lockstep-query aggregates the segments to the
+# same values as the text file. Usage: segment-roundtrip.sh lockstep lockstep-query
+set -e
+lockstep="$1"
+query="$2"
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+mkdir "$dir/segments"
+cat > "$dir/lockstep.conf" << EOF
+interval = 100ms
+process.fields = timestamp,pid,command,resident_set_size,cpu_percent
+process.output = $dir/records
+process.segments = $dir/segments
+EOF
+"$lockstep" -c "$dir/lockstep.conf" -- sh -c 'sleep 1; head -c 10000000 /dev/zero | tail -c 1 >/dev/null'
+if test "$(wc -l < "$dir/records")" -eq 0; then
+    echo "no records were written" >&2
+    exit 1
+fi
+check() {
+    if test "$1" != "$2"; then
+        printf '%s\nexpected: %s\nactual: %s\n' "$3" "$1" "$2" >&2
+        exit 1
+    fi
+}
+expected=$(awk -F'|' '
+{ n[$3]++; if (!($3 in max) || $4 > max[$3]) max[$3] = $4 }
+END { for (c in n) print c "|" n[c] "|" max[c] }' "$dir/records" | sort)
+actual=$("$query" -g command -a max:resident_set_size "$dir/segments" | tail -n +2 | sort)
+check "$expected" "$actual" "max(resident_set_size) differs"
+# the median resident set size splits the records in two
+threshold=$(cut -d'|' -f4 "$dir/records" | sort -n | awk '{ x[NR] = $1 } END { print x[int((NR+1)/2)] }')
+for op in '<' '<=' '=' '>=' '>'; do
+    expected=$(awk -F'|' -v t="$threshold" -v op="$op" '
+    (op == "<" && $4 < t) || (op == "<=" && $4 <= t) || (op == "=" && $4 == t) ||
+    (op == ">=" && $4 >= t) || (op == ">" && $4 > t) { n++ }
+    END { print n+0 }' "$dir/records")
+    actual=$("$query" -w "resident_set_size$op$threshold" "$dir/segments" | tail -n +2)
+    check "$expected" "${actual:-0}" "count(resident_set_size$op$threshold) differs"
+done
+# the segment is pruned by the maximum in the footer
+max=$(cut -d'|' -f4 "$dir/records" | sort -n | tail -n 1)
+"$query" -v -w "resident_set_size>$max" "$dir/segments" 2> "$dir/stats" > /dev/null
+check "scanned 1 segments, 0 blocks, 0 rows" "$(cat "$dir/stats")" "the segment was not pruned"
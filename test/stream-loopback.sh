@@ -0,0 +1,37 @@
+#!/bin/sh
+# Stream the records of a short command to lockstep-receiver over the
+# loopback interface and compare them with the records that lockstep
+# writes to the file. Usage: stream-loopback.sh lockstep lockstep-receiver
+set -e
+lockstep="$1"
+receiver="$2"
+dir=$(mktemp -d)
+receiver_pid=
+cleanup() {
+    if test -n "$receiver_pid"; then kill "$receiver_pid" 2>/dev/null || true; fi
+    rm -rf "$dir"
+}
+trap cleanup EXIT
+port=$((20000 + $$ % 20000))
+"$receiver" -o "$dir/received" "tcp://127.0.0.1:$port" &
+receiver_pid=$!
+sleep 1
+cat > "$dir/lockstep.conf" << EOF
+interval = 100ms
+process.fields = timestamp,pid,ppid,command,resident_set_size,userspace_time
+process.output = $dir/records
+stream.address = tcp://127.0.0.1:$port
+EOF
+"$lockstep" -c "$dir/lockstep.conf" -- sleep 1
+expected=$(wc -l < "$dir/records")
+if test "$expected" -eq 0; then
+    echo "no records were written" >&2
+    exit 1
+fi
+i=0
+while test "$(wc -l < "$dir/received")" -lt "$expected" && test "$i" -lt 50; do
+    sleep 0.1
+    i=$((i+1))
+done
+# the receiver prepends the host name to every record
+sed 's/^[^|]*|//' "$dir/received" | diff "$dir/records" -